@@ -0,0 +1,19 @@
+# - Try to find Zstd
+# Once done this will define
+#  Zstd_FOUND - System has Zstd
+#  Zstd_INCLUDE_DIRS - The Zstd include directories
+#  Zstd_LIBRARIES - The libraries needed to use Zstd
+
+find_path(Zstd_INCLUDE_DIR "zstd.h")
+find_library(Zstd_LIBRARY NAMES zstd)
+
+set(Zstd_LIBRARIES ${Zstd_LIBRARY})
+set(Zstd_INCLUDE_DIRS ${Zstd_INCLUDE_DIR})
+
+include(FindPackageHandleStandardArgs)
+# handle the QUIETLY and REQUIRED arguments and set Zstd_FOUND to TRUE
+# if all listed variables are TRUE
+find_package_handle_standard_args(
+    Zstd DEFAULT_MSG Zstd_LIBRARY Zstd_INCLUDE_DIR)
+
+mark_as_advanced(Zstd_INCLUDE_DIR Zstd_LIBRARY)
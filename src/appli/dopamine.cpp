@@ -6,6 +6,8 @@
  * for details.
  ************************************************************************/
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <fstream>
 #include <string>
@@ -16,8 +18,14 @@
 #include <log4cpp/Priority.hh>
 #include <mongo/client/dbclient.h>
 
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/archive/Storage.h"
 #include "dopamine/authentication/factory.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/bulk/factory.h"
 #include "dopamine/Configuration.h"
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/logging.h"
 #include "dopamine/Server.h"
 
 
@@ -70,22 +78,96 @@ int main(int argc, char** argv)
     logger.removeAllAppenders();
     logger.addAppender(appender);
 
+    // Each C-GET or C-MOVE holds a connection for its results while it
+    // waits for the connections reading the data sets: make sure that all
+    // associations can get them at the same time.
+    auto const required_connections =
+        configuration.get_max_associations()
+        *(1+std::max(1u, configuration.get_retrieve_prefetch()));
+    if(configuration.get_max_connections() < required_connections)
+    {
+        DOPAMINE_LOG(ERROR)
+            << "max_connections must be at least " << required_connections
+            << " with " << configuration.get_max_associations()
+            << " associations and a retrieve prefetch of "
+            << configuration.get_retrieve_prefetch() << ", not starting";
+        return EXIT_FAILURE;
+    }
+
     // Initialize the MongoDB client
     mongo::client::initialize();
 
-    // Create the MongoDB connection
-    mongo::DBClientConnection connection;
-    connection.connect(
+    // Create the MongoDB connection pool
+    dopamine::ConnectionPool connection_pool(
         configuration.get_mongo_host()+":"
-            +std::to_string(configuration.get_mongo_port()));
+            +std::to_string(configuration.get_mongo_port()),
+        configuration.get_min_connections(),
+        configuration.get_max_connections(),
+        std::chrono::seconds(configuration.get_idle_timeout()));
 
     // Create and run Network listener
     auto authenticator = dopamine::authentication::factory(
         configuration.get_authentication());
     dopamine::Server server(
-        connection,
+        connection_pool,
         configuration.get_database(), configuration.get_bulk_database(),
-        configuration.get_archive_port(), *authenticator);
+        configuration.get_archive_port(), *authenticator,
+        configuration.get_max_associations());
+    server.set_retrieve_prefetch(configuration.get_retrieve_prefetch());
+    server.get_query_plan_cache().set_capacity(
+        configuration.get_query_plan_cache_size());
+    server.get_acl().set_cache_ttl(
+        std::chrono::seconds(configuration.get_acl_cache_ttl()));
+    server.get_storage().set_gridfs_chunk_size(
+        configuration.get_gridfs_chunk_size());
+    server.get_storage().set_gridfs_readers(configuration.get_gridfs_readers());
+    server.get_storage().set_compression(
+        configuration.get_compression_level(),
+        configuration.get_compression_min_size());
+    auto const duplicates = dopamine::archive::Storage::parse_duplicates(
+        configuration.get_duplicates());
+    server.get_storage().set_duplicates(duplicates);
+    auto const schema = dopamine::as_schema(configuration.get_schema());
+    server.get_storage().set_schema(schema);
+    // Documents of the other schema would no longer be found.
+    auto const other_schema =
+        (schema == dopamine::Schema::Verbose)
+        ?dopamine::Schema::Compact:dopamine::Schema::Verbose;
+    if(server.get_storage().has_documents(other_schema))
+    {
+        DOPAMINE_LOG(ERROR)
+            << "The datasets collection holds documents stored with another "
+            << "schema than " << configuration.get_schema() << ", not starting";
+        return EXIT_FAILURE;
+    }
+    server.get_storage().set_bulk_storage(
+        dopamine::bulk::factory(configuration.get_bulk_storage()));
+    server.get_storage().set_batch(
+        configuration.get_batch_count(), configuration.get_batch_size(),
+        std::chrono::milliseconds(configuration.get_batch_delay()));
+
+    auto & index_manager = server.get_index_manager();
+    // Several data sets may share a SOP Instance UID without duplicates check.
+    index_manager.set_defaults(
+        schema, duplicates != dopamine::archive::Storage::Duplicates::None);
+    for(auto const & item: configuration.get_indexes())
+    {
+        index_manager.add_index(
+            dopamine::archive::IndexManager::parse_keys(
+                item.second, schema));
+    }
+    index_manager.set_report_threshold(
+        configuration.get_index_report_threshold());
+    auto const index_errors = index_manager.create_indexes();
+    if(index_errors != 0)
+    {
+        DOPAMINE_LOG(ERROR)
+            << "Could not create " << index_errors << " "
+            << (index_errors>1?"indexes":"index") << " of the datasets "
+            << "collection, not starting";
+        return EXIT_FAILURE;
+    }
+
     server.run();
 
     return EXIT_SUCCESS;
@@ -0,0 +1,100 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <log4cpp/Category.hh>
+#include <log4cpp/OstreamAppender.hh>
+#include <log4cpp/Priority.hh>
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/archive/Storage.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/bulk/factory.h"
+#include "dopamine/Configuration.h"
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/Exception.h"
+
+int main(int argc, char** argv)
+{
+    std::string const syntax = "dopamine_migrate -f CONFIG_FILE";
+    if(argc != 3 || std::string(argv[1]) != std::string("-f"))
+    {
+        std::cerr << "Syntax: " << syntax << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Read configuration file
+    std::string const config_path(argv[2]);
+    if(!boost::filesystem::exists(config_path))
+    {
+        std::cerr << "No such file: '" << config_path << "'\n";
+        std::cerr << "Syntax: " << syntax << "\n";
+        return 1;
+    }
+    std::ifstream config_stream(config_path);
+    dopamine::Configuration const configuration(config_stream);
+    if(!configuration.is_valid())
+    {
+        std::cerr << "Invalid configuration in '" << config_path << "'\n";
+        std::cerr << "Syntax: " << syntax << "\n";
+        return 1;
+    }
+
+    // Log the documents which cannot be migrated to the console
+    auto & logger = log4cpp::Category::getInstance("dopamine");
+    logger.setPriority(log4cpp::Priority::ERROR);
+    auto * appender = new log4cpp::OstreamAppender("console", &std::cerr);
+    appender->setLayout(new log4cpp::BasicLayout());
+    logger.removeAllAppenders();
+    logger.addAppender(appender);
+
+    mongo::client::initialize();
+
+    dopamine::ConnectionPool connection_pool(
+        configuration.get_mongo_host()+":"
+            +std::to_string(configuration.get_mongo_port()),
+        1, 2, std::chrono::seconds(configuration.get_idle_timeout()));
+
+    dopamine::archive::Storage storage(
+        connection_pool,
+        configuration.get_database(), configuration.get_bulk_database());
+    storage.set_schema(dopamine::as_schema(configuration.get_schema()));
+    storage.set_bulk_storage(
+        dopamine::bulk::factory(configuration.get_bulk_storage()));
+
+    try
+    {
+        auto const count = storage.migrate_content();
+        std::cout << "Migrated " << count << " data set(s)\n";
+
+        auto const metadata = storage.migrate_metadata();
+        std::cout
+            << "Updated the metadata of " << metadata << " data set(s)\n";
+
+        auto const summaries = storage.rebuild_summaries();
+        std::cout << "Checked the summaries of " << summaries << " value(s)\n";
+
+        // Keep the contents of the data sets being stored by a running
+        // server.
+        auto const orphans = storage.sweep_bulk_storage(std::chrono::hours(1));
+        std::cout << "Removed " << orphans << " orphan content(s)\n";
+    }
+    catch(dopamine::Exception const & e)
+    {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
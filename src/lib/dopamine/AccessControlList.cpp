@@ -8,13 +8,18 @@
 
 #include "dopamine/AccessControlList.h"
 
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <mongo/bson/bson.h>
 #include <mongo/client/dbclient.h>
 #include <odil/DataSet.h>
 
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/Exception.h"
 
 namespace dopamine
@@ -31,9 +36,9 @@ AccessControlList::Entry
 
 AccessControlList
 ::AccessControlList(
-    mongo::DBClientConnection & connection,
-    std::string const & database)
-: _connection(connection), _database()
+    ConnectionPool & connection_pool, std::string const & database,
+    std::chrono::seconds const & cache_ttl)
+: _connection_pool(connection_pool), _database(), _cache_ttl(cache_ttl)
 {
     this->set_database(database);
 }
@@ -57,6 +62,30 @@ AccessControlList
 {
     this->_database = database;
     this->_namespace = database+".authorization";
+    this->reload();
+}
+
+std::chrono::seconds const &
+AccessControlList
+::get_cache_ttl() const
+{
+    return this->_cache_ttl;
+}
+
+void
+AccessControlList
+::set_cache_ttl(std::chrono::seconds const & cache_ttl)
+{
+    this->_cache_ttl = cache_ttl;
+    this->reload();
+}
+
+void
+AccessControlList
+::reload()
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_cache.clear();
 }
 
 std::vector<AccessControlList::Entry>
@@ -64,7 +93,8 @@ AccessControlList
 ::get_entries() const
 {
     std::vector<AccessControlList::Entry> result;
-    auto cursor = this->_connection.query(this->_namespace);
+    auto connection = this->_connection_pool.acquire();
+    auto cursor = connection->query(this->_namespace);
     while(cursor->more())
     {
         auto const response = cursor->next();
@@ -81,26 +111,25 @@ void
 AccessControlList
 ::set_entries(std::vector<Entry> const & entries)
 {
-    this->_connection.remove(this->_namespace, mongo::Query());
+    auto connection = this->_connection_pool.acquire();
+    connection->remove(this->_namespace, mongo::Query());
     for(auto const & entry: entries)
     {
-        this->_connection.insert(
+        connection->insert(
             this->_namespace, BSON(
                 "principal_name" << entry.principal <<
                 "service" << entry.service <<
                 "dataset" << entry.constraint));
     }
+
+    this->reload();
 }
 
 bool
 AccessControlList
 ::is_allowed(std::string const & principal, std::string const & service) const
 {
-    // Return at most one record since we just need to know if there is a
-    // matching record
-    auto cursor = this->_connection.query(
-        this->_namespace, this->_get_query(principal, service), 1);
-    return (cursor->more());
+    return this->_get_cache_entry(principal, service).is_allowed;
 }
 
 mongo::BSONObj
@@ -108,12 +137,56 @@ AccessControlList
 ::get_constraints(
     std::string const & principal, std::string const & service) const
 {
-    mongo::BSONObj result;
+    return this->_get_cache_entry(principal, service).constraints;
+}
 
-    auto cursor = this->_connection.query(
+AccessControlList::CacheEntry
+AccessControlList
+::_get_cache_entry(
+    std::string const & principal, std::string const & service) const
+{
+    if(this->_cache_ttl.count() == 0)
+    {
+        return this->_fetch(principal, service);
+    }
+
+    auto const key = std::make_pair(principal, service);
+    auto const now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        auto const it = this->_cache.find(key);
+        if(it != this->_cache.end() && it->second.expiration > now)
+        {
+            return it->second;
+        }
+    }
+
+    // Do not hold the lock while querying the database: concurrent misses
+    // on the same key at worst query it several times.
+    auto const entry = this->_fetch(principal, service);
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_cache[key] = entry;
+    }
+
+    return entry;
+}
+
+AccessControlList::CacheEntry
+AccessControlList
+::_fetch(std::string const & principal, std::string const & service) const
+{
+    CacheEntry entry;
+    entry.is_allowed = false;
+    entry.expiration = std::chrono::steady_clock::now()+this->_cache_ttl;
+
+    auto connection = this->_connection_pool.acquire();
+    auto cursor = connection->query(
         this->_namespace, this->_get_query(principal, service));
     if(cursor->more())
     {
+        entry.is_allowed = true;
+
         mongo::BSONArrayBuilder constraints;
         bool allow_all = false;
 
@@ -159,11 +232,11 @@ AccessControlList
 
         if(!allow_all)
         {
-            result = BSON("$or" << constraints.arr());
+            entry.constraints = BSON("$or" << constraints.arr());
         }
     }
 
-    return result;
+    return entry;
 }
 
 mongo::BSONObj
@@ -9,16 +9,26 @@
 #ifndef _33bf2cd0_3580_4b1c_8335_7accf9832f26
 #define _33bf2cd0_3580_4b1c_8335_7accf9832f26
 
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <mongo/client/dbclient.h>
 
+#include "dopamine/ConnectionPool.h"
+
 namespace dopamine
 {
 
 /**
  * @brief Access control list of principals, services, and optional constraints.
+ *
+ * The results of is_allowed and get_constraints are cached for each principal
+ * and service. Cached results expire after a delay, and are cleared when the
+ * entries are set through this object or when reload is called.
  */
 class AccessControlList
 {
@@ -49,8 +59,8 @@ public:
 
     /// @brief Constructor.
     AccessControlList(
-        mongo::DBClientConnection & connection,
-        std::string const & database);
+        ConnectionPool & connection_pool, std::string const & database,
+        std::chrono::seconds const & cache_ttl=std::chrono::seconds(60));
 
     /// @brief Destructor.
     ~AccessControlList();
@@ -61,6 +71,15 @@ public:
     /// @brief Set the database name.
     void set_database(std::string const & database);
 
+    /// @brief Return the lifetime of cached results, 0 if not cached.
+    std::chrono::seconds const & get_cache_ttl() const;
+
+    /// @brief Set the lifetime of cached results, disable the cache if 0.
+    void set_cache_ttl(std::chrono::seconds const & cache_ttl);
+
+    /// @brief Clear the cached results.
+    void reload();
+
     /// @brief Return the access control list entries.
     std::vector<Entry> get_entries() const;
 
@@ -82,11 +101,30 @@ public:
         std::string const & principal, std::string const & service) const;
 
 private:
-    mongo::DBClientConnection & _connection;
+    struct CacheEntry
+    {
+        bool is_allowed;
+        mongo::BSONObj constraints;
+        std::chrono::steady_clock::time_point expiration;
+    };
+
+    ConnectionPool & _connection_pool;
 
     std::string _database;
     std::string _namespace;
 
+    std::chrono::seconds _cache_ttl;
+    mutable std::mutex _mutex;
+    mutable std::map<std::pair<std::string, std::string>, CacheEntry> _cache;
+
+    /// @brief Return the cached entry, query the database if needed.
+    CacheEntry _get_cache_entry(
+        std::string const & principal, std::string const & service) const;
+
+    /// @brief Query the database.
+    CacheEntry _fetch(
+        std::string const & principal, std::string const & service) const;
+
     static mongo::BSONObj _get_query(
         std::string const & principal, std::string const & service);
 };
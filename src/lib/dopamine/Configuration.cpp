@@ -65,9 +65,28 @@ Configuration
 {
     this->_mongo_host = nullptr;
     this->_mongo_port = 27017;
+    this->_min_connections = 1;
+    this->_max_connections = 16;
+    this->_idle_timeout = 60;
+    this->_batch_count = 1;
+    this->_batch_size = 8000000;
+    this->_batch_delay = 10;
+    this->_acl_cache_ttl = 60;
+    this->_gridfs_chunk_size = 261120;
+    this->_gridfs_readers = 4;
+    this->_compression_level = 0;
+    this->_compression_min_size = 65536;
+    this->_duplicates = "none";
+    this->_schema = "verbose";
     this->_database = nullptr;
     this->_bulk_database = "";
     this->_archive_port = nullptr;
+    this->_max_associations = 1;
+    this->_retrieve_prefetch = 2;
+    this->_query_plan_cache_size = 256;
+    this->_indexes.clear();
+    this->_index_report_threshold = 100;
+    this->_bulk_storage.clear();
     this->_authentication.clear();
     this->_logger_priority = "WARN";
     this->_logger_destination = "";
@@ -77,12 +96,47 @@ Configuration
 
     set(tree, "database.hostname", this->_mongo_host);
     set(tree, "database.port", this->_mongo_port);
+    set(tree, "database.min_connections", this->_min_connections);
+    set(tree, "database.max_connections", this->_max_connections);
+    set(tree, "database.idle_timeout", this->_idle_timeout);
+    set(tree, "database.batch_count", this->_batch_count);
+    set(tree, "database.batch_size", this->_batch_size);
+    set(tree, "database.batch_delay", this->_batch_delay);
+    set(tree, "database.acl_cache_ttl", this->_acl_cache_ttl);
+    set(tree, "database.gridfs_chunk_size", this->_gridfs_chunk_size);
+    set(tree, "database.gridfs_readers", this->_gridfs_readers);
+    set(tree, "database.compression_level", this->_compression_level);
+    set(tree, "database.compression_min_size", this->_compression_min_size);
+    set(tree, "database.duplicates", this->_duplicates);
+    set(tree, "database.schema", this->_schema);
     set(tree, "database.dbname", this->_database);
     set(tree, "database.bulk_data", this->_bulk_database);
     set(tree, "dicom.port", this->_archive_port);
+    set(tree, "dicom.max_associations", this->_max_associations);
+    set(tree, "dicom.retrieve_prefetch", this->_retrieve_prefetch);
+    set(tree, "dicom.query_plan_cache_size", this->_query_plan_cache_size);
+    set(tree, "database.index_report_threshold", this->_index_report_threshold);
     set(tree, "logger.priority", this->_logger_priority);
     set(tree, "logger.destination", this->_logger_destination);
 
+    auto const & indexes = tree.get_child_optional("indexes");
+    if(indexes)
+    {
+        for(auto const & item: indexes.get())
+        {
+            this->_indexes[item.first] = item.second.data();
+        }
+    }
+
+    auto const & bulk_storage = tree.get_child_optional("bulk_storage");
+    if(bulk_storage)
+    {
+        for(auto const & item: bulk_storage.get())
+        {
+            this->_bulk_storage[item.first] = item.second.data();
+        }
+    }
+
     auto const & authentication = tree.get_child_optional("authentication");
     if(authentication)
     {
@@ -123,6 +177,97 @@ Configuration
     return this->_mongo_port;
 }
 
+unsigned int
+Configuration
+::get_min_connections() const
+{
+    return this->_min_connections;
+}
+
+unsigned int
+Configuration
+::get_max_connections() const
+{
+    return this->_max_connections;
+}
+
+unsigned int
+Configuration
+::get_idle_timeout() const
+{
+    return this->_idle_timeout;
+}
+
+unsigned int
+Configuration
+::get_batch_count() const
+{
+    return this->_batch_count;
+}
+
+unsigned int
+Configuration
+::get_batch_size() const
+{
+    return this->_batch_size;
+}
+
+unsigned int
+Configuration
+::get_batch_delay() const
+{
+    return this->_batch_delay;
+}
+
+unsigned int
+Configuration
+::get_acl_cache_ttl() const
+{
+    return this->_acl_cache_ttl;
+}
+
+unsigned int
+Configuration
+::get_gridfs_chunk_size() const
+{
+    return this->_gridfs_chunk_size;
+}
+
+unsigned int
+Configuration
+::get_gridfs_readers() const
+{
+    return this->_gridfs_readers;
+}
+
+int
+Configuration
+::get_compression_level() const
+{
+    return this->_compression_level;
+}
+
+unsigned int
+Configuration
+::get_compression_min_size() const
+{
+    return this->_compression_min_size;
+}
+
+std::string const &
+Configuration
+::get_duplicates() const
+{
+    return this->_duplicates;
+}
+
+std::string const &
+Configuration
+::get_schema() const
+{
+    return this->_schema;
+}
+
 std::string const &
 Configuration
 ::get_database() const
@@ -158,6 +303,48 @@ Configuration
     }
 }
 
+unsigned int
+Configuration
+::get_max_associations() const
+{
+    return this->_max_associations;
+}
+
+unsigned int
+Configuration
+::get_retrieve_prefetch() const
+{
+    return this->_retrieve_prefetch;
+}
+
+unsigned int
+Configuration
+::get_query_plan_cache_size() const
+{
+    return this->_query_plan_cache_size;
+}
+
+std::map<std::string, std::string> const &
+Configuration
+::get_indexes() const
+{
+    return this->_indexes;
+}
+
+unsigned int
+Configuration
+::get_index_report_threshold() const
+{
+    return this->_index_report_threshold;
+}
+
+std::map<std::string, std::string> const &
+Configuration
+::get_bulk_storage() const
+{
+    return this->_bulk_storage;
+}
+
 std::map<std::string, std::string> const &
 Configuration
 ::get_authentication() const
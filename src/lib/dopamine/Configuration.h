@@ -36,6 +36,45 @@ public:
     /// @brief Return the MongoDB port, default to 27017.
     uint16_t get_mongo_port() const;
 
+    /// @brief Return the minimum number of MongoDB connections kept open, default to 1.
+    unsigned int get_min_connections() const;
+
+    /// @brief Return the maximum number of open MongoDB connections, default to 16.
+    unsigned int get_max_connections() const;
+
+    /// @brief Return the delay in seconds after which idle MongoDB connections are closed, default to 60.
+    unsigned int get_idle_timeout() const;
+
+    /// @brief Return the maximum number of metadata documents inserted in a single batch, default to 1 (no batch).
+    unsigned int get_batch_count() const;
+
+    /// @brief Return the maximum size in bytes of a batch of metadata documents, default to 8000000.
+    unsigned int get_batch_size() const;
+
+    /// @brief Return the maximum delay in milliseconds to fill a batch of metadata documents, default to 10.
+    unsigned int get_batch_delay() const;
+
+    /// @brief Return the delay in seconds after which cached access control results expire, default to 60 (0 disables the cache).
+    unsigned int get_acl_cache_ttl() const;
+
+    /// @brief Return the size of the GridFS chunks of the stored data sets, default to 261120.
+    unsigned int get_gridfs_chunk_size() const;
+
+    /// @brief Return the maximum number of parallel reads of a GridFS file, default to 4.
+    unsigned int get_gridfs_readers() const;
+
+    /// @brief Return the zstd compression level of the stored data sets, default to 0 (no compression).
+    int get_compression_level() const;
+
+    /// @brief Return the minimum size of the compressed data sets, default to 65536.
+    unsigned int get_compression_min_size() const;
+
+    /// @brief Return the handling of already stored data sets, default to "none".
+    std::string const & get_duplicates() const;
+
+    /// @brief Return the schema of the metadata documents, default to "verbose".
+    std::string const & get_schema() const;
+
     /// @brief Return the main MongoDB database, or throw an exception if none was defined.
     std::string const & get_database() const;
 
@@ -45,6 +84,24 @@ public:
     /// @brief Return the port on which the DICOM archive listens, or throw an exception if none was defined.
     uint16_t get_archive_port() const;
 
+    /// @brief Return the maximum number of concurrent associations, default to 1.
+    unsigned int get_max_associations() const;
+
+    /// @brief Return the number of data sets read ahead by C-GET and C-MOVE, default to 2.
+    unsigned int get_retrieve_prefetch() const;
+
+    /// @brief Return the maximum number of cached query plans, default to 256.
+    unsigned int get_query_plan_cache_size() const;
+
+    /// @brief Return the additional indexes, by name, as comma-separated lists of tags or fields.
+    std::map<std::string, std::string> const & get_indexes() const;
+
+    /// @brief Return the number of times a query must be seen before it is reported as missing an index, default to 100.
+    unsigned int get_index_report_threshold() const;
+
+    /// @brief Return the bulk storage data, empty if the content is stored in MongoDB.
+    std::map<std::string, std::string> const & get_bulk_storage() const;
+
     /// @brief Return the authentication data.
     std::map<std::string, std::string> const & get_authentication() const;
 
@@ -57,6 +114,19 @@ public:
 private:
     std::shared_ptr<std::string> _mongo_host;
     uint16_t _mongo_port;
+    unsigned int _min_connections;
+    unsigned int _max_connections;
+    unsigned int _idle_timeout;
+    unsigned int _batch_count;
+    unsigned int _batch_size;
+    unsigned int _batch_delay;
+    unsigned int _acl_cache_ttl;
+    unsigned int _gridfs_chunk_size;
+    unsigned int _gridfs_readers;
+    int _compression_level;
+    unsigned int _compression_min_size;
+    std::string _duplicates;
+    std::string _schema;
 
     // FIXME: mongo auth
     // http://api.mongodb.com/cplusplus/2.6.1/classmongo_1_1_d_b_client_with_commands.html#aef21a401b2151f3f35c77c0b9c7e00d0
@@ -67,6 +137,14 @@ private:
     std::string _bulk_database;
 
     std::shared_ptr<uint16_t> _archive_port;
+    unsigned int _max_associations;
+    unsigned int _retrieve_prefetch;
+    unsigned int _query_plan_cache_size;
+
+    std::map<std::string, std::string> _indexes;
+    unsigned int _index_report_threshold;
+
+    std::map<std::string, std::string> _bulk_storage;
 
     std::map<std::string, std::string> _authentication;
 
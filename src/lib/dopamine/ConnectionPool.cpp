@@ -0,0 +1,308 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/ConnectionPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/Exception.h"
+
+namespace dopamine
+{
+
+ConnectionPool::Connection
+::Connection(
+    ConnectionPool & pool,
+    std::unique_ptr<mongo::DBClientConnection> connection)
+: _pool(&pool), _connection(std::move(connection))
+{
+    // Nothing else.
+}
+
+ConnectionPool::Connection
+::Connection(Connection && other)
+: _pool(other._pool), _connection(std::move(other._connection))
+{
+    other._pool = nullptr;
+}
+
+ConnectionPool::Connection &
+ConnectionPool::Connection
+::operator=(Connection && other)
+{
+    if(this != &other)
+    {
+        if(this->_pool && this->_connection)
+        {
+            this->_pool->_release(std::move(this->_connection));
+        }
+        this->_pool = other._pool;
+        this->_connection = std::move(other._connection);
+        other._pool = nullptr;
+    }
+    return *this;
+}
+
+ConnectionPool::Connection
+::~Connection()
+{
+    if(this->_pool && this->_connection)
+    {
+        this->_pool->_release(std::move(this->_connection));
+    }
+}
+
+mongo::DBClientConnection &
+ConnectionPool::Connection
+::operator*() const
+{
+    return *this->_connection;
+}
+
+mongo::DBClientConnection *
+ConnectionPool::Connection
+::operator->() const
+{
+    return this->_connection.get();
+}
+
+ConnectionPool
+::ConnectionPool(
+    std::string const & host,
+    unsigned int min_connections, unsigned int max_connections,
+    std::chrono::seconds const & idle_timeout)
+: _host(host), _min_connections(min_connections),
+  _max_connections(std::max(1u, max_connections)), _idle_timeout(idle_timeout),
+  _acquire_timeout(30), _size(0)
+{
+    // Nothing else.
+}
+
+ConnectionPool
+::~ConnectionPool()
+{
+    // Nothing to do: idle connections are closed by their destructor.
+}
+
+std::string const &
+ConnectionPool
+::get_host() const
+{
+    return this->_host;
+}
+
+unsigned int
+ConnectionPool
+::get_min_connections() const
+{
+    return this->_min_connections;
+}
+
+unsigned int
+ConnectionPool
+::get_max_connections() const
+{
+    return this->_max_connections;
+}
+
+std::chrono::seconds const &
+ConnectionPool
+::get_idle_timeout() const
+{
+    return this->_idle_timeout;
+}
+
+std::chrono::seconds const &
+ConnectionPool
+::get_acquire_timeout() const
+{
+    return this->_acquire_timeout;
+}
+
+void
+ConnectionPool
+::set_acquire_timeout(std::chrono::seconds const & timeout)
+{
+    this->_acquire_timeout = timeout;
+}
+
+unsigned int
+ConnectionPool
+::size() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_size;
+}
+
+unsigned int
+ConnectionPool
+::idle() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_idle.size();
+}
+
+ConnectionPool::Connection
+ConnectionPool
+::acquire()
+{
+    auto connection = this->_acquire(true);
+    if(!connection)
+    {
+        throw Exception("No MongoDB connection available");
+    }
+    return std::move(*connection);
+}
+
+std::unique_ptr<ConnectionPool::Connection>
+ConnectionPool
+::try_acquire()
+{
+    return this->_acquire(false);
+}
+
+std::unique_ptr<ConnectionPool::Connection>
+ConnectionPool
+::_acquire(bool wait)
+{
+    auto const deadline =
+        std::chrono::steady_clock::now()+this->_acquire_timeout;
+
+    while(true)
+    {
+        std::unique_ptr<mongo::DBClientConnection> connection;
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_prune();
+
+            auto const is_available = [this]() {
+                return (
+                    !this->_idle.empty()
+                    || this->_size < this->_max_connections);
+            };
+            auto const available =
+                wait
+                ?this->_condition.wait_until(lock, deadline, is_available)
+                :is_available();
+            if(!available)
+            {
+                return nullptr;
+            }
+
+            if(!this->_idle.empty())
+            {
+                // Re-use the most recently returned connection.
+                connection = std::move(this->_idle.back().connection);
+                this->_idle.pop_back();
+            }
+            else
+            {
+                // Reserve a slot for a new connection.
+                ++this->_size;
+            }
+        }
+
+        if(connection)
+        {
+            // Health check: do not hand out a connection whose socket was
+            // closed while it was idle.
+            if(connection->isFailed() || !connection->isStillConnected())
+            {
+                connection.reset();
+                this->_discard();
+                continue;
+            }
+        }
+        else
+        {
+            try
+            {
+                connection = this->_connect();
+            }
+            catch(...)
+            {
+                this->_discard();
+                throw;
+            }
+        }
+
+        return std::unique_ptr<Connection>(
+            new Connection(*this, std::move(connection)));
+    }
+}
+
+std::unique_ptr<mongo::DBClientConnection>
+ConnectionPool
+::_connect() const
+{
+    std::unique_ptr<mongo::DBClientConnection> connection(
+        new mongo::DBClientConnection());
+    try
+    {
+        connection->connect(this->_host);
+    }
+    catch(mongo::DBException const & e)
+    {
+        throw Exception(
+            "Could not connect to MongoDB on "+this->_host+": "+e.what());
+    }
+    return connection;
+}
+
+void
+ConnectionPool
+::_release(std::unique_ptr<mongo::DBClientConnection> connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        if(connection->isFailed())
+        {
+            --this->_size;
+        }
+        else
+        {
+            this->_idle.push_back(
+                { std::move(connection), std::chrono::steady_clock::now() });
+        }
+        this->_prune();
+    }
+    this->_condition.notify_one();
+}
+
+void
+ConnectionPool
+::_discard()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        --this->_size;
+    }
+    this->_condition.notify_one();
+}
+
+void
+ConnectionPool
+::_prune()
+{
+    auto const now = std::chrono::steady_clock::now();
+    while(
+        !this->_idle.empty() && this->_size > this->_min_connections
+        && now-this->_idle.front().since > this->_idle_timeout)
+    {
+        this->_idle.pop_front();
+        --this->_size;
+    }
+}
+
+} // namespace dopamine
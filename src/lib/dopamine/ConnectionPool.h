@@ -0,0 +1,144 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _5f0e7c1a_3b6d_4e0b_9a52_8c4f2d6b71e3
+#define _5f0e7c1a_3b6d_4e0b_9a52_8c4f2d6b71e3
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+
+namespace dopamine
+{
+
+/**
+ * @brief Thread-safe pool of connections to a MongoDB server.
+ *
+ * Connections are opened on demand, up to a maximum number, and are checked
+ * for failure when they are checked out. Idle connections above the minimum
+ * number are closed after a timeout.
+ */
+class ConnectionPool
+{
+public:
+    /// @brief Connection checked out of the pool, returned at destruction.
+    class Connection
+    {
+    public:
+        Connection(Connection && other);
+        Connection & operator=(Connection && other);
+
+        Connection(Connection const &) = delete;
+        Connection & operator=(Connection const &) = delete;
+
+        ~Connection();
+
+        mongo::DBClientConnection & operator*() const;
+        mongo::DBClientConnection * operator->() const;
+
+    private:
+        friend class ConnectionPool;
+
+        ConnectionPool * _pool;
+        std::unique_ptr<mongo::DBClientConnection> _connection;
+
+        Connection(
+            ConnectionPool & pool,
+            std::unique_ptr<mongo::DBClientConnection> connection);
+    };
+
+    /// @brief Constructor, no connection is opened until the first checkout.
+    ConnectionPool(
+        std::string const & host,
+        unsigned int min_connections=1, unsigned int max_connections=16,
+        std::chrono::seconds const & idle_timeout=std::chrono::seconds(60));
+
+    /// @brief Destructor, all connections must have been returned.
+    ~ConnectionPool();
+
+    /// @brief Return the host (and optional port) of the MongoDB server.
+    std::string const & get_host() const;
+
+    /// @brief Return the minimum number of connections kept open.
+    unsigned int get_min_connections() const;
+
+    /// @brief Return the maximum number of open connections.
+    unsigned int get_max_connections() const;
+
+    /// @brief Return the delay after which idle connections are closed.
+    std::chrono::seconds const & get_idle_timeout() const;
+
+    /// @brief Return the maximum delay to wait for a connection, default to 30s.
+    std::chrono::seconds const & get_acquire_timeout() const;
+
+    /// @brief Set the maximum delay to wait for a connection.
+    void set_acquire_timeout(std::chrono::seconds const & timeout);
+
+    /// @brief Return the number of open connections, idle or checked-out.
+    unsigned int size() const;
+
+    /// @brief Return the number of idle connections.
+    unsigned int idle() const;
+
+    /**
+     * @brief Check out a connection, wait until one is available if the
+     * maximum number is reached; throw an exception if no connection is
+     * available within the acquire timeout or if the server is unreachable.
+     */
+    Connection acquire();
+
+    /**
+     * @brief Check out a connection if one is available without waiting,
+     * return null otherwise; throw an exception if the server is
+     * unreachable.
+     */
+    std::unique_ptr<Connection> try_acquire();
+
+private:
+    struct IdleConnection
+    {
+        std::unique_ptr<mongo::DBClientConnection> connection;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::string _host;
+    unsigned int _min_connections;
+    unsigned int _max_connections;
+    std::chrono::seconds _idle_timeout;
+    std::chrono::seconds _acquire_timeout;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _condition;
+    /// @brief Idle connections, least recently used first.
+    std::deque<IdleConnection> _idle;
+    unsigned int _size;
+
+    /**
+     * @brief Check out a connection, waiting until the acquire timeout if
+     * requested; return null if none is available.
+     */
+    std::unique_ptr<Connection> _acquire(bool wait);
+
+    std::unique_ptr<mongo::DBClientConnection> _connect() const;
+
+    void _release(std::unique_ptr<mongo::DBClientConnection> connection);
+
+    void _discard();
+
+    /// @brief Close expired idle connections, mutex must be locked.
+    void _prune();
+};
+
+} // namespace dopamine
+
+#endif // _5f0e7c1a_3b6d_4e0b_9a52_8c4f2d6b71e3
@@ -8,10 +8,17 @@
 
 #include "dopamine/Server.h"
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <mongo/client/dbclient.h>
@@ -32,6 +39,7 @@
 #include "dopamine/archive/QueryDataSetGenerator.h"
 #include "dopamine/archive/Storage.h"
 #include "dopamine/archive/store.h"
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/logging.h"
 #include "dopamine/utils.h"
 
@@ -40,12 +48,16 @@ namespace dopamine
 
 Server
 ::Server(
-    mongo::DBClientConnection & connection,
+    ConnectionPool & connection_pool,
     std::string const & database, std::string const & bulk_database,
-    uint16_t port, authentication::AuthenticatorBase const & authenticator)
-: _connection(connection), _database(database), _bulk_database(bulk_database),
-  _port(port), _authenticator(authenticator), _acl(connection, database),
-  _storage(connection, database, bulk_database), _is_running(false)
+    uint16_t port, authentication::AuthenticatorBase const & authenticator,
+    unsigned int max_associations)
+: _connection_pool(connection_pool), _database(database),
+  _bulk_database(bulk_database), _port(port), _authenticator(authenticator),
+  _max_associations(std::max(1u, max_associations)), _retrieve_prefetch(2),
+  _acl(connection_pool, database),
+  _storage(connection_pool, database, bulk_database),
+  _index_manager(connection_pool, database), _is_running(false)
 {
     // Nothing else.
 }
@@ -56,17 +68,94 @@ Server
     // Nothing to do.
 }
 
+unsigned int
+Server
+::get_max_associations() const
+{
+    return this->_max_associations;
+}
+
+unsigned int
+Server
+::get_retrieve_prefetch() const
+{
+    return this->_retrieve_prefetch;
+}
+
+void
+Server
+::set_retrieve_prefetch(unsigned int retrieve_prefetch)
+{
+    this->_retrieve_prefetch = retrieve_prefetch;
+}
+
+AccessControlList &
+Server
+::get_acl()
+{
+    return this->_acl;
+}
+
+archive::Storage &
+Server
+::get_storage()
+{
+    return this->_storage;
+}
+
+archive::IndexManager &
+Server
+::get_index_manager()
+{
+    return this->_index_manager;
+}
+
+archive::QueryPlanCache &
+Server
+::get_query_plan_cache()
+{
+    return this->_query_plan_cache;
+}
+
 void
 Server
 ::run()
 {
-    this->_is_running = true;
-    while(this->_is_running)
     {
-        this->_association = std::make_shared<odil::Association>();
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_is_running = true;
+    }
+
+    std::vector<std::thread> workers;
+    for(unsigned int i=0; i<this->_max_associations; ++i)
+    {
+        workers.emplace_back(&Server::_work, this);
+    }
+
+    while(true)
+    {
+        std::shared_ptr<odil::Association> association;
+        {
+            // Wait for a free worker before accepting the next association.
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_condition.wait(
+                lock, [this]() {
+                    return (
+                        !this->_is_running
+                        || this->_pending.size()+this->_active.size()
+                            < this->_max_associations);
+                });
+            if(!this->_is_running)
+            {
+                break;
+            }
+            this->_association = std::make_shared<odil::Association>();
+            association = this->_association;
+        }
+
         try
         {
-            this->_association->receive_association(
+            association->receive_association(
                 boost::asio::ip::tcp::v4(), this->_port,
                 std::bind(
                     Server::_acceptor, std::placeholders::_1,
@@ -76,11 +165,12 @@ Server
         {
             DOPAMINE_LOG(DEBUG)
                 << "Incoming association from "
-                << this->_association->get_transport().get_socket()->remote_endpoint().address()
+                << Server::_get_peer(*association)
                 << "/"
-                << this->_association->get_parameters().get_calling_ae_title()
+                << association->get_parameters().get_calling_ae_title()
                 << "rejected";
             // FIXME: close ?
+            std::lock_guard<std::mutex> lock(this->_mutex);
             this->_association = nullptr;
             continue;
         }
@@ -90,61 +180,22 @@ Server
                 << "Failed receiving association: "
                 << e.what() << " (" << typeid(e).name() << ")";
             // FIXME: close ?
+            std::lock_guard<std::mutex> lock(this->_mutex);
             this->_association = nullptr;
             continue;
         }
 
-        DOPAMINE_LOG(INFO)
-            << "Association received from "
-            << this->_association->get_transport().get_socket()->remote_endpoint().address()
-            << " ("
-            << this->_association->get_negotiated_parameters().get_calling_ae_title()
-            << " -> "
-            << this->_association->get_negotiated_parameters().get_called_ae_title()
-            << ")";
-        DOPAMINE_LOG(DEBUG) << "Negotiated presentation contexts: ";
-        for(auto const & pc: this->_association->get_negotiated_parameters().get_presentation_contexts())
-        {
-            DOPAMINE_LOG(DEBUG)
-                << get_uid_name(pc.abstract_syntax) << " / "
-                << get_uid_name(pc.transfer_syntaxes[0]) << " "
-                << (pc.scu_role_support?"SCU":"")
-                << (pc.scu_role_support&&pc.scp_role_support?"/":"")
-                << (pc.scp_role_support?"SCP":"");
-        }
-
-        auto dispatcher = this->_get_dispatcher(*this->_association);
-
-        bool done = false;
-        while(!done)
         {
-            try
-            {
-                dispatcher.dispatch();
-            }
-            catch(odil::AssociationReleased const &)
-            {
-                DOPAMINE_LOG(INFO)
-                    << "Association released from "
-                    << this->_association->get_transport().get_socket()->remote_endpoint().address();
-                done = true;
-            }
-            catch(odil::AssociationAborted const &)
-            {
-                DOPAMINE_LOG(INFO)
-                    << "Association aborted from "
-                    << this->_association->get_transport().get_socket()->remote_endpoint().address();
-                done = true;
-            }
-            catch(std::exception const & e)
-            {
-                DOPAMINE_LOG(ERROR)
-                    << "Failed dispatching messages: " << e.what();
-                done = true;
-            }
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_pending.push(association);
+            this->_association = nullptr;
         }
+        this->_condition.notify_all();
+    }
 
-        this->_association = nullptr;
+    for(auto & worker: workers)
+    {
+        worker.join();
     }
 }
 
@@ -152,8 +203,24 @@ void
 Server
 ::shutdown()
 {
-    this->_is_running = false;
-    this->_association->get_transport().close();
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_is_running = false;
+        if(this->_association)
+        {
+            this->_association->get_transport().close();
+        }
+        while(!this->_pending.empty())
+        {
+            this->_pending.front()->get_transport().close();
+            this->_pending.pop();
+        }
+        for(auto const & association: this->_active)
+        {
+            association->get_transport().close();
+        }
+    }
+    this->_condition.notify_all();
 }
 
 odil::AssociationParameters
@@ -204,42 +271,178 @@ Server
        return output;
    };
 
+std::string
+Server
+::_get_peer(odil::Association & association)
+{
+    auto const socket = association.get_transport().get_socket();
+    if(!socket)
+    {
+        return std::string();
+    }
+
+    boost::system::error_code error;
+    auto const endpoint = socket->remote_endpoint(error);
+    return error?std::string():endpoint.address().to_string();
+}
+
+void
+Server
+::_work()
+{
+    while(true)
+    {
+        std::shared_ptr<odil::Association> association;
+        {
+            std::unique_lock<std::mutex> lock(this->_mutex);
+            this->_condition.wait(
+                lock, [this]() {
+                    return !this->_is_running || !this->_pending.empty();
+                });
+            if(!this->_is_running)
+            {
+                break;
+            }
+            association = this->_pending.front();
+            this->_pending.pop();
+            this->_active.insert(association);
+        }
+
+        // An exception escaping the worker would terminate the server.
+        try
+        {
+            this->_handle(*association);
+        }
+        catch(std::exception const & e)
+        {
+            DOPAMINE_LOG(ERROR)
+                << "Failed handling association: "
+                << e.what() << " (" << typeid(e).name() << ")";
+        }
+        catch(...)
+        {
+            DOPAMINE_LOG(ERROR) << "Failed handling association";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            this->_active.erase(association);
+        }
+        this->_condition.notify_all();
+    }
+}
+
+void
+Server
+::_handle(odil::Association & association)
+{
+    DOPAMINE_LOG(INFO)
+        << "Association received from "
+        << Server::_get_peer(association)
+        << " ("
+        << association.get_negotiated_parameters().get_calling_ae_title()
+        << " -> "
+        << association.get_negotiated_parameters().get_called_ae_title()
+        << ")";
+    DOPAMINE_LOG(DEBUG) << "Negotiated presentation contexts: ";
+    for(auto const & pc: association.get_negotiated_parameters().get_presentation_contexts())
+    {
+        DOPAMINE_LOG(DEBUG)
+            << get_uid_name(pc.abstract_syntax) << " / "
+            << get_uid_name(pc.transfer_syntaxes[0]) << " "
+            << (pc.scu_role_support?"SCU":"")
+            << (pc.scu_role_support&&pc.scp_role_support?"/":"")
+            << (pc.scp_role_support?"SCP":"");
+    }
+
+    auto dispatcher = this->_get_dispatcher(association);
+
+    bool done = false;
+    while(!done)
+    {
+        try
+        {
+            dispatcher.dispatch();
+        }
+        catch(odil::AssociationReleased const &)
+        {
+            DOPAMINE_LOG(INFO)
+                << "Association released from "
+                << Server::_get_peer(association);
+            done = true;
+        }
+        catch(odil::AssociationAborted const &)
+        {
+            DOPAMINE_LOG(INFO)
+                << "Association aborted from "
+                << Server::_get_peer(association);
+            done = true;
+        }
+        catch(std::exception const & e)
+        {
+            DOPAMINE_LOG(ERROR)
+                << "Failed dispatching messages: " << e.what();
+            done = true;
+        }
+    }
+}
+
 odil::SCPDispatcher
 Server
-::_get_dispatcher(odil::Association & association) const
+::_get_dispatcher(odil::Association & association)
 {
    odil::SCPDispatcher dispatcher(association);
 
    auto echo_scp = std::make_shared<odil::EchoSCP>(
        association, std::bind(
-           archive::echo, std::ref(this->_connection), this->_acl,
+           archive::echo, std::ref(this->_connection_pool), std::ref(this->_acl),
            association.get_negotiated_parameters(), std::placeholders::_1));
    dispatcher.set_scp(odil::message::Message::Command::C_ECHO_RQ, echo_scp);
 
-   auto find_scp = std::make_shared<odil::FindSCP>(
-       association, std::make_shared<archive::QueryDataSetGenerator>(
-           this->_connection, this->_acl, this->_database,
-           association.get_negotiated_parameters()));
+   auto const find_generator = std::make_shared<archive::QueryDataSetGenerator>(
+       this->_connection_pool, this->_acl, this->_database,
+       association.get_negotiated_parameters());
+   find_generator->set_index_manager(&this->_index_manager);
+   find_generator->set_query_plan_cache(&this->_query_plan_cache);
+   find_generator->set_schema(this->_storage.get_schema());
+   auto find_scp = std::make_shared<odil::FindSCP>(association, find_generator);
    dispatcher.set_scp(odil::message::Message::Command::C_FIND_RQ, find_scp);
 
-   auto get_scp = std::make_shared<odil::GetSCP>(
-       association, std::make_shared<archive::GetDataSetGenerator>(
-           this->_connection, this->_acl,
-           this->_database, this->_bulk_database,
-           association.get_negotiated_parameters()));
+   auto const get_generator = std::make_shared<archive::GetDataSetGenerator>(
+       this->_connection_pool, this->_acl,
+       this->_database, this->_bulk_database,
+       association.get_negotiated_parameters());
+   get_generator->set_index_manager(&this->_index_manager);
+   get_generator->set_query_plan_cache(&this->_query_plan_cache);
+   get_generator->set_prefetch(this->_retrieve_prefetch);
+   get_generator->get_storage().set_gridfs_readers(
+       this->_storage.get_gridfs_readers());
+   get_generator->get_storage().set_bulk_storage(
+       this->_storage.get_bulk_storage());
+   get_generator->get_storage().set_schema(this->_storage.get_schema());
+   auto get_scp = std::make_shared<odil::GetSCP>(association, get_generator);
    dispatcher.set_scp(odil::message::Message::Command::C_GET_RQ, get_scp);
 
-   auto move_scp = std::make_shared<odil::MoveSCP>(
-       association, std::make_shared<archive::MoveDataSetGenerator>(
-           this->_connection, this->_acl,
-           this->_database, this->_bulk_database,
-           association.get_negotiated_parameters()));
+   auto const move_generator = std::make_shared<archive::MoveDataSetGenerator>(
+       this->_connection_pool, this->_acl,
+       this->_database, this->_bulk_database,
+       association.get_negotiated_parameters());
+   move_generator->set_index_manager(&this->_index_manager);
+   move_generator->set_query_plan_cache(&this->_query_plan_cache);
+   move_generator->set_prefetch(this->_retrieve_prefetch);
+   move_generator->get_storage().set_gridfs_readers(
+       this->_storage.get_gridfs_readers());
+   move_generator->get_storage().set_bulk_storage(
+       this->_storage.get_bulk_storage());
+   move_generator->get_storage().set_schema(this->_storage.get_schema());
+   auto move_scp = std::make_shared<odil::MoveSCP>(association, move_generator);
    dispatcher.set_scp(odil::message::Message::Command::C_MOVE_RQ, move_scp);
 
    auto store_scp = std::make_shared<odil::StoreSCP>(
         association, std::bind(
-            archive::store, this->_acl, association.get_negotiated_parameters(),
-            this->_storage, std::placeholders::_1));
+            archive::store, std::ref(this->_acl),
+            association.get_negotiated_parameters(),
+            std::ref(this->_storage), std::placeholders::_1));
    dispatcher.set_scp(odil::message::Message::Command::C_STORE_RQ, store_scp);
 
    return dispatcher;
@@ -9,7 +9,12 @@
 #ifndef _13a8d4a4_4144_4910_b54a_702ae291eac2
 #define _13a8d4a4_4144_4910_b54a_702ae291eac2
 
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
 #include <string>
 
 #include <mongo/client/dbclient.h>
@@ -18,44 +23,97 @@
 
 #include "dopamine/authentication/AuthenticatorBase.h"
 #include "dopamine/AccessControlList.h"
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/archive/QueryPlanCache.h"
 #include "dopamine/archive/Storage.h"
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/logging.h"
 
 namespace dopamine
 {
 
-/// @brief Main class, dispatching requests to generators and callbacks.
+/**
+ * @brief Main class, dispatching requests to generators and callbacks.
+ *
+ * Associations are received by the thread calling run() and handled by a pool
+ * of worker threads. The size of the pool is the maximum number of concurrent
+ * associations.
+ */
 class Server
 {
 public:
     Server(
-        mongo::DBClientConnection & connection,
+        ConnectionPool & connection_pool,
         std::string const & database, std::string const & bulk_database,
-        uint16_t port, authentication::AuthenticatorBase const & authenticator);
+        uint16_t port, authentication::AuthenticatorBase const & authenticator,
+        unsigned int max_associations=1);
 
     ~Server();
 
+    /// @brief Return the maximum number of concurrent associations.
+    unsigned int get_max_associations() const;
+
+    /// @brief Return the number of data sets read ahead by C-GET and C-MOVE.
+    unsigned int get_retrieve_prefetch() const;
+
+    /// @brief Set the number of data sets read ahead by C-GET and C-MOVE.
+    void set_retrieve_prefetch(unsigned int retrieve_prefetch);
+
+    /// @brief Return the access control list shared by the associations.
+    AccessControlList & get_acl();
+
+    /// @brief Return the storage shared by the associations.
+    archive::Storage & get_storage();
+
+    /// @brief Return the index manager recording the queries.
+    archive::IndexManager & get_index_manager();
+
+    /// @brief Return the cache of the query plans shared by the associations.
+    archive::QueryPlanCache & get_query_plan_cache();
+
     void run();
 
     void shutdown();
 
 private:
-    mongo::DBClientConnection & _connection;
+    ConnectionPool & _connection_pool;
     std::string _database;
     std::string _bulk_database;
     uint16_t _port;
     authentication::AuthenticatorBase const & _authenticator;
+    unsigned int _max_associations;
+    unsigned int _retrieve_prefetch;
     AccessControlList _acl;
     archive::Storage _storage;
+    archive::IndexManager _index_manager;
+    archive::QueryPlanCache _query_plan_cache;
 
+    /// @brief Association being received by the listener.
     std::shared_ptr<odil::Association> _association;
+    /// @brief Associations waiting for a worker.
+    std::queue<std::shared_ptr<odil::Association>> _pending;
+    /// @brief Associations being handled by a worker.
+    std::set<std::shared_ptr<odil::Association>> _active;
     bool _is_running;
 
+    std::mutex _mutex;
+    std::condition_variable _condition;
+
     static odil::AssociationParameters _acceptor(
         odil::AssociationParameters const &,
         authentication::AuthenticatorBase const & authenticator);
 
-    odil::SCPDispatcher _get_dispatcher(odil::Association & association) const;
+    /**
+     * @brief Return the address of the peer of an association, or an empty
+     * string if the socket is already closed.
+     */
+    static std::string _get_peer(odil::Association & association);
+
+    void _work();
+
+    void _handle(odil::Association & association);
+
+    odil::SCPDispatcher _get_dispatcher(odil::Association & association);
 };
 
 } // namespace dopamine
@@ -0,0 +1,201 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/BatchWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/Exception.h"
+#include "dopamine/logging.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+BatchWriter::Batch
+::Batch()
+: objects(), size(0), done(false), errors()
+{
+    // Nothing else.
+}
+
+BatchWriter
+::BatchWriter(
+    ConnectionPool & connection_pool, std::string const & ns,
+    unsigned int max_count, unsigned int max_size,
+    std::chrono::milliseconds const & max_delay)
+: _connection_pool(connection_pool), _namespace(ns),
+  _max_count(std::max(1u, max_count)), _max_size(max_size),
+  _max_delay(max_delay)
+{
+    // Nothing else.
+}
+
+std::string const &
+BatchWriter
+::get_namespace() const
+{
+    return this->_namespace;
+}
+
+unsigned int
+BatchWriter
+::get_max_count() const
+{
+    return this->_max_count;
+}
+
+unsigned int
+BatchWriter
+::get_max_size() const
+{
+    return this->_max_size;
+}
+
+std::chrono::milliseconds const &
+BatchWriter
+::get_max_delay() const
+{
+    return this->_max_delay;
+}
+
+void
+BatchWriter
+::insert(mongo::BSONObj const & object)
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    // The first document of a batch makes its caller responsible for writing
+    // the batch.
+    bool const is_leader = !this->_batch;
+    if(is_leader)
+    {
+        this->_batch = std::make_shared<Batch>();
+    }
+    auto const batch = this->_batch;
+    auto const index = batch->objects.size();
+    batch->objects.push_back(object);
+    batch->size += object.objsize();
+
+    if(is_leader)
+    {
+        auto const deadline = std::chrono::steady_clock::now()+this->_max_delay;
+        this->_condition.wait_until(
+            lock, deadline, [&]() { return this->_is_full(*batch); });
+
+        // Do not accept new documents in this batch.
+        if(this->_batch == batch)
+        {
+            this->_batch = nullptr;
+        }
+        lock.unlock();
+
+        this->_write(*batch);
+
+        lock.lock();
+        batch->done = true;
+        this->_condition.notify_all();
+    }
+    else
+    {
+        if(this->_is_full(*batch))
+        {
+            // Close the batch now, the next document starts a new batch.
+            this->_batch = nullptr;
+            this->_condition.notify_all();
+        }
+        this->_condition.wait(lock, [&]() { return batch->done; });
+    }
+
+    if(!batch->errors[index].empty())
+    {
+        throw Exception(batch->errors[index]);
+    }
+}
+
+bool
+BatchWriter
+::_is_full(Batch const & batch) const
+{
+    return (
+        batch.objects.size() >= this->_max_count
+        || batch.size >= this->_max_size);
+}
+
+void
+BatchWriter
+::_write(Batch & batch)
+{
+    batch.errors.resize(batch.objects.size());
+
+    try
+    {
+        auto connection = this->_connection_pool.acquire();
+        try
+        {
+            connection->insert(
+                this->_namespace, batch.objects,
+                mongo::InsertOption_ContinueOnError,
+                &mongo::WriteConcern::acknowledged);
+        }
+        catch(mongo::DBException const & e)
+        {
+            // Some documents may have been inserted: find which ones.
+            DOPAMINE_LOG(WARN)
+                << "Batch insert of " << batch.objects.size()
+                << " documents failed: " << e.what();
+
+            mongo::BSONArrayBuilder ids;
+            for(auto const & object: batch.objects)
+            {
+                ids << object["_id"];
+            }
+            mongo::BSONObj const fields = BSON("_id" << 1);
+            auto cursor = connection->query(
+                this->_namespace,
+                BSON("_id" << BSON("$in" << ids.arr())), 0, 0, &fields);
+            std::set<std::string> inserted;
+            while(cursor->more())
+            {
+                inserted.insert(cursor->next()["_id"].toString(false));
+            }
+
+            for(std::size_t i=0; i<batch.objects.size(); ++i)
+            {
+                if(!inserted.count(batch.objects[i]["_id"].toString(false)))
+                {
+                    batch.errors[i] = e.what();
+                }
+            }
+        }
+    }
+    catch(Exception const & e)
+    {
+        // Could not acquire a connection or query the inserted documents.
+        std::fill(batch.errors.begin(), batch.errors.end(), e.what());
+    }
+    catch(mongo::DBException const & e)
+    {
+        std::fill(batch.errors.begin(), batch.errors.end(), e.what());
+    }
+}
+
+} // namespace archive
+
+} // namespace dopamine
@@ -0,0 +1,99 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _7ad3eb3f_e9ac_499f_9666_9e1b7fc3ffa3
+#define _7ad3eb3f_e9ac_499f_9666_9e1b7fc3ffa3
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/ConnectionPool.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Group the documents inserted concurrently in a collection in bulk
+ * inserts.
+ *
+ * The first document of a batch waits until the batch is full (in number of
+ * documents or in size) or until a delay has expired, then the whole batch is
+ * inserted with an acknowledged write concern. Each call to insert returns
+ * only when its document has been acknowledged.
+ */
+class BatchWriter
+{
+public:
+    /// @brief Constructor.
+    BatchWriter(
+        ConnectionPool & connection_pool, std::string const & ns,
+        unsigned int max_count=100, unsigned int max_size=8000000,
+        std::chrono::milliseconds const & max_delay=
+            std::chrono::milliseconds(10));
+
+    /// @brief Return the namespace (database.collection) of the documents.
+    std::string const & get_namespace() const;
+
+    /// @brief Return the maximum number of documents in a batch.
+    unsigned int get_max_count() const;
+
+    /// @brief Return the maximum size in bytes of a batch.
+    unsigned int get_max_size() const;
+
+    /// @brief Return the maximum delay before a batch is inserted.
+    std::chrono::milliseconds const & get_max_delay() const;
+
+    /**
+     * @brief Insert a document, return once the document has been
+     * acknowledged; throw an exception if the document was not inserted.
+     * The document must have an _id field.
+     */
+    void insert(mongo::BSONObj const & object);
+
+private:
+    struct Batch
+    {
+        std::vector<mongo::BSONObj> objects;
+        unsigned int size;
+        bool done;
+        /// @brief Error message for each object, empty if inserted.
+        std::vector<std::string> errors;
+
+        Batch();
+    };
+
+    ConnectionPool & _connection_pool;
+    std::string _namespace;
+    unsigned int _max_count;
+    unsigned int _max_size;
+    std::chrono::milliseconds _max_delay;
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    /// @brief Batch accepting new documents, null if none.
+    std::shared_ptr<Batch> _batch;
+
+    bool _is_full(Batch const & batch) const;
+
+    void _write(Batch & batch);
+};
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _7ad3eb3f_e9ac_499f_9666_9e1b7fc3ffa3
@@ -0,0 +1,227 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/CompressionBuffer.h"
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+#include <zstd.h>
+
+#include "dopamine/Exception.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+std::string const CompressionBuffer::codec = "zstd";
+
+CompressionBuffer
+::CompressionBuffer(std::streambuf & sink, int level)
+: _sink(sink), _stream(ZSTD_createCStream()),
+  _input(ZSTD_CStreamInSize(), '\0'), _output(ZSTD_CStreamOutSize(), '\0'),
+  _size(0)
+{
+    if(this->_stream == nullptr)
+    {
+        throw Exception("Could not create compression stream");
+    }
+    auto const result = ZSTD_initCStream(this->_stream, level);
+    if(ZSTD_isError(result))
+    {
+        ZSTD_freeCStream(this->_stream);
+        throw Exception(
+            std::string("Could not create compression stream: ")
+            +ZSTD_getErrorName(result));
+    }
+
+    this->setp(&this->_input[0], &this->_input[0]+this->_input.size());
+}
+
+CompressionBuffer
+::~CompressionBuffer()
+{
+    ZSTD_freeCStream(this->_stream);
+}
+
+std::size_t
+CompressionBuffer
+::size() const
+{
+    return this->_size;
+}
+
+void
+CompressionBuffer
+::close()
+{
+    this->_compress_input();
+
+    std::size_t remaining = 0;
+    do
+    {
+        ZSTD_outBuffer output{ &this->_output[0], this->_output.size(), 0 };
+        remaining = ZSTD_endStream(this->_stream, &output);
+        if(ZSTD_isError(remaining))
+        {
+            throw Exception(
+                std::string("Could not compress: ")
+                +ZSTD_getErrorName(remaining));
+        }
+        this->_write(output.pos);
+    }
+    while(remaining != 0);
+}
+
+CompressionBuffer::int_type
+CompressionBuffer
+::overflow(int_type c)
+{
+    this->_compress_input();
+    if(!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *this->pptr() = traits_type::to_char_type(c);
+        this->pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize
+CompressionBuffer
+::xsputn(char const * s, std::streamsize count)
+{
+    if(count < this->epptr()-this->pptr())
+    {
+        return std::streambuf::xsputn(s, count);
+    }
+
+    // Large write: compress directly from the caller's data.
+    this->_compress_input();
+    this->_compress(s, count);
+    return count;
+}
+
+void
+CompressionBuffer
+::_compress_input()
+{
+    this->_compress(this->pbase(), this->pptr()-this->pbase());
+    this->setp(&this->_input[0], &this->_input[0]+this->_input.size());
+}
+
+void
+CompressionBuffer
+::_compress(char const * data, std::size_t size)
+{
+    ZSTD_inBuffer input{ data, size, 0 };
+    while(input.pos < input.size)
+    {
+        ZSTD_outBuffer output{ &this->_output[0], this->_output.size(), 0 };
+        auto const result = ZSTD_compressStream(this->_stream, &output, &input);
+        if(ZSTD_isError(result))
+        {
+            throw Exception(
+                std::string("Could not compress: ")+ZSTD_getErrorName(result));
+        }
+        this->_write(output.pos);
+    }
+    this->_size += size;
+}
+
+void
+CompressionBuffer
+::_write(std::size_t size)
+{
+    if(size == 0)
+    {
+        return;
+    }
+    auto const written = this->_sink.sputn(this->_output.data(), size);
+    if(written != static_cast<std::streamsize>(size))
+    {
+        throw Exception("Could not write compressed data");
+    }
+}
+
+std::string decompress(std::string const & codec, std::string const & data)
+{
+    if(codec.empty())
+    {
+        return data;
+    }
+    else if(codec != CompressionBuffer::codec)
+    {
+        throw Exception("Unknown codec: "+codec);
+    }
+
+    auto * stream = ZSTD_createDStream();
+    if(stream == nullptr)
+    {
+        throw Exception("Could not create decompression stream");
+    }
+
+    std::string result;
+    std::string error;
+
+    auto const initialized = ZSTD_initDStream(stream);
+    if(ZSTD_isError(initialized))
+    {
+        error = ZSTD_getErrorName(initialized);
+    }
+    else
+    {
+        // Allocate from the frame size if it is known, otherwise grow.
+        auto const content_size = ZSTD_getFrameContentSize(
+            data.data(), data.size());
+        if(
+            content_size != ZSTD_CONTENTSIZE_UNKNOWN
+            && content_size != ZSTD_CONTENTSIZE_ERROR)
+        {
+            result.reserve(content_size);
+        }
+
+        std::string buffer(ZSTD_DStreamOutSize(), '\0');
+        ZSTD_inBuffer input{ data.data(), data.size(), 0 };
+        std::size_t status = 1;
+        while(status != 0 && error.empty())
+        {
+            ZSTD_outBuffer output{ &buffer[0], buffer.size(), 0 };
+            status = ZSTD_decompressStream(stream, &output, &input);
+            if(ZSTD_isError(status))
+            {
+                error = ZSTD_getErrorName(status);
+            }
+            else
+            {
+                result.append(buffer.data(), output.pos);
+                if(
+                    status != 0 && input.pos == input.size
+                    && output.pos < output.size)
+                {
+                    error = "truncated data";
+                }
+            }
+        }
+    }
+
+    ZSTD_freeDStream(stream);
+
+    if(!error.empty())
+    {
+        throw Exception("Could not decompress: "+error);
+    }
+
+    return result;
+}
+
+} // namespace archive
+
+} // namespace dopamine
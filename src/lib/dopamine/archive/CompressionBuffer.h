@@ -0,0 +1,85 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _bf663e2a_c301_4716_9465_5b06f09d157c
+#define _bf663e2a_c301_4716_9465_5b06f09d157c
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+// Same as ZSTD_CStream, avoid exposing zstd.h
+struct ZSTD_CCtx_s;
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Output stream buffer compressing its input with zstd and writing
+ * the compressed data to another stream buffer, e.g. a ContentBuffer or a
+ * GridFSWriter.
+ */
+class CompressionBuffer: public std::streambuf
+{
+public:
+    /// @brief Codec name stored in the Content references.
+    static std::string const codec;
+
+    /// @brief Constructor.
+    CompressionBuffer(std::streambuf & sink, int level);
+
+    /// @brief Destructor.
+    ~CompressionBuffer();
+
+    CompressionBuffer(CompressionBuffer const &) = delete;
+    CompressionBuffer & operator=(CompressionBuffer const &) = delete;
+
+    /// @brief Return the number of uncompressed bytes written.
+    std::size_t size() const;
+
+    /**
+     * @brief Compress the pending data and end the compressed frame; throw
+     * an exception on error.
+     */
+    void close();
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(char const * s, std::streamsize count);
+
+private:
+    std::streambuf & _sink;
+    ZSTD_CCtx_s * _stream;
+    std::string _input;
+    std::string _output;
+    std::size_t _size;
+
+    /// @brief Compress the content of the put area.
+    void _compress_input();
+
+    /// @brief Compress the given data and write the result to the sink.
+    void _compress(char const * data, std::size_t size);
+
+    /// @brief Write the output buffer to the sink.
+    void _write(std::size_t size);
+};
+
+/**
+ * @brief Return the decompressed data; throw an exception if the codec is
+ * unknown or if the data is invalid. An empty codec means no compression.
+ */
+std::string decompress(std::string const & codec, std::string const & data);
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _bf663e2a_c301_4716_9465_5b06f09d157c
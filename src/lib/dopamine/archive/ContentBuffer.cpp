@@ -0,0 +1,141 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/ContentBuffer.h"
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+#include <odil/DataSet.h>
+
+namespace
+{
+
+std::size_t estimate_elements_size(odil::DataSet const & data_set)
+{
+    std::size_t size = 0;
+    for(auto const & item: data_set)
+    {
+        auto const & element = item.second;
+
+        // Tag, VR and 32-bit length
+        size += 12;
+
+        if(element.is_int())
+        {
+            // Largest of the binary and of the text (IS) encodings
+            size += 12*element.as_int().size();
+        }
+        else if(element.is_real())
+        {
+            // Largest of the binary and of the text (DS) encodings
+            size += 16*element.as_real().size();
+        }
+        else if(element.is_string())
+        {
+            for(auto const & value: element.as_string())
+            {
+                // Value and separator or padding
+                size += value.size()+1;
+            }
+        }
+        else if(element.is_data_set())
+        {
+            for(auto const & value: element.as_data_set())
+            {
+                // Item and item delimitation
+                size += 16+estimate_elements_size(value);
+            }
+            // Sequence delimitation
+            size += 8;
+        }
+        else if(element.is_binary())
+        {
+            for(auto const & value: element.as_binary())
+            {
+                // Value, padding and fragment item
+                size += value.size()+1+8;
+            }
+            // Offset table and sequence delimitation
+            size += 16;
+        }
+    }
+
+    return size;
+}
+
+}
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+ContentBuffer
+::ContentBuffer(mongo::BufBuilder & buffer)
+: _bson_buffer(&buffer), _string_buffer(nullptr), _size(0)
+{
+    // Nothing else.
+}
+
+ContentBuffer
+::ContentBuffer(std::string & buffer)
+: _bson_buffer(nullptr), _string_buffer(&buffer), _size(0)
+{
+    // Nothing else.
+}
+
+std::size_t
+ContentBuffer
+::size() const
+{
+    return this->_size;
+}
+
+ContentBuffer::int_type
+ContentBuffer
+::overflow(int_type c)
+{
+    if(traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+
+    char const value = traits_type::to_char_type(c);
+    this->xsputn(&value, 1);
+    return c;
+}
+
+std::streamsize
+ContentBuffer
+::xsputn(char const * s, std::streamsize count)
+{
+    if(this->_bson_buffer)
+    {
+        this->_bson_buffer->appendBuf(s, count);
+    }
+    else
+    {
+        this->_string_buffer->append(s, count);
+    }
+    this->_size += count;
+    return count;
+}
+
+std::size_t estimate_size(odil::DataSet const & data_set)
+{
+    // Preamble, magic string and a generous meta-information header
+    return 128+4+512+estimate_elements_size(data_set);
+}
+
+} // namespace archive
+
+} // namespace dopamine
@@ -0,0 +1,62 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _122ae3ee_34b4_4b04_ac57_4b613b7d18bf
+#define _122ae3ee_34b4_4b04_ac57_4b613b7d18bf
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+#include <odil/DataSet.h>
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Output stream buffer appending directly to a BSON buffer or to a
+ * string, so that a serialized data set does not need to be copied to its
+ * final destination.
+ */
+class ContentBuffer: public std::streambuf
+{
+public:
+    /// @brief Append to a BSON buffer, e.g. the one of a BSONObjBuilder.
+    ContentBuffer(mongo::BufBuilder & buffer);
+
+    /// @brief Append to a string.
+    ContentBuffer(std::string & buffer);
+
+    /// @brief Return the number of bytes written through this buffer.
+    std::size_t size() const;
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(char const * s, std::streamsize count);
+
+private:
+    mongo::BufBuilder * _bson_buffer;
+    std::string * _string_buffer;
+    std::size_t _size;
+};
+
+/**
+ * @brief Return an upper estimate of the size of the data set written as a
+ * DICOM file, used to pre-allocate the serialization buffer.
+ */
+std::size_t estimate_size(odil::DataSet const & data_set);
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _122ae3ee_34b4_4b04_ac57_4b613b7d18bf
@@ -9,6 +9,9 @@
 
 #include "dopamine/archive/DataSetGeneratorHelper.h"
 
+#include <deque>
+#include <future>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -21,8 +24,11 @@
 #include <odil/SCP.h>
 
 #include "dopamine/AccessControlList.h"
+#include "dopamine/archive/IndexManager.h"
 #include "dopamine/archive/mongo_query.h"
 #include "dopamine/archive/Storage.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/ConnectionPool.h"
 
 namespace dopamine
 {
@@ -32,14 +38,29 @@ namespace archive
 
 DataSetGeneratorHelper
 ::DataSetGeneratorHelper(
-    mongo::DBClientConnection & connection, AccessControlList const & acl,
+    ConnectionPool & connection_pool, AccessControlList const & acl,
     std::string const & database, std::string const & bulk_database,
     std::string const & principal, std::string const & service)
-: _connection(connection), _acl(acl),
-  _storage(connection, database, bulk_database),
-  _principal(principal), _service(service)
+: _connection_pool(connection_pool), _acl(acl),
+  _storage(connection_pool, database, bulk_database), _index_manager(nullptr),
+  _query_plan_cache(nullptr), _principal(principal), _service(service),
+  _batch_size(100), _prefetch(2), _use_cursor(false), _count(0), _read(0)
 {
-    // Nothing else
+    this->_results_iterator = this->_results.end();
+}
+
+void
+DataSetGeneratorHelper
+::set_index_manager(IndexManager * index_manager)
+{
+    this->_index_manager = index_manager;
+}
+
+void
+DataSetGeneratorHelper
+::set_query_plan_cache(QueryPlanCache * query_plan_cache)
+{
+    this->_query_plan_cache = query_plan_cache;
 }
 
 void
@@ -70,7 +91,9 @@ DataSetGeneratorHelper
     mongo::BSONObjBuilder & projection_builder) const
 {
     mongo::BSONArrayBuilder query_builder;
-    as_mongo_query(data_set, query_builder, projection_builder);
+    as_mongo_query(
+        data_set, query_builder, projection_builder,
+        this->_storage.get_schema(), this->_query_plan_cache);
 
     auto const query = query_builder.arr();
     auto const constraints = this->_acl.get_constraints(
@@ -88,45 +111,155 @@ DataSetGeneratorHelper
 
     if(condition_terms_builder.arrSize()>0)
     {
-        condition_builder << "$and" << condition_terms_builder.arr();
+        auto const condition = BSON("$and" << condition_terms_builder.arr());
+        if(this->_index_manager)
+        {
+            this->_index_manager->record_query(condition);
+        }
+        condition_builder.appendElements(condition);
     }
     // Otherwise do nothing
 }
 
+unsigned int
+DataSetGeneratorHelper
+::get_batch_size() const
+{
+    return this->_batch_size;
+}
+
+void
+DataSetGeneratorHelper
+::set_batch_size(unsigned int batch_size)
+{
+    this->_batch_size = batch_size;
+}
+
+unsigned int
+DataSetGeneratorHelper
+::get_prefetch() const
+{
+    return this->_prefetch;
+}
+
+void
+DataSetGeneratorHelper
+::set_prefetch(unsigned int prefetch)
+{
+    this->_prefetch = prefetch;
+}
+
+Storage &
+DataSetGeneratorHelper
+::get_storage()
+{
+    return this->_storage;
+}
+
+Schema
+DataSetGeneratorHelper
+::get_schema() const
+{
+    return this->_storage.get_schema();
+}
+
+void
+DataSetGeneratorHelper
+::set_schema(Schema schema)
+{
+    this->_storage.set_schema(schema);
+}
+
 void
 DataSetGeneratorHelper
 ::set_results(std::vector<mongo::BSONObj> const & results)
 {
+    this->_reset();
     this->_results = results;
     this->_results_iterator = this->_results.begin();
+    this->_count = this->_results.size();
+}
+
+void
+DataSetGeneratorHelper
+::query(
+    std::string const & ns, mongo::BSONObj const & condition,
+    mongo::BSONObj const & projection)
+{
+    this->_reset();
+
+    this->_connection.reset(
+        new ConnectionPool::Connection(this->_connection_pool.acquire()));
+    auto & connection = **this->_connection;
+
+    this->_count = connection.count(ns, condition);
+    this->_use_cursor = true;
+    if(this->_count == 0)
+    {
+        // A limit of 0 would return all documents.
+        this->_connection.reset();
+        return;
+    }
+
+    // The cursor may stay idle while the data sets are sent: do not let the
+    // server close it. Documents stored after the count are not returned, so
+    // that the number of remaining sub-operations does not underflow.
+    auto cursor = connection.query(
+        ns, condition, this->_count, 0, &projection,
+        mongo::QueryOption_NoCursorTimeout, this->_batch_size);
+    this->_cursor.reset(cursor.release());
+
+    this->_fill();
 }
 
 bool
 DataSetGeneratorHelper
 ::done() const
 {
-    return (this->_results_iterator == this->_results.end());
+    if(this->_use_cursor)
+    {
+        return this->_pending.empty();
+    }
+    else
+    {
+        return (this->_results_iterator == this->_results.end());
+    }
 }
 
 void
 DataSetGeneratorHelper
 ::next()
 {
-    ++this->_results_iterator;
+    if(this->_use_cursor)
+    {
+        this->_pending.pop_front();
+        this->_fill();
+    }
+    else
+    {
+        ++this->_results_iterator;
+    }
 }
 
 mongo::BSONObj const &
 DataSetGeneratorHelper
 ::get() const
 {
-    return *this->_results_iterator;
+    if(this->_use_cursor)
+    {
+        return this->_pending.front().object;
+    }
+    else
+    {
+        return *this->_results_iterator;
+    }
 }
 
 unsigned int
 DataSetGeneratorHelper
 ::count() const
 {
-    return this->_results.size();
+    return this->_count;
 }
 
 odil::DataSet
@@ -146,6 +279,88 @@ DataSetGeneratorHelper
     }
 }
 
+odil::DataSet
+DataSetGeneratorHelper
+::retrieve_current() const
+{
+    if(!this->_use_cursor || !this->_pending.front().data_set.valid())
+    {
+        return this->retrieve(_get_sop_instance_uid(this->get()));
+    }
+
+    try
+    {
+        return this->_pending.front().data_set.get();
+    }
+    catch(std::exception const & e)
+    {
+        odil::DataSet status;
+        status.add(odil::registry::ErrorComment, { e.what()});
+        throw odil::SCP::Exception(
+            e.what(), odil::message::Response::ProcessingFailure, status);
+    }
+}
+
+void
+DataSetGeneratorHelper
+::_reset()
+{
+    // The cursor must be destroyed before its connection is returned.
+    this->_cursor.reset();
+    this->_connection.reset();
+    // Wait for the background retrievals.
+    this->_pending.clear();
+    this->_use_cursor = false;
+
+    this->_results.clear();
+    this->_results_iterator = this->_results.end();
+    this->_count = 0;
+    this->_read = 0;
+}
+
+void
+DataSetGeneratorHelper
+::_fill()
+{
+    // Current element, followed by the prefetched ones.
+    while(this->_cursor && this->_pending.size() < 1+this->_prefetch)
+    {
+        if(!this->_cursor->more())
+        {
+            // Return the connection as soon as possible.
+            this->_cursor.reset();
+            this->_connection.reset();
+            // Documents removed after the count
+            this->_count = this->_read;
+            break;
+        }
+
+        Pending pending;
+        pending.object = this->_cursor->next().getOwned();
+        ++this->_read;
+        if(this->_prefetch > 0)
+        {
+            // The storage object only refers to the pool: each retrieval
+            // uses its own connection.
+            auto const storage = this->_storage;
+            auto const sop_instance_uid = _get_sop_instance_uid(pending.object);
+            pending.data_set = std::async(
+                std::launch::async,
+                [storage, sop_instance_uid]() {
+                    return storage.retrieve(sop_instance_uid); }).share();
+        }
+        this->_pending.push_back(pending);
+    }
+}
+
+std::string
+DataSetGeneratorHelper
+::_get_sop_instance_uid(mongo::BSONObj const & object)
+{
+    return get_first_value(
+        object[std::string(odil::registry::SOPInstanceUID)]).String();
+}
+
 } // namespace archive
 
 } // namespace dopamine
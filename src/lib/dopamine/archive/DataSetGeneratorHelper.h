@@ -9,6 +9,9 @@
 #ifndef _9533ce45_f1ca_4bea_ba12_3d77495bacd6
 #define _9533ce45_f1ca_4bea_ba12_3d77495bacd6
 
+#include <deque>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -18,7 +21,10 @@
 #include <odil/DataSet.h>
 
 #include "dopamine/AccessControlList.h"
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/archive/QueryPlanCache.h"
 #include "dopamine/archive/Storage.h"
+#include "dopamine/ConnectionPool.h"
 
 namespace dopamine
 {
@@ -32,10 +38,16 @@ class DataSetGeneratorHelper
 public:
     /// @brief Constructor.
     DataSetGeneratorHelper(
-        mongo::DBClientConnection & connection, AccessControlList const & acl,
+        ConnectionPool & connection_pool, AccessControlList const & acl,
         std::string const & database, std::string const & bulk_database,
         std::string const & principal, std::string const & service);
 
+    /// @brief Set the index manager recording the queries, may be null.
+    void set_index_manager(IndexManager * index_manager);
+
+    /// @brief Set the cache of the query plans, may be null.
+    void set_query_plan_cache(QueryPlanCache * query_plan_cache);
+
     /**
      * @brief Check that the principal is allowed to use the service, throw
      * an exception otherwise.
@@ -51,9 +63,52 @@ public:
         mongo::BSONObjBuilder & condition_builder,
         mongo::BSONObjBuilder & projection_builder) const;
 
+    /// @brief Return the number of documents fetched per round trip by query.
+    unsigned int get_batch_size() const;
+
+    /// @brief Set the number of documents fetched per round trip by query.
+    void set_batch_size(unsigned int batch_size);
+
+    /**
+     * @brief Return the number of data sets retrieved in the background
+     * ahead of the current one by query, default to 2.
+     */
+    unsigned int get_prefetch() const;
+
+    /**
+     * @brief Set the number of data sets retrieved in the background ahead of
+     * the current one by query; each of them uses a connection of the pool
+     * while it is read. A value of 0 disables the prefetching.
+     */
+    void set_prefetch(unsigned int prefetch);
+
+    /// @brief Return the storage used to retrieve the data sets.
+    Storage & get_storage();
+
+    /// @brief Return the schema of the metadata documents, default to verbose.
+    Schema get_schema() const;
+
+    /// @brief Set the schema of the metadata documents.
+    void set_schema(Schema schema);
+
     /// @brief Set and initialize the results iterator.
     void set_results(std::vector<mongo::BSONObj> const & results);
 
+    /**
+     * @brief Count the matching documents and iterate over them with a
+     * cursor, which keeps a connection of the pool until all results are
+     * consumed or until the next query. The data sets of the next
+     * documents are retrieved in the background.
+     *
+     * The count and the cursor are not a single snapshot: the cursor is
+     * limited to the counted number of documents, and the count is lowered
+     * to the number of returned documents if the cursor ends first, e.g.
+     * after a concurrent removal.
+     */
+    void query(
+        std::string const & ns, mongo::BSONObj const & condition,
+        mongo::BSONObj const & projection);
+
     /// @brief Test whether all elements have been generated.
     bool done() const;
 
@@ -63,7 +118,7 @@ public:
     /// @brief Return the current element.
     mongo::BSONObj const & get() const;
 
-    /// @brief Return the number of responses.
+    /// @brief Return the number of responses, see query.
     unsigned int count() const;
 
     /**
@@ -72,16 +127,51 @@ public:
      */
     odil::DataSet retrieve(std::string const & sop_instance_uid) const;
 
+    /**
+     * @brief Return the data set of the current element, using its
+     * prefetched value if available; throw an exception if no such data set
+     * is stored.
+     */
+    odil::DataSet retrieve_current() const;
+
 private:
-    mongo::DBClientConnection & _connection;
+    ConnectionPool & _connection_pool;
     AccessControlList const & _acl;
     Storage _storage;
+    IndexManager * _index_manager;
+    QueryPlanCache * _query_plan_cache;
 
     std::string _principal;
     std::string _service;
 
+    unsigned int _batch_size;
+    unsigned int _prefetch;
+
     std::vector<mongo::BSONObj> _results;
     std::vector<mongo::BSONObj>::const_iterator _results_iterator;
+
+    std::unique_ptr<ConnectionPool::Connection> _connection;
+    std::unique_ptr<mongo::DBClientCursor> _cursor;
+    /// @brief Element read from the cursor and its (prefetched) data set.
+    struct Pending
+    {
+        mongo::BSONObj object;
+        std::shared_future<odil::DataSet> data_set;
+    };
+
+    bool _use_cursor;
+    /// @brief Current element of the cursor, followed by the prefetched ones.
+    std::deque<Pending> _pending;
+    unsigned int _count;
+    /// @brief Number of documents read from the cursor.
+    unsigned int _read;
+
+    void _reset();
+
+    /// @brief Read from the cursor until the prefetch queue is full.
+    void _fill();
+
+    static std::string _get_sop_instance_uid(mongo::BSONObj const & object);
 };
 
 } // namespace archive
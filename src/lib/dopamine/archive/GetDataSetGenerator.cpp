@@ -22,6 +22,8 @@
 
 #include "dopamine/AccessControlList.h"
 #include "dopamine/archive/DataSetGeneratorHelper.h"
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/logging.h"
 #include "dopamine/utils.h"
 
@@ -33,12 +35,12 @@ namespace archive
 
 GetDataSetGenerator
 ::GetDataSetGenerator(
-    mongo::DBClientConnection & connection, AccessControlList const & acl,
+    ConnectionPool & connection_pool, AccessControlList const & acl,
     std::string const & database, std::string const & bulk_database,
     odil::AssociationParameters const & parameters)
-: _connection(connection), _acl(acl), _parameters(parameters),
+: _connection_pool(connection_pool), _acl(acl), _parameters(parameters),
   _helper(
-    connection, acl, database, bulk_database, get_principal(parameters),
+    connection_pool, acl, database, bulk_database, get_principal(parameters),
     "Retrieve")
 {
     this->_namespace = database+".datasets";
@@ -50,6 +52,55 @@ GetDataSetGenerator
     // Nothing to do.
 }
 
+void
+GetDataSetGenerator
+::set_index_manager(IndexManager * index_manager)
+{
+    this->_helper.set_index_manager(index_manager);
+}
+
+void
+GetDataSetGenerator
+::set_query_plan_cache(QueryPlanCache * query_plan_cache)
+{
+    this->_helper.set_query_plan_cache(query_plan_cache);
+}
+
+unsigned int
+GetDataSetGenerator
+::get_batch_size() const
+{
+    return this->_helper.get_batch_size();
+}
+
+void
+GetDataSetGenerator
+::set_batch_size(unsigned int batch_size)
+{
+    this->_helper.set_batch_size(batch_size);
+}
+
+unsigned int
+GetDataSetGenerator
+::get_prefetch() const
+{
+    return this->_helper.get_prefetch();
+}
+
+void
+GetDataSetGenerator
+::set_prefetch(unsigned int prefetch)
+{
+    this->_helper.set_prefetch(prefetch);
+}
+
+Storage &
+GetDataSetGenerator
+::get_storage()
+{
+    return this->_helper.get_storage();
+}
+
 void
 GetDataSetGenerator
 ::initialize(odil::message::Request const & request)
@@ -70,21 +121,12 @@ GetDataSetGenerator
 
     auto const condition = condition_builder.obj();
     auto const projection = BSON(
-        std::string(odil::registry::SOPInstanceUID) << 1
-        << "Content" << 1);
+        std::string(odil::registry::SOPInstanceUID) << 1);
 
-    auto const cursor = this->_connection.query(
-        this->_namespace, condition, 0, 0, &projection);
-    std::vector<mongo::BSONObj> results;
-    while(cursor->more())
-    {
-        auto const object = cursor->next().getOwned();
-        results.push_back(object);
-    }
-    this->_helper.set_results(results);
+    this->_helper.query(this->_namespace, condition, projection);
     DOPAMINE_LOG(DEBUG)
-        << "Sending " << results.size()
-        << " instance" << (results.size()>1?"s":"");
+        << "Sending " << this->_helper.count()
+        << " instance" << (this->_helper.count()>1?"s":"");
 
     this->_dicom_data_set_up_to_date = false;
 }
@@ -114,11 +156,7 @@ GetDataSetGenerator
 {
     if(!this->_dicom_data_set_up_to_date)
     {
-        auto const current = this->_helper.get();
-        auto const sop_instance_uid = current[
-            std::string(odil::registry::SOPInstanceUID)][
-                "Value"].Array()[0].String();
-        this->_dicom_data_set = this->_helper.retrieve(sop_instance_uid);
+        this->_dicom_data_set = this->_helper.retrieve_current();
         this->_dicom_data_set_up_to_date = true;
     }
 
@@ -20,6 +20,10 @@
 
 #include "dopamine/AccessControlList.h"
 #include "dopamine/archive/DataSetGeneratorHelper.h"
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/archive/QueryPlanCache.h"
+#include "dopamine/archive/Storage.h"
+#include "dopamine/ConnectionPool.h"
 
 namespace dopamine
 {
@@ -31,12 +35,39 @@ class GetDataSetGenerator: public odil::GetSCP::DataSetGenerator
 {
 public:
     GetDataSetGenerator(
-        mongo::DBClientConnection & connection, AccessControlList const & acl,
+        ConnectionPool & connection_pool, AccessControlList const & acl,
         std::string const & database, std::string const & bulk_database,
         odil::AssociationParameters const & parameters);
 
     virtual ~GetDataSetGenerator();
 
+    /// @brief Set the index manager recording the queries, may be null.
+    void set_index_manager(IndexManager * index_manager);
+
+    /// @brief Set the cache of the query plans, may be null.
+    void set_query_plan_cache(QueryPlanCache * query_plan_cache);
+
+    /// @brief Return the number of data sets fetched per database round trip.
+    unsigned int get_batch_size() const;
+
+    /// @brief Set the number of data sets fetched per database round trip.
+    void set_batch_size(unsigned int batch_size);
+
+    /**
+     * @brief Return the number of data sets read in the background while the
+     * current one is sent.
+     */
+    unsigned int get_prefetch() const;
+
+    /**
+     * @brief Set the number of data sets read in the background while the
+     * current one is sent, 0 to disable.
+     */
+    void set_prefetch(unsigned int prefetch);
+
+    /// @brief Return the storage used to retrieve the data sets.
+    Storage & get_storage();
+
     /// @brief Initialize the generator, the request must be a C-GET request.
     virtual void initialize(odil::message::Request const & request);
 
@@ -52,7 +83,7 @@ public:
     /// @brief Return the number of responses.
     virtual unsigned int count() const;
 private:
-    mongo::DBClientConnection & _connection;
+    ConnectionPool & _connection_pool;
     AccessControlList const & _acl;
 
     std::string _namespace;
@@ -0,0 +1,212 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/GridFSReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/Exception.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+GridFSReader
+::GridFSReader(
+    ConnectionPool & connection_pool, std::string const & database,
+    unsigned int max_ranges)
+: _connection_pool(connection_pool), _database(database),
+  _max_ranges(std::max(1u, max_ranges))
+{
+    // Nothing else.
+}
+
+unsigned int
+GridFSReader
+::get_max_ranges() const
+{
+    return this->_max_ranges;
+}
+
+std::string
+GridFSReader
+::read(mongo::DBClientBase & connection, mongo::OID const & id) const
+{
+    mongo::BSONObj const fields(BSON("length" << 1 << "chunkSize" << 1));
+    mongo::BSONObj file;
+    try
+    {
+        file = connection.findOne(
+            this->_database+".fs.files", BSON("_id" << id), &fields);
+    }
+    catch(mongo::DBException const & e)
+    {
+        throw Exception(
+            "Could not read GridFS file "+id.toString()+": "+e.what());
+    }
+    if(file.isEmpty())
+    {
+        throw Exception("No such GridFS file: "+id.toString());
+    }
+
+    long long const length = file["length"].numberLong();
+    int const chunk_size = file["chunkSize"].numberInt();
+    if(length < 0 || chunk_size <= 0)
+    {
+        throw Exception("Invalid GridFS file: "+id.toString());
+    }
+
+    std::string buffer(length, '\0');
+    int const chunks_count = (length+chunk_size-1)/chunk_size;
+    if(chunks_count == 0)
+    {
+        return buffer;
+    }
+
+    unsigned int const ranges_count = std::min<unsigned int>(
+        this->_max_ranges,
+        (chunks_count+min_range_size-1)/min_range_size);
+    int const range_size = (chunks_count+ranges_count-1)/ranges_count;
+    char * const data = &buffer[0];
+
+    // The first range is read in this thread with the caller's connection,
+    // as are the ranges for which the pool has no connection right now:
+    // waiting for the pool while holding a connection could dead-lock
+    // concurrent readers.
+    std::vector<std::pair<int, int>> local_ranges;
+    local_ranges.emplace_back(0, std::min(range_size, chunks_count));
+
+    std::vector<std::future<void>> ranges;
+    for(int begin=range_size; begin<chunks_count; begin+=range_size)
+    {
+        int const end = std::min(begin+range_size, chunks_count);
+
+        std::shared_ptr<ConnectionPool::Connection> range_connection;
+        try
+        {
+            range_connection = this->_connection_pool.try_acquire();
+        }
+        catch(std::exception const &)
+        {
+            // Fall back to the caller's connection.
+        }
+
+        if(range_connection)
+        {
+            ranges.push_back(std::async(
+                std::launch::async, [=]() {
+                    this->_read_range(
+                        **range_connection, id, length, chunk_size,
+                        begin, end, data);
+                }));
+        }
+        else
+        {
+            local_ranges.emplace_back(begin, end);
+        }
+    }
+
+    std::string error;
+    try
+    {
+        for(auto const & range: local_ranges)
+        {
+            this->_read_range(
+                connection, id, length, chunk_size,
+                range.first, range.second, data);
+        }
+    }
+    catch(std::exception const & e)
+    {
+        error = e.what();
+    }
+
+    // Wait for all ranges, since they write into the buffer.
+    for(auto & range: ranges)
+    {
+        try
+        {
+            range.get();
+        }
+        catch(std::exception const & e)
+        {
+            if(error.empty())
+            {
+                error = e.what();
+            }
+        }
+    }
+
+    if(!error.empty())
+    {
+        throw Exception(error);
+    }
+
+    return buffer;
+}
+
+void
+GridFSReader
+::_read_range(
+    mongo::DBClientBase & connection, mongo::OID const & id,
+    long long length, int chunk_size, int begin, int end, char * buffer) const
+{
+    mongo::BSONObj const fields(BSON("n" << 1 << "data" << 1 << "_id" << 0));
+    int count = 0;
+    try
+    {
+        auto cursor = connection.query(
+            this->_database+".fs.chunks",
+            BSON(
+                "files_id" << id
+                << "n" << BSON("$gte" << begin << "$lt" << end)),
+            0, 0, &fields, 0, end-begin);
+        while(cursor->more())
+        {
+            auto const chunk = cursor->next();
+            int const n = chunk.getIntField("n");
+            long long const offset = static_cast<long long>(n)*chunk_size;
+            long long const expected_size =
+                std::min<long long>(chunk_size, length-offset);
+
+            int size = 0;
+            char const * data = chunk.getField("data").binData(size);
+            if(n < begin || n >= end || size != expected_size)
+            {
+                throw Exception("Invalid GridFS chunk of "+id.toString());
+            }
+            std::memcpy(buffer+offset, data, size);
+            ++count;
+        }
+    }
+    catch(mongo::DBException const & e)
+    {
+        throw Exception(
+            "Could not read GridFS file "+id.toString()+": "+e.what());
+    }
+
+    if(count != end-begin)
+    {
+        throw Exception("Missing GridFS chunk of "+id.toString());
+    }
+}
+
+} // namespace archive
+
+} // namespace dopamine
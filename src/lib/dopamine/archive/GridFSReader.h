@@ -0,0 +1,72 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _77f25195_3d1a_4837_9810_061354e42e28
+#define _77f25195_3d1a_4837_9810_061354e42e28
+
+#include <string>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/ConnectionPool.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Reader of GridFS files, fetching ranges of chunks in parallel on
+ * connections of a pool.
+ *
+ * The chunks are copied at their final position in a buffer allocated from
+ * the file length.
+ */
+class GridFSReader
+{
+public:
+    /// @brief Minimum number of chunks fetched by a range query.
+    static unsigned int const min_range_size=4;
+
+    /// @brief Constructor.
+    GridFSReader(
+        ConnectionPool & connection_pool, std::string const & database,
+        unsigned int max_ranges=4);
+
+    /// @brief Return the maximum number of ranges fetched in parallel.
+    unsigned int get_max_ranges() const;
+
+    /**
+     * @brief Return the content of the file with given id. The file document
+     * and the first range of chunks are read with the given connection, the
+     * other ranges with idle connections of the pool. Since the caller
+     * already holds a connection, this never waits for the pool: ranges for
+     * which no connection is available are read with the given connection.
+     * Throw an exception if the file is missing or incomplete.
+     */
+    std::string read(
+        mongo::DBClientBase & connection, mongo::OID const & id) const;
+
+private:
+    ConnectionPool & _connection_pool;
+    std::string _database;
+    unsigned int _max_ranges;
+
+    /// @brief Copy the chunks in [begin, end) at their position in buffer.
+    void _read_range(
+        mongo::DBClientBase & connection, mongo::OID const & id,
+        long long length, int chunk_size, int begin, int end,
+        char * buffer) const;
+};
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _77f25195_3d1a_4837_9810_061354e42e28
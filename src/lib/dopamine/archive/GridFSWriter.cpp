@@ -0,0 +1,182 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/GridFSWriter.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/Exception.h"
+#include "dopamine/logging.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+GridFSWriter
+::GridFSWriter(
+    mongo::DBClientBase & connection, std::string const & database,
+    std::string const & filename, unsigned int chunk_size)
+: _connection(connection), _database(database), _filename(filename),
+  _chunk_size(std::max(1u, chunk_size)), _id(mongo::OID::gen()), _chunk(),
+  _chunks_count(0), _size(0), _closed(false)
+{
+    this->_chunk.reserve(this->_chunk_size);
+}
+
+GridFSWriter
+::~GridFSWriter()
+{
+    if(!this->_closed && this->_chunks_count > 0)
+    {
+        try
+        {
+            this->abort();
+        }
+        catch(mongo::DBException const & e)
+        {
+            DOPAMINE_LOG(ERROR)
+                << "Could not remove chunks of " << this->_filename << ": "
+                << e.what();
+        }
+    }
+}
+
+mongo::OID const &
+GridFSWriter
+::get_id() const
+{
+    return this->_id;
+}
+
+std::size_t
+GridFSWriter
+::size() const
+{
+    return this->_size;
+}
+
+mongo::BSONObj
+GridFSWriter
+::close()
+{
+    if(!this->_chunk.empty())
+    {
+        this->_write_chunk();
+    }
+
+    // Same file document as the one created by mongo::GridFS::storeFile.
+    mongo::BSONObjBuilder builder;
+    builder << "_id" << this->_id;
+    builder << "filename" << this->_filename;
+    builder << "chunkSize" << static_cast<int>(this->_chunk_size);
+    builder << "uploadDate" << mongo::DATENOW;
+    builder << "length" << static_cast<long long>(this->_size);
+
+    // The command is processed after the unacknowledged chunks sent on the
+    // same connection: the chunks which could not be inserted are missing.
+    mongo::BSONObj md5;
+    if(!this->_connection.runCommand(
+        this->_database, BSON("filemd5" << this->_id << "root" << "fs"), md5))
+    {
+        throw Exception(
+            "Could not compute checksum of "+this->_filename+": "
+            +md5["errmsg"].toString(false));
+    }
+    auto const chunks_count = md5["numChunks"].numberLong();
+    if(chunks_count != static_cast<long long>(this->_chunks_count))
+    {
+        throw Exception(
+            "Could not store chunks of "+this->_filename+": "
+            +std::to_string(chunks_count)+" of "
+            +std::to_string(this->_chunks_count)+" inserted");
+    }
+    builder.appendAs(md5["md5"], "md5");
+
+    auto const file = builder.obj();
+    this->_connection.insert(
+        this->_database+".fs.files", file, 0,
+        &mongo::WriteConcern::acknowledged);
+    this->_closed = true;
+
+    return file;
+}
+
+void
+GridFSWriter
+::abort()
+{
+    this->_connection.remove(
+        this->_database+".fs.chunks", BSON("files_id" << this->_id));
+    this->_chunks_count = 0;
+    this->_chunk.clear();
+}
+
+GridFSWriter::int_type
+GridFSWriter
+::overflow(int_type c)
+{
+    if(traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+
+    char const value = traits_type::to_char_type(c);
+    this->xsputn(&value, 1);
+    return c;
+}
+
+std::streamsize
+GridFSWriter
+::xsputn(char const * s, std::streamsize count)
+{
+    std::streamsize written = 0;
+    while(written < count)
+    {
+        auto const size = std::min<std::streamsize>(
+            count-written, this->_chunk_size-this->_chunk.size());
+        this->_chunk.append(s+written, size);
+        written += size;
+
+        if(this->_chunk.size() == this->_chunk_size)
+        {
+            this->_write_chunk();
+        }
+    }
+    this->_size += count;
+    return count;
+}
+
+void
+GridFSWriter
+::_write_chunk()
+{
+    mongo::BSONObjBuilder builder(this->_chunk.size()+128);
+    builder.genOID();
+    builder << "files_id" << this->_id;
+    builder << "n" << static_cast<int>(this->_chunks_count);
+    builder.appendBinData(
+        "data", this->_chunk.size(), mongo::BinDataGeneral,
+        this->_chunk.data());
+    this->_connection.insert(
+        this->_database+".fs.chunks", builder.obj(), 0,
+        &mongo::WriteConcern::unacknowledged);
+
+    ++this->_chunks_count;
+    this->_chunk.clear();
+}
+
+} // namespace archive
+
+} // namespace dopamine
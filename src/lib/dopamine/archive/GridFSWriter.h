@@ -0,0 +1,90 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _f5407763_f329_4d4e_a7c2_d58e15f3fc78
+#define _f5407763_f329_4d4e_a7c2_d58e15f3fc78
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Output stream buffer writing a GridFS file chunk by chunk, so that
+ * the whole file is never held in memory.
+ *
+ * The chunks are inserted as soon as they are full, without waiting for the
+ * acknowledgment of the server; the file document is inserted by close(),
+ * once the number of inserted chunks is checked. If the writer is destroyed
+ * before close() is called, the inserted chunks are removed.
+ */
+class GridFSWriter: public std::streambuf
+{
+public:
+    /// @brief Default size of the chunks, same as the MongoDB drivers.
+    static unsigned int const default_chunk_size=255*1024;
+
+    /// @brief Constructor.
+    GridFSWriter(
+        mongo::DBClientBase & connection, std::string const & database,
+        std::string const & filename,
+        unsigned int chunk_size=default_chunk_size);
+
+    /// @brief Destructor, remove the inserted chunks if the file is not closed.
+    ~GridFSWriter();
+
+    GridFSWriter(GridFSWriter const &) = delete;
+    GridFSWriter & operator=(GridFSWriter const &) = delete;
+
+    /// @brief Return the id of the GridFS file.
+    mongo::OID const & get_id() const;
+
+    /// @brief Return the number of bytes written.
+    std::size_t size() const;
+
+    /**
+     * @brief Write the last chunk and the file document, return the file
+     * document. Throw a mongo::DBException if the insertion fails, or an
+     * Exception if a chunk is missing.
+     */
+    mongo::BSONObj close();
+
+    /// @brief Remove the inserted chunks.
+    void abort();
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(char const * s, std::streamsize count);
+
+private:
+    mongo::DBClientBase & _connection;
+    std::string _database;
+    std::string _filename;
+    unsigned int _chunk_size;
+
+    mongo::OID _id;
+    std::string _chunk;
+    unsigned int _chunks_count;
+    std::size_t _size;
+    bool _closed;
+
+    void _write_chunk();
+};
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _f5407763_f329_4d4e_a7c2_d58e15f3fc78
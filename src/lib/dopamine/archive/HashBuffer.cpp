@@ -0,0 +1,91 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/HashBuffer.h"
+
+#include <iomanip>
+#include <sstream>
+#include <streambuf>
+#include <string>
+
+#include <openssl/evp.h>
+
+#include "dopamine/Exception.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+std::string const HashBuffer::algorithm = "sha1";
+
+HashBuffer
+::HashBuffer(std::streambuf * sink)
+: _sink(sink), _context(EVP_MD_CTX_new(), EVP_MD_CTX_free)
+{
+    if(!this->_context || !EVP_DigestInit_ex(
+        this->_context.get(), EVP_sha1(), nullptr))
+    {
+        throw Exception("Could not initialize "+HashBuffer::algorithm);
+    }
+}
+
+std::string
+HashBuffer
+::digest()
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int size = 0;
+    if(!EVP_DigestFinal_ex(this->_context.get(), digest, &size))
+    {
+        throw Exception("Could not compute "+HashBuffer::algorithm);
+    }
+
+    std::ostringstream stream;
+    stream << HashBuffer::algorithm << ":" << std::hex << std::setfill('0');
+    for(unsigned int i=0; i<size; ++i)
+    {
+        stream << std::setw(2) << static_cast<unsigned int>(digest[i]);
+    }
+    return stream.str();
+}
+
+HashBuffer::int_type
+HashBuffer
+::overflow(int_type c)
+{
+    if(traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        return traits_type::not_eof(c);
+    }
+
+    auto const character = traits_type::to_char_type(c);
+    EVP_DigestUpdate(this->_context.get(), &character, 1);
+    if(this->_sink)
+    {
+        return this->_sink->sputc(character);
+    }
+    return c;
+}
+
+std::streamsize
+HashBuffer
+::xsputn(char const * s, std::streamsize count)
+{
+    EVP_DigestUpdate(this->_context.get(), s, count);
+    if(this->_sink)
+    {
+        return this->_sink->sputn(s, count);
+    }
+    return count;
+}
+
+} // namespace archive
+
+} // namespace dopamine
@@ -0,0 +1,59 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _11116377_11b3_4a60_bb51_3d72c867a954
+#define _11116377_11b3_4a60_bb51_3d72c867a954
+
+#include <memory>
+#include <streambuf>
+#include <string>
+
+#include <openssl/evp.h>
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Output stream buffer hashing its input and forwarding it to another
+ * stream buffer, or discarding it if there is none.
+ */
+class HashBuffer: public std::streambuf
+{
+public:
+    /// @brief Hash algorithm, prefix of the digests.
+    static std::string const algorithm;
+
+    /// @brief Constructor.
+    HashBuffer(std::streambuf * sink=nullptr);
+
+    HashBuffer(HashBuffer const &) = delete;
+    HashBuffer & operator=(HashBuffer const &) = delete;
+
+    /**
+     * @brief Return the digest of the input, as "<algorithm>:<hex digest>".
+     * The digest is computed once, after the whole input is written.
+     */
+    std::string digest();
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(char const * s, std::streamsize count);
+
+private:
+    std::streambuf * _sink;
+    std::unique_ptr<EVP_MD_CTX, void(*)(EVP_MD_CTX*)> _context;
+};
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _11116377_11b3_4a60_bb51_3d72c867a954
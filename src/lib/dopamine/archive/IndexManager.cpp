@@ -0,0 +1,304 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/IndexManager.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <mongo/client/dbclient.h>
+#include <odil/registry.h>
+
+#include "dopamine/archive/date_time.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/Exception.h"
+#include "dopamine/logging.h"
+
+namespace
+{
+
+/**
+ * @brief Add the fields of a condition to its shape, including the sub-fields
+ * matched by $elemMatch, as dotted paths below the given prefix.
+ */
+void get_shape(
+    mongo::BSONObj const & condition, std::set<std::string> & shape,
+    std::string const & prefix="")
+{
+    for(auto it=condition.begin(); it.more(); /* nothing */)
+    {
+        auto const element = it.next();
+        std::string const name = element.fieldName();
+        if(name == "$and" || name == "$or" || name == "$nor")
+        {
+            for(auto const & term: element.Array())
+            {
+                if(term.isABSONObj())
+                {
+                    get_shape(term.Obj(), shape, prefix);
+                }
+            }
+        }
+        else if(!name.empty() && name[0] != '$')
+        {
+            if(
+                element.type() == mongo::Object
+                && element.Obj().nFields() == 1
+                && element.Obj()["$exists"].isBoolean()
+                && !element.Obj()["$exists"].Bool())
+            {
+                // Not a bound of an index scan, e.g. a single value.
+                continue;
+            }
+
+            auto const path = prefix.empty()?name:prefix+"."+name;
+            std::set<std::string> sub_shape;
+            if(element.type() == mongo::Object)
+            {
+                auto const match = element.Obj()["$elemMatch"];
+                if(match.type() == mongo::Object)
+                {
+                    get_shape(match.Obj(), sub_shape, path);
+                }
+            }
+            if(sub_shape.empty())
+            {
+                shape.insert(path);
+            }
+            else
+            {
+                shape.insert(sub_shape.begin(), sub_shape.end());
+            }
+        }
+    }
+}
+
+std::string as_string(std::set<std::string> const & shape)
+{
+    return boost::algorithm::join(shape, ", ");
+}
+
+}
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+IndexManager::Index
+::Index(mongo::BSONObj const & keys, bool unique)
+: keys(keys), unique(unique)
+{
+    // Nothing else.
+}
+
+std::vector<IndexManager::Index>
+IndexManager
+::get_default_indexes(Schema schema, bool unique_instances)
+{
+    auto const get_field = [&](odil::Tag const & tag) {
+        return get_value_path(tag, schema); };
+
+    // NOTE: the values may be stored in arrays, and MongoDB cannot index two
+    // arrays in the same index: the patient, study and series levels are
+    // single-field indexes.
+    return {
+        {
+            BSON(get_field(odil::registry::SOPInstanceUID) << 1),
+            unique_instances
+        },
+        { BSON(get_field(odil::registry::PatientID) << 1) },
+        { BSON(get_field(odil::registry::StudyInstanceUID) << 1) },
+        { BSON(get_field(odil::registry::SeriesInstanceUID) << 1) },
+        { BSON(get_field(odil::registry::PatientName)+".Alphabetic" << 1) },
+        {
+            BSON(
+                get_field(odil::registry::PatientName)+"."
+                    +normalized_alphabetic << 1)
+        },
+        { BSON(get_field(odil::registry::StudyDate) << 1) },
+        {
+            BSON(
+                normalized_field+"."+std::string(odil::registry::StudyDate)
+                << 1)
+        },
+        {
+            BSON(
+                normalized_field+"."+get_date_time_field(
+                    odil::registry::StudyDate, odil::registry::StudyTime)
+                << 1)
+        },
+        { BSON(get_field(odil::registry::AccessionNumber) << 1) },
+        { BSON(get_field(odil::registry::Modality) << 1) },
+    };
+}
+
+mongo::BSONObj
+IndexManager
+::parse_keys(std::string const & keys, Schema schema)
+{
+    std::vector<std::string> fields;
+    boost::split(fields, keys, boost::is_any_of(","));
+
+    mongo::BSONObjBuilder builder;
+    for(auto field: fields)
+    {
+        boost::trim(field);
+        if(field.empty())
+        {
+            throw Exception("Invalid index: \""+keys+"\"");
+        }
+
+        // Tags are converted to the path of their value, with the same
+        // spelling as the stored field names.
+        if(
+            field.size() == 8
+            && field.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos)
+        {
+            odil::Tag const tag(std::stoul(field, nullptr, 16));
+            field = get_value_path(tag, schema);
+        }
+        builder << field << 1;
+    }
+
+    return builder.obj();
+}
+
+IndexManager
+::IndexManager(ConnectionPool & connection_pool, std::string const & database)
+: _connection_pool(connection_pool), _namespace(database+".datasets"),
+  _indexes(IndexManager::get_default_indexes()), _report_threshold(100)
+{
+    // Nothing else.
+}
+
+std::vector<IndexManager::Index> const &
+IndexManager
+::get_indexes() const
+{
+    return this->_indexes;
+}
+
+void
+IndexManager
+::set_defaults(Schema schema, bool unique_instances)
+{
+    this->_indexes = IndexManager::get_default_indexes(
+        schema, unique_instances);
+}
+
+void
+IndexManager
+::add_index(Index const & index)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_indexes.push_back(index);
+}
+
+unsigned int
+IndexManager
+::get_report_threshold() const
+{
+    return this->_report_threshold;
+}
+
+void
+IndexManager
+::set_report_threshold(unsigned int threshold)
+{
+    this->_report_threshold = threshold;
+}
+
+unsigned int
+IndexManager
+::create_indexes() const
+{
+    unsigned int errors = 0;
+
+    auto connection = this->_connection_pool.acquire();
+    for(auto const & index: this->_indexes)
+    {
+        try
+        {
+            connection->createIndex(
+                this->_namespace,
+                mongo::IndexSpec().addKeys(index.keys).unique(index.unique));
+            DOPAMINE_LOG(DEBUG)
+                << "Index " << index.keys.toString()
+                << (index.unique?" (unique)":"") << " is available";
+        }
+        catch(mongo::DBException const & e)
+        {
+            DOPAMINE_LOG(ERROR)
+                << "Could not create index " << index.keys.toString()
+                << " on " << this->_namespace << ": " << e.what();
+            ++errors;
+        }
+    }
+
+    return errors;
+}
+
+void
+IndexManager
+::record_query(mongo::BSONObj const & condition)
+{
+    std::set<std::string> shape;
+    get_shape(condition, shape);
+    if(shape.empty())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if(this->_is_served(shape))
+    {
+        return;
+    }
+
+    auto const count = ++this->_shapes[shape];
+    if(count == this->_report_threshold)
+    {
+        DOPAMINE_LOG(WARN)
+            << "Query on " << as_string(shape) << " seen " << count
+            << " times is not served by an index";
+    }
+}
+
+std::map<std::set<std::string>, unsigned int>
+IndexManager
+::get_missing_indexes() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_shapes;
+}
+
+bool
+IndexManager
+::_is_served(std::set<std::string> const & shape) const
+{
+    for(auto const & index: this->_indexes)
+    {
+        if(!index.keys.isEmpty() && shape.count(index.keys.firstElementFieldName()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace archive
+
+} // namespace dopamine
@@ -0,0 +1,124 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _272cb165_f0dd_4f73_8e7c_0a786fdd2c26
+#define _272cb165_f0dd_4f73_8e7c_0a786fdd2c26
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/bson_converter.h"
+#include "dopamine/ConnectionPool.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Create the indexes of the datasets collection and report the query
+ * shapes which are not served by an index.
+ *
+ * A query shape is the set of fields of a query condition. A shape is
+ * considered as served if the first field of an index belongs to it.
+ */
+class IndexManager
+{
+public:
+    /// @brief Index of the datasets collection.
+    struct Index
+    {
+        mongo::BSONObj keys;
+        bool unique;
+
+        Index(mongo::BSONObj const & keys, bool unique=false);
+    };
+
+    /**
+     * @brief Return the default indexes: SOP Instance UID, unique if
+     * requested, and the keys of the patient, study and series levels and
+     * common query keys.
+     */
+    static std::vector<Index> get_default_indexes(
+        Schema schema=Schema::Verbose, bool unique_instances=false);
+
+    /**
+     * @brief Parse a comma-separated list of tags (e.g. "00100020,00080020")
+     * or of field paths to the keys of an index.
+     */
+    static mongo::BSONObj parse_keys(
+        std::string const & keys, Schema schema=Schema::Verbose);
+
+    /// @brief Constructor, using the default indexes.
+    IndexManager(ConnectionPool & connection_pool, std::string const & database);
+
+    /// @brief Return the indexes.
+    std::vector<Index> const & get_indexes() const;
+
+    /**
+     * @brief Reset the indexes to the default ones of a schema of the
+     * metadata documents. The SOP Instance UID index must only be unique if
+     * the storage does not keep several data sets with the same SOP Instance
+     * UID, i.e. with a duplicates policy other than None.
+     */
+    void set_defaults(Schema schema, bool unique_instances);
+
+    /// @brief Add an index to be created.
+    void add_index(Index const & index);
+
+    /**
+     * @brief Return the number of times a query shape must be seen before it
+     * is reported as missing an index, default to 100.
+     */
+    unsigned int get_report_threshold() const;
+
+    /// @brief Set the report threshold.
+    void set_report_threshold(unsigned int threshold);
+
+    /**
+     * @brief Create the indexes if they do not exist; errors are logged, and
+     * the number of indexes which could not be created is returned. A unique
+     * index cannot be created if the collection already holds duplicates.
+     */
+    unsigned int create_indexes() const;
+
+    /**
+     * @brief Record the shape of a query condition, log a warning the first
+     * time a shape not served by an index reaches the report threshold.
+     */
+    void record_query(mongo::BSONObj const & condition);
+
+    /**
+     * @brief Return the shapes not served by an index, with the number of
+     * times they were seen.
+     */
+    std::map<std::set<std::string>, unsigned int> get_missing_indexes() const;
+
+private:
+    ConnectionPool & _connection_pool;
+    std::string _namespace;
+    std::vector<Index> _indexes;
+    unsigned int _report_threshold;
+
+    mutable std::mutex _mutex;
+    std::map<std::set<std::string>, unsigned int> _shapes;
+
+    bool _is_served(std::set<std::string> const & shape) const;
+};
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _272cb165_f0dd_4f73_8e7c_0a786fdd2c26
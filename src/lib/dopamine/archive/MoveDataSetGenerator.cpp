@@ -23,6 +23,9 @@
 
 #include "dopamine/AccessControlList.h"
 #include "dopamine/archive/DataSetGeneratorHelper.h"
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/logging.h"
 #include "dopamine/utils.h"
 
@@ -34,12 +37,12 @@ namespace archive
 
 MoveDataSetGenerator
 ::MoveDataSetGenerator(
-    mongo::DBClientConnection & connection, AccessControlList const & acl,
+    ConnectionPool & connection_pool, AccessControlList const & acl,
     std::string const & database, std::string const & bulk_database,
     odil::AssociationParameters const & parameters)
-: _connection(connection), _acl(acl), _parameters(parameters),
+: _connection_pool(connection_pool), _acl(acl), _parameters(parameters),
   _helper(
-    connection, acl, database, bulk_database, get_principal(parameters),
+    connection_pool, acl, database, bulk_database, get_principal(parameters),
     "Retrieve")
 {
     this->_datasets_namespace = database+".datasets";
@@ -52,6 +55,55 @@ MoveDataSetGenerator
     // Nothing to do.
 }
 
+void
+MoveDataSetGenerator
+::set_index_manager(IndexManager * index_manager)
+{
+    this->_helper.set_index_manager(index_manager);
+}
+
+void
+MoveDataSetGenerator
+::set_query_plan_cache(QueryPlanCache * query_plan_cache)
+{
+    this->_helper.set_query_plan_cache(query_plan_cache);
+}
+
+unsigned int
+MoveDataSetGenerator
+::get_batch_size() const
+{
+    return this->_helper.get_batch_size();
+}
+
+void
+MoveDataSetGenerator
+::set_batch_size(unsigned int batch_size)
+{
+    this->_helper.set_batch_size(batch_size);
+}
+
+unsigned int
+MoveDataSetGenerator
+::get_prefetch() const
+{
+    return this->_helper.get_prefetch();
+}
+
+void
+MoveDataSetGenerator
+::set_prefetch(unsigned int prefetch)
+{
+    this->_helper.set_prefetch(prefetch);
+}
+
+Storage &
+MoveDataSetGenerator
+::get_storage()
+{
+    return this->_helper.get_storage();
+}
+
 void
 MoveDataSetGenerator
 ::initialize(odil::message::Request const & request)
@@ -72,21 +124,12 @@ MoveDataSetGenerator
 
     auto const condition = condition_builder.obj();
     auto const projection = BSON(
-        std::string(odil::registry::SOPInstanceUID) << 1
-        << "Content" << 1);
+        std::string(odil::registry::SOPInstanceUID) << 1);
 
-    auto const cursor = this->_connection.query(
-        this->_datasets_namespace, condition, 0, 0, &projection);
-    std::vector<mongo::BSONObj> results;
-    while(cursor->more())
-    {
-        auto const object = cursor->next().getOwned();
-        results.push_back(object);
-    }
-    this->_helper.set_results(results);
+    this->_helper.query(this->_datasets_namespace, condition, projection);
     DOPAMINE_LOG(DEBUG)
-        << "Sending " << results.size()
-        << " instance" << (results.size()>1?"s":"");
+        << "Sending " << this->_helper.count()
+        << " instance" << (this->_helper.count()>1?"s":"");
 
     this->_dicom_data_set_up_to_date = false;
 }
@@ -116,11 +159,7 @@ MoveDataSetGenerator
 {
     if(!this->_dicom_data_set_up_to_date)
     {
-        auto const current = this->_helper.get();
-        auto const sop_instance_uid = current[
-            std::string(odil::registry::SOPInstanceUID)][
-                "Value"].Array()[0].String();
-        this->_dicom_data_set = this->_helper.retrieve(sop_instance_uid);
+        this->_dicom_data_set = this->_helper.retrieve_current();
         this->_dicom_data_set_up_to_date = true;
     }
 
@@ -139,9 +178,13 @@ MoveDataSetGenerator
 ::get_association(odil::message::CMoveRequest const & request) const
 {
     // Find the peer information
-    auto const peer = this->_connection.findOne(
-        this->_peers_namespace,
-        BSON("ae_title" << request.get_move_destination()));
+    mongo::BSONObj peer;
+    {
+        auto connection = this->_connection_pool.acquire();
+        peer = connection->findOne(
+            this->_peers_namespace,
+            BSON("ae_title" << request.get_move_destination()));
+    }
     if(peer.isEmpty())
     {
         throw odil::Exception("Unknown move destination");
@@ -164,15 +207,16 @@ MoveDataSetGenerator
         std::string(odil::registry::SOPClassUID) << 1
         << "Content" << 1);
 
-    auto const cursor = this->_connection.query(
+    auto connection = this->_connection_pool.acquire();
+    auto const cursor = connection->query(
         this->_datasets_namespace, condition, 0, 0, &projection);
     std::set<std::string> sop_classes;
     while(cursor->more())
     {
         auto const object = cursor->next();
         sop_classes.insert(
-            object[std::string(odil::registry::SOPClassUID)].Obj()
-                ["Value"].Array()[0].String());
+            get_first_value(
+                object[std::string(odil::registry::SOPClassUID)]).String());
     }
 
     std::vector<odil::AssociationParameters::PresentationContext> contexts;
@@ -8,9 +8,10 @@
 
 #include "dopamine/archive/QueryDataSetGenerator.h"
 
-#include <functional>
 #include <map>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <mongo/bson/bson.h>
@@ -25,7 +26,9 @@
 #include <odil/SCP.h>
 
 #include "dopamine/AccessControlList.h"
+#include "dopamine/archive/IndexManager.h"
 #include "dopamine/bson_converter.h"
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/logging.h"
 #include "dopamine/utils.h"
 
@@ -35,17 +38,18 @@ namespace dopamine
 namespace archive
 {
 
-std::map<odil::Tag, QueryDataSetGenerator::AttributeCalculator> const
+std::map<odil::Tag, QueryDataSetGenerator::ComputedAttribute> const
 QueryDataSetGenerator
-::_attribute_calculators=QueryDataSetGenerator::_create_attribute_calculators();
+::_computed_attributes=QueryDataSetGenerator::_create_computed_attributes();
 
 QueryDataSetGenerator
 ::QueryDataSetGenerator(
-    mongo::DBClientConnection & connection, AccessControlList const & acl,
+    ConnectionPool & connection_pool, AccessControlList const & acl,
     std::string const & database,
     odil::AssociationParameters const & parameters)
-: _connection(connection), _acl(acl), _parameters(parameters),
-  _helper(connection, acl, database, "", get_principal(parameters), "Query")
+: _connection_pool(connection_pool), _acl(acl), _parameters(parameters),
+  _helper(
+    connection_pool, acl, database, "", get_principal(parameters), "Query")
 {
     this->set_database(database);
 }
@@ -71,6 +75,34 @@ QueryDataSetGenerator
     this->_namespace = database+".datasets";
 }
 
+void
+QueryDataSetGenerator
+::set_index_manager(IndexManager * index_manager)
+{
+    this->_helper.set_index_manager(index_manager);
+}
+
+void
+QueryDataSetGenerator
+::set_query_plan_cache(QueryPlanCache * query_plan_cache)
+{
+    this->_helper.set_query_plan_cache(query_plan_cache);
+}
+
+Schema
+QueryDataSetGenerator
+::get_schema() const
+{
+    return this->_helper.get_schema();
+}
+
+void
+QueryDataSetGenerator
+::set_schema(Schema schema)
+{
+    this->_helper.set_schema(schema);
+}
+
 void
 QueryDataSetGenerator
 ::initialize(odil::message::Request const & request)
@@ -84,7 +116,7 @@ QueryDataSetGenerator
     // Don't query additional attributes (PS 3.4, C.3.4), they are processed
     // later.
     this->_additional_attributes.clear();
-    for(auto const it: this->_attribute_calculators)
+    for(auto const it: this->_computed_attributes)
     {
         auto const & tag = it.first;
         if(data_set.has(tag))
@@ -119,7 +151,8 @@ QueryDataSetGenerator
     );
 
     mongo::BSONObj info;
-    auto const ok = this->_connection.runCommand(
+    auto connection = this->_connection_pool.acquire();
+    auto const ok = connection->runCommand(
         this->_database,
         BSON("aggregate" << "datasets" << "pipeline" << pipeline), info);
     if(!ok)
@@ -137,6 +170,8 @@ QueryDataSetGenerator
         results.push_back(result["_id"].Obj().getOwned());
     }
 
+    this->_compute_attributes(*connection, results);
+
     this->_helper.set_results(results);
 
     DOPAMINE_LOG(DEBUG)
@@ -174,8 +209,37 @@ QueryDataSetGenerator
         this->_dicom_data_set = as_dataset(this->_helper.get());
         for(auto const & attribute: this->_additional_attributes)
         {
-            auto const & function = this->_attribute_calculators.at(attribute);
-            function(this, this->_dicom_data_set);
+            auto const & computed = this->_computed_attributes.at(attribute);
+
+            odil::DataSet const * values = nullptr;
+            auto const values_it = this->_computed_values.find(
+                computed.primary);
+            if(
+                values_it != this->_computed_values.end()
+                && this->_dicom_data_set.has(computed.primary)
+                && !this->_dicom_data_set.empty(computed.primary))
+            {
+                auto const it = values_it->second.find(
+                    this->_dicom_data_set.as_string(computed.primary, 0));
+                if(it != values_it->second.end())
+                {
+                    values = &it->second;
+                }
+            }
+
+            if(values != nullptr)
+            {
+                this->_dicom_data_set.add(attribute, (*values)[attribute]);
+            }
+            else if(computed.count)
+            {
+                this->_dicom_data_set.add(
+                    attribute, { odil::Value::Integer(0) });
+            }
+            else
+            {
+                this->_dicom_data_set.add(attribute, odil::Value::Strings());
+            }
         }
         this->_dicom_data_set.add(
             odil::registry::SpecificCharacterSet, {"ISO_IR 192"});
@@ -190,229 +254,311 @@ QueryDataSetGenerator
     return this->_dicom_data_set;
 }
 
-std::map<odil::Tag, QueryDataSetGenerator::AttributeCalculator>
+std::map<odil::Tag, QueryDataSetGenerator::ComputedAttribute>
 QueryDataSetGenerator
-::_create_attribute_calculators()
+::_create_computed_attributes()
 {
     return {
         {
             odil::registry::NumberOfPatientRelatedStudies,
-            &QueryDataSetGenerator::_NumberOfPatientRelatedStudies
+            {
+                odil::registry::PatientID, odil::registry::StudyInstanceUID,
+                true
+            }
         },
         {
             odil::registry::NumberOfPatientRelatedSeries,
-            &QueryDataSetGenerator::_NumberOfPatientRelatedSeries
+            {
+                odil::registry::PatientID, odil::registry::SeriesInstanceUID,
+                true
+            }
         },
         {
             odil::registry::NumberOfPatientRelatedInstances,
-            &QueryDataSetGenerator::_NumberOfPatientRelatedInstances
+            {
+                odil::registry::PatientID, odil::registry::SOPInstanceUID,
+                true
+            }
         },
         {
             odil::registry::NumberOfStudyRelatedSeries,
-            &QueryDataSetGenerator::_NumberOfStudyRelatedSeries
+            {
+                odil::registry::StudyInstanceUID,
+                odil::registry::SeriesInstanceUID, true
+            }
         },
         {
             odil::registry::NumberOfStudyRelatedInstances,
-            &QueryDataSetGenerator::_NumberOfStudyRelatedInstances
+            {
+                odil::registry::StudyInstanceUID,
+                odil::registry::SOPInstanceUID, true
+            }
         },
         {
             odil::registry::NumberOfSeriesRelatedInstances,
-            &QueryDataSetGenerator::_NumberOfSeriesRelatedInstances
+            {
+                odil::registry::SeriesInstanceUID,
+                odil::registry::SOPInstanceUID, true
+            }
         },
         {
             odil::registry::ModalitiesInStudy,
-            &QueryDataSetGenerator::_ModalitiesInStudy
+            { odil::registry::StudyInstanceUID, odil::registry::Modality, false }
         },
         {
             odil::registry::SOPClassesInStudy,
-            &QueryDataSetGenerator::_SOPClassesInStudy
+            {
+                odil::registry::StudyInstanceUID, odil::registry::SOPClassUID,
+                false
+            }
         },
     };
 }
 
 void
 QueryDataSetGenerator
-::_xxx_in_yyy(
-    odil::DataSet & data_set,
-    odil::Tag const & primary, odil::Tag const & secondary,
-    odil::Tag const & destination) const
+::_compute_attributes(
+    mongo::DBClientConnection & connection,
+    std::vector<mongo::BSONObj> const & results)
 {
-    mongo::BSONObj const condition(BSON(
-        "$and" << BSON_ARRAY(
-            BSON(std::string(primary)+".Value" << data_set.as_string(primary, 0))
-            << this->_acl.get_constraints(
-                get_principal(this->_parameters), "Query")
-           )
-    ));
-    auto const projection = BSON(
-        std::string(primary) << 1 << std::string(secondary) << 1);
-
-    auto const pipeline = BSON_ARRAY(
-        BSON("$match" << condition)
-        << BSON("$project" << projection)
-        << BSON(
-            "$group" << BSON(
-                "_id" << BSON(
-                    std::string(primary) << "$"+std::string(primary)+".Value"
-                )
-                << "result" << BSON("$addToSet" << "$"+std::string(secondary)+".Value")
-            )
-        )
-    );
+    this->_computed_values.clear();
 
-    mongo::BSONObj info;
-    auto const ok = this->_connection.runCommand(
-        this->_database,
-        BSON("aggregate" << "datasets" << "pipeline" << pipeline), info);
-    if(!ok)
+    // Group the additional attributes by primary attribute
+    std::map<odil::Tag, std::vector<odil::Tag>> attributes;
+    for(auto const & attribute: this->_additional_attributes)
     {
-        odil::DataSet status;
-        status.add(odil::registry::OffendingElement, {destination});
-        status.add(odil::registry::ErrorComment, {info["errmsg"].String()});
-        throw odil::SCP::Exception(
-            info["errmsg"].String(),
-            odil::message::CFindResponse::UnableToProcess, status);
+        auto const & computed = this->_computed_attributes.at(attribute);
+        attributes[computed.primary].push_back(attribute);
+    }
+    if(attributes.empty())
+    {
+        return;
     }
 
-    odil::Value::Strings values;
-    auto const result = info["result"].Array()[0]["result"].Array();
-    std::transform(
-        result.begin(), result.end(), std::back_inserter(values),
-        [](mongo::BSONElement const & element)
-        {
-            return element.Array()[0].String();
-        });
+    auto const constraints = this->_acl.get_constraints(
+        get_principal(this->_parameters), "Query");
 
-    data_set.add(destination, values);
-}
-void
-QueryDataSetGenerator
-::_number_of_xxx_related_yyy(
-    odil::DataSet & data_set,
-    odil::Tag const & primary, odil::Tag const & secondary,
-    odil::Tag const & destination) const
-{
-    mongo::BSONObj const condition(BSON(
-        "$and" << BSON_ARRAY(
-            BSON(std::string(primary)+".Value" << data_set.as_string(primary, 0))
-            << this->_acl.get_constraints(
-                get_principal(this->_parameters), "Query")
-        )
-    ));
-    auto const projection = BSON(
-        std::string(primary) << 1 << std::string(secondary) << 1);
+    for(auto const & item: attributes)
+    {
+        auto const & primary = item.first;
+        auto const primary_value = get_value_path(
+            primary, this->_helper.get_schema());
 
-    auto const pipeline = BSON_ARRAY(
-        BSON("$match" << condition)
-        << BSON("$project" << projection)
-        << BSON(
-            "$group" << BSON(
-                "_id" << BSON(
-                    std::string(primary) << "$"+std::string(primary)+".Value" <<
-                    std::string(secondary) << "$"+std::string(secondary)+".Value"
-                )
-            )
-        )
-    );
+        // Primary values of all results
+        std::set<std::string> primary_values;
+        for(auto const & result: results)
+        {
+            auto const value = get_first_value(result[std::string(primary)]);
+            if(value.type() == mongo::String)
+            {
+                primary_values.insert(value.String());
+            }
+        }
 
-    mongo::BSONObj info;
-    auto const ok = this->_connection.runCommand(
-        this->_database,
-        BSON("aggregate" << "datasets" << "pipeline" << pipeline), info);
-    if(!ok)
-    {
-        odil::DataSet status;
-        status.add(odil::registry::OffendingElement, {destination});
-        status.add(odil::registry::ErrorComment, {info["errmsg"].String()});
-        throw odil::SCP::Exception(
-            info["errmsg"].String(),
-            odil::message::CFindResponse::UnableToProcess, status);
-    }
+        // The summaries do not take the ACL constraints into account.
+        if(constraints.isEmpty())
+        {
+            this->_read_summaries(
+                connection, primary, item.second, primary_values);
+        }
+        if(primary_values.empty())
+        {
+            continue;
+        }
 
-    data_set.add(
-        destination, { odil::Value::Integer(info["result"].Array().size()) });
-}
+        mongo::BSONArrayBuilder values_builder;
+        for(auto const & value: primary_values)
+        {
+            values_builder << value;
+        }
 
-void
-QueryDataSetGenerator
-::_NumberOfPatientRelatedStudies(odil::DataSet & data_set) const
-{
-    this->_number_of_xxx_related_yyy(
-        data_set,
-        odil::registry::PatientID, odil::registry::StudyInstanceUID,
-        odil::registry::NumberOfPatientRelatedStudies);
-}
+        mongo::BSONArrayBuilder condition_builder;
+        condition_builder
+            << BSON(primary_value << BSON("$in" << values_builder.arr()));
+        if(!constraints.isEmpty())
+        {
+            condition_builder << constraints;
+        }
 
-void
-QueryDataSetGenerator
-::_NumberOfPatientRelatedSeries(odil::DataSet & data_set) const
-{
-    this->_number_of_xxx_related_yyy(
-        data_set,
-        odil::registry::PatientID, odil::registry::SeriesInstanceUID,
-        odil::registry::NumberOfPatientRelatedSeries);
-}
+        // Collect the distinct secondary values of each primary value, and
+        // only return their number when counting. As in the summaries, each
+        // metadata document is an instance.
+        mongo::BSONObjBuilder group_builder;
+        group_builder << "_id" << "$"+primary_value;
+        mongo::BSONObjBuilder projection_builder;
+        for(auto const & attribute: item.second)
+        {
+            auto const & computed = this->_computed_attributes.at(attribute);
+            std::string const field(attribute);
+            if(computed.secondary == odil::registry::SOPInstanceUID)
+            {
+                group_builder << field << BSON("$sum" << 1);
+                projection_builder << field << 1;
+                continue;
+            }
+            group_builder
+                << field << BSON(
+                    "$addToSet" << "$"+get_value_path(
+                        computed.secondary, this->_helper.get_schema()));
+            if(computed.count)
+            {
+                projection_builder << field << BSON("$size" << "$"+field);
+            }
+            else
+            {
+                projection_builder << field << 1;
+            }
+        }
 
-void
-QueryDataSetGenerator
-::_NumberOfPatientRelatedInstances(odil::DataSet & data_set) const
-{
-    this->_number_of_xxx_related_yyy(
-        data_set,
-        odil::registry::PatientID, odil::registry::SOPInstanceUID,
-        odil::registry::NumberOfPatientRelatedInstances);
-}
+        auto const pipeline = BSON_ARRAY(
+            BSON("$match" << BSON("$and" << condition_builder.arr()))
+            << BSON("$group" << group_builder.obj())
+            << BSON("$project" << projection_builder.obj())
+        );
+
+        mongo::BSONObj info;
+        auto const ok = connection.runCommand(
+            this->_database,
+            BSON("aggregate" << "datasets" << "pipeline" << pipeline), info);
+        if(!ok)
+        {
+            odil::DataSet status;
+            status.add(odil::registry::OffendingElement, {item.second[0]});
+            status.add(odil::registry::ErrorComment, {info["errmsg"].String()});
+            throw odil::SCP::Exception(
+                info["errmsg"].String(),
+                odil::message::CFindResponse::UnableToProcess, status);
+        }
 
-void
-QueryDataSetGenerator
-::_NumberOfStudyRelatedSeries(odil::DataSet & data_set) const
-{
-    this->_number_of_xxx_related_yyy(
-        data_set,
-        odil::registry::StudyInstanceUID, odil::registry::SeriesInstanceUID,
-        odil::registry::NumberOfStudyRelatedSeries);
+        auto & values = this->_computed_values[primary];
+        for(auto const & result: info["result"].Array())
+        {
+            auto const id = get_first_value(result["_id"]);
+            if(id.type() != mongo::String)
+            {
+                continue;
+            }
+
+            odil::DataSet data_set;
+            for(auto const & attribute: item.second)
+            {
+                auto const & computed = this->_computed_attributes.at(attribute);
+                auto const field = result[std::string(attribute)];
+                if(computed.count)
+                {
+                    data_set.add(
+                        attribute, { odil::Value::Integer(field.numberLong()) });
+                }
+                else
+                {
+                    odil::Value::Strings strings;
+                    for(auto const & element: field.Array())
+                    {
+                        // Each element holds the values of a data set
+                        auto const value = get_first_value(element);
+                        if(value.type() == mongo::String)
+                        {
+                            strings.push_back(value.String());
+                        }
+                    }
+                    data_set.add(attribute, strings);
+                }
+            }
+
+            values[id.String()] = data_set;
+        }
+    }
 }
 
 void
 QueryDataSetGenerator
-::_NumberOfStudyRelatedInstances(odil::DataSet & data_set) const
+::_read_summaries(
+    mongo::DBClientConnection & connection, odil::Tag const & primary,
+    std::vector<odil::Tag> const & attributes,
+    std::set<std::string> & primary_values)
 {
-    this->_number_of_xxx_related_yyy(
-        data_set,
-        odil::registry::StudyInstanceUID, odil::registry::SOPInstanceUID,
-        odil::registry::NumberOfStudyRelatedInstances);
-}
+    std::string collection;
+    if(primary == odil::registry::PatientID)
+    {
+        collection = "patients";
+    }
+    else if(primary == odil::registry::StudyInstanceUID)
+    {
+        collection = "studies";
+    }
+    else if(primary == odil::registry::SeriesInstanceUID)
+    {
+        collection = "series";
+    }
+    else
+    {
+        return;
+    }
 
-void
-QueryDataSetGenerator
-::_NumberOfSeriesRelatedInstances(odil::DataSet & data_set) const
-{
-    this->_number_of_xxx_related_yyy(
-        data_set,
-        odil::registry::SeriesInstanceUID, odil::registry::SOPInstanceUID,
-        odil::registry::NumberOfSeriesRelatedInstances);
-}
+    mongo::BSONArrayBuilder values_builder;
+    for(auto const & value: primary_values)
+    {
+        values_builder << value;
+    }
 
+    // Stale summaries fall back to the data sets; they are rebuilt offline,
+    // not while the connection of this query is held.
+    auto & values = this->_computed_values[primary];
+    auto cursor = connection.query(
+        this->_database+"."+collection,
+        BSON(
+            "_id" << BSON("$in" << values_builder.arr())
+            << "stale" << BSON("$ne" << true)));
+    while(cursor->more())
+    {
+        auto const summary = cursor->next();
+        if(summary["_id"].type() != mongo::String)
+        {
+            continue;
+        }
+        auto const primary_value = summary["_id"].String();
 
-void
-QueryDataSetGenerator
-::_ModalitiesInStudy(odil::DataSet & data_set) const
-{
-    this->_xxx_in_yyy(
-        data_set,
-        odil::registry::StudyInstanceUID, odil::registry::Modality,
-        odil::registry::ModalitiesInStudy);
-}
+        odil::DataSet data_set;
+        for(auto const & attribute: attributes)
+        {
+            auto const & computed = this->_computed_attributes.at(attribute);
+
+            // Instances are counted, other attributes are distinct values.
+            if(computed.secondary == odil::registry::SOPInstanceUID)
+            {
+                data_set.add(
+                    attribute,
+                    { odil::Value::Integer(summary["instances"].numberLong()) });
+                continue;
+            }
+
+            auto const field = summary[std::string(computed.secondary)];
+            std::vector<mongo::BSONElement> distinct;
+            if(field.type() == mongo::Array)
+            {
+                distinct = field.Array();
+            }
+            if(computed.count)
+            {
+                data_set.add(
+                    attribute, { odil::Value::Integer(distinct.size()) });
+            }
+            else
+            {
+                odil::Value::Strings strings;
+                for(auto const & element: distinct)
+                {
+                    strings.push_back(element.String());
+                }
+                data_set.add(attribute, strings);
+            }
+        }
 
-void
-QueryDataSetGenerator
-::_SOPClassesInStudy(odil::DataSet & data_set) const
-{
-    this->_xxx_in_yyy(
-        data_set,
-        odil::registry::StudyInstanceUID, odil::registry::SOPClassUID,
-        odil::registry::SOPClassesInStudy);
+        values[primary_value] = data_set;
+        primary_values.erase(primary_value);
+    }
 }
+
 }
 
 }
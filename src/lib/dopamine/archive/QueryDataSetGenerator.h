@@ -9,9 +9,10 @@
 #ifndef _28a4833c_45e9_4de8_a7ca_f45491e6410d
 #define _28a4833c_45e9_4de8_a7ca_f45491e6410d
 
-#include <functional>
 #include <map>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <mongo/client/dbclient.h>
@@ -23,6 +24,10 @@
 
 #include "dopamine/AccessControlList.h"
 #include "dopamine/archive/DataSetGeneratorHelper.h"
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/archive/QueryPlanCache.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/ConnectionPool.h"
 
 namespace dopamine
 {
@@ -34,7 +39,7 @@ class QueryDataSetGenerator: public odil::SCP::DataSetGenerator
 {
 public:
     QueryDataSetGenerator(
-        mongo::DBClientConnection & connection, AccessControlList const & acl,
+        ConnectionPool & connection_pool, AccessControlList const & acl,
         std::string const & database,
         odil::AssociationParameters const & parameters);
 
@@ -46,6 +51,18 @@ public:
     /// @brief Set the database name.
     void set_database(std::string const & database);
 
+    /// @brief Set the index manager recording the queries, may be null.
+    void set_index_manager(IndexManager * index_manager);
+
+    /// @brief Set the cache of the query plans, may be null.
+    void set_query_plan_cache(QueryPlanCache * query_plan_cache);
+
+    /// @brief Return the schema of the metadata documents, default to verbose.
+    Schema get_schema() const;
+
+    /// @brief Set the schema of the metadata documents.
+    void set_schema(Schema schema);
+
     /// @brief Initialize the generator, the request must be a C-FIND request.
     virtual void initialize(odil::message::Request const & request);
 
@@ -58,15 +75,21 @@ public:
     /// @brief Return the current element.
     virtual odil::DataSet get() const;
 private:
-
-    typedef
-        std::function<
-            void(QueryDataSetGenerator const *, odil::DataSet &)>
-            AttributeCalculator;
-
-    static std::map<odil::Tag, AttributeCalculator> const _attribute_calculators;
-
-    mongo::DBClientConnection & _connection;
+    /**
+     * @brief Additional attribute (PS 3.4, C.3.4), computed from the
+     * secondary attribute of all data sets with the same primary attribute.
+     */
+    struct ComputedAttribute
+    {
+        odil::Tag primary;
+        odil::Tag secondary;
+        /// @brief Count the distinct secondary values instead of listing them.
+        bool count;
+    };
+
+    static std::map<odil::Tag, ComputedAttribute> const _computed_attributes;
+
+    ConnectionPool & _connection_pool;
     AccessControlList const & _acl;
 
     std::string _database;
@@ -76,32 +99,34 @@ private:
 
     odil::DataSet _query;
     std::vector<odil::Tag> _additional_attributes;
+    /// @brief Computed attributes, by primary attribute and primary value.
+    std::map<odil::Tag, std::unordered_map<std::string, odil::DataSet>>
+        _computed_values;
 
     DataSetGeneratorHelper _helper;
 
     mutable bool _dicom_data_set_up_to_date;
     mutable odil::DataSet _dicom_data_set;
 
-    static std::map<odil::Tag, AttributeCalculator> _create_attribute_calculators();
-
-    void _xxx_in_yyy(
-        odil::DataSet & data_set,
-        odil::Tag const & primary, odil::Tag const & secondary,
-        odil::Tag const & destination) const;
-
-    void _number_of_xxx_related_yyy(
-        odil::DataSet & data_set,
-        odil::Tag const & primary, odil::Tag const & secondary,
-        odil::Tag const & destination) const;
-
-    void _NumberOfPatientRelatedStudies(odil::DataSet & data_set) const;
-    void _NumberOfPatientRelatedSeries(odil::DataSet & data_set) const;
-    void _NumberOfPatientRelatedInstances(odil::DataSet & data_set) const;
-    void _NumberOfStudyRelatedSeries(odil::DataSet & data_set) const;
-    void _NumberOfStudyRelatedInstances(odil::DataSet & data_set) const;
-    void _NumberOfSeriesRelatedInstances(odil::DataSet & data_set) const;
-    void _ModalitiesInStudy(odil::DataSet & data_set) const;
-    void _SOPClassesInStudy(odil::DataSet & data_set) const;
+    static std::map<odil::Tag, ComputedAttribute> _create_computed_attributes();
+
+    /**
+     * @brief Compute the additional attributes of all results, from the
+     * summaries or with one aggregation per primary attribute.
+     */
+    void _compute_attributes(
+        mongo::DBClientConnection & connection,
+        std::vector<mongo::BSONObj> const & results);
+
+    /**
+     * @brief Read the additional attributes from the summaries maintained by
+     * Storage, remove the primary values which were found. Missing and stale
+     * summaries are rebuilt first.
+     */
+    void _read_summaries(
+        mongo::DBClientConnection & connection, odil::Tag const & primary,
+        std::vector<odil::Tag> const & attributes,
+        std::set<std::string> & primary_values);
 };
 
 }
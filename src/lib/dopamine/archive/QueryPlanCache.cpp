@@ -0,0 +1,133 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/QueryPlanCache.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+QueryPlanCache
+::QueryPlanCache(unsigned int capacity)
+: _capacity(capacity), _hits(0), _misses(0)
+{
+    // Nothing else.
+}
+
+unsigned int
+QueryPlanCache
+::get_capacity() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_capacity;
+}
+
+void
+QueryPlanCache
+::set_capacity(unsigned int capacity)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_capacity = capacity;
+    this->_prune();
+}
+
+unsigned int
+QueryPlanCache
+::size() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_plans.size();
+}
+
+std::shared_ptr<QueryPlan const>
+QueryPlanCache
+::find(std::string const & shape)
+{
+    std::shared_ptr<QueryPlan const> plan;
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        auto const it = this->_index.find(shape);
+        if(it != this->_index.end())
+        {
+            this->_plans.splice(
+                this->_plans.begin(), this->_plans, it->second);
+            plan = it->second->second;
+        }
+    }
+
+    if(plan)
+    {
+        ++this->_hits;
+    }
+    else
+    {
+        ++this->_misses;
+    }
+    return plan;
+}
+
+void
+QueryPlanCache
+::insert(std::string const & shape, std::shared_ptr<QueryPlan const> plan)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if(this->_capacity == 0)
+    {
+        return;
+    }
+
+    auto const it = this->_index.find(shape);
+    if(it != this->_index.end())
+    {
+        // Inserted concurrently by another association.
+        it->second->second = plan;
+        this->_plans.splice(this->_plans.begin(), this->_plans, it->second);
+    }
+    else
+    {
+        this->_plans.emplace_front(shape, plan);
+        this->_index[shape] = this->_plans.begin();
+        this->_prune();
+    }
+}
+
+unsigned long
+QueryPlanCache
+::get_hits() const
+{
+    return this->_hits;
+}
+
+unsigned long
+QueryPlanCache
+::get_misses() const
+{
+    return this->_misses;
+}
+
+void
+QueryPlanCache
+::_prune()
+{
+    while(this->_plans.size() > this->_capacity)
+    {
+        this->_index.erase(this->_plans.back().first);
+        this->_plans.pop_back();
+    }
+}
+
+} // namespace archive
+
+} // namespace dopamine
@@ -0,0 +1,116 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _44249f82_db35_4556_811e_a50425e222da
+#define _44249f82_db35_4556_811e_a50425e222da
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <mongo/bson/bson.h>
+#include <odil/Tag.h>
+
+#include "dopamine/archive/mongo_query.h"
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Translation of a query shape to MongoDB, independent of the values
+ * of the query.
+ */
+struct QueryPlan
+{
+    /// @brief Element of the query.
+    struct Term
+    {
+        /// @brief Path of the values in the metadata documents.
+        std::string path;
+        std::string vr;
+        /// @brief Converter of the value, empty if the element has no value.
+        QueryConverter converter;
+    };
+
+    /// @brief Terms, in the order of the elements of the query.
+    std::vector<Term> terms;
+
+    /// @brief Pairs of date and time attributes which may be combined.
+    std::vector<std::pair<odil::Tag, odil::Tag>> date_time_pairs;
+
+    /// @brief Projection of the query.
+    mongo::BSONObj fields;
+};
+
+/**
+ * @brief Thread-safe cache of query plans, by query shape, discarding the
+ * least recently used plans.
+ *
+ * The shape of a query is its Query/Retrieve Level, the schema, and the tag,
+ * VR and match type of each of its elements. The mutex shared by the
+ * associations only guards a hash look-up and a list splice; the benefit of
+ * the cache is measured by benchmark_mongo_query.
+ */
+class QueryPlanCache
+{
+public:
+    /// @brief Constructor.
+    QueryPlanCache(unsigned int capacity=256);
+
+    /// @brief Return the maximum number of plans, default to 256.
+    unsigned int get_capacity() const;
+
+    /// @brief Set the maximum number of plans, 0 disables the cache.
+    void set_capacity(unsigned int capacity);
+
+    /// @brief Return the number of plans.
+    unsigned int size() const;
+
+    /// @brief Return the plan of a shape, or null if it is not cached.
+    std::shared_ptr<QueryPlan const> find(std::string const & shape);
+
+    /// @brief Add the plan of a shape.
+    void insert(
+        std::string const & shape, std::shared_ptr<QueryPlan const> plan);
+
+    /// @brief Return the number of queries with a cached plan.
+    unsigned long get_hits() const;
+
+    /// @brief Return the number of queries without a cached plan.
+    unsigned long get_misses() const;
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<QueryPlan const>> Entry;
+
+    unsigned int _capacity;
+
+    mutable std::mutex _mutex;
+    /// @brief Plans, most recently used first.
+    std::list<Entry> _plans;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+
+    std::atomic<unsigned long> _hits;
+    std::atomic<unsigned long> _misses;
+
+    /// @brief Discard the least recently used plans, mutex must be locked.
+    void _prune();
+};
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _44249f82_db35_4556_811e_a50425e222da
@@ -8,19 +8,135 @@
 
 #include "dopamine/archive/Storage.h"
 
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <ios>
+#include <istream>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
 #include <sstream>
+#include <streambuf>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include <mongo/client/dbclient.h>
 #include <mongo/client/gridfs.h>
 #include <odil/DataSet.h>
 #include <odil/Reader.h>
 #include <odil/registry.h>
+#include <odil/Tag.h>
 #include <odil/VR.h>
 #include <odil/Writer.h>
 
+#include "dopamine/archive/BatchWriter.h"
+#include "dopamine/archive/CompressionBuffer.h"
+#include "dopamine/archive/ContentBuffer.h"
+#include "dopamine/archive/date_time.h"
+#include "dopamine/archive/GridFSReader.h"
+#include "dopamine/archive/GridFSWriter.h"
+#include "dopamine/archive/HashBuffer.h"
 #include "dopamine/bson_converter.h"
+#include "dopamine/bulk/BulkStorageBase.h"
+#include "dopamine/bulk/View.h"
+#include "dopamine/ConnectionPool.h"
 #include "dopamine/Exception.h"
+#include "dopamine/logging.h"
+
+namespace
+{
+
+/// @brief Summary collection, primary attribute and distinct attributes.
+typedef std::tuple<std::string, odil::Tag, std::vector<odil::Tag>> Summary;
+
+std::vector<Summary> const & get_summaries()
+{
+    static std::vector<Summary> const summaries{
+        std::make_tuple(
+            "patients", odil::registry::PatientID,
+            std::vector<odil::Tag>{
+                odil::registry::StudyInstanceUID,
+                odil::registry::SeriesInstanceUID }),
+        std::make_tuple(
+            "studies", odil::registry::StudyInstanceUID,
+            std::vector<odil::Tag>{
+                odil::registry::SeriesInstanceUID, odil::registry::Modality,
+                odil::registry::SOPClassUID }),
+        std::make_tuple(
+            "series", odil::registry::SeriesInstanceUID,
+            std::vector<odil::Tag>{}),
+    };
+    return summaries;
+}
+
+/// @brief Return the first value of an element, or an empty string.
+std::string get_string(odil::DataSet const & data_set, odil::Tag const & tag)
+{
+    return (
+        (data_set.has(tag) && data_set.is_string(tag) && !data_set.empty(tag))
+        ?data_set.as_string(tag, 0):std::string());
+}
+
+/// @brief Return the first value of an element, or an empty string.
+std::string get_string(mongo::BSONObj const & object, odil::Tag const & tag)
+{
+    auto const value = dopamine::get_first_value(object[std::string(tag)]);
+    return (value.type() == mongo::String)?value.String():std::string();
+}
+
+/**
+ * @brief Copy a BSON object, adding the normalized Alphabetic component to
+ * the person names, at any depth, which lack it; return whether it was added.
+ */
+bool add_normalized_alphabetic(
+    mongo::BSONObj const & object, mongo::BSONObjBuilder & builder)
+{
+    bool added = false;
+    for(auto it = object.begin(); it.more(); /* Nothing */)
+    {
+        auto const element = it.next();
+        if(element.type() == mongo::Object || element.type() == mongo::Array)
+        {
+            mongo::BSONObjBuilder child;
+            if(add_normalized_alphabetic(element.Obj(), child))
+            {
+                added = true;
+            }
+            if(element.type() == mongo::Array)
+            {
+                builder.appendArray(element.fieldName(), child.obj());
+            }
+            else
+            {
+                builder.append(element.fieldName(), child.obj());
+            }
+        }
+        else
+        {
+            builder.append(element);
+        }
+    }
+
+    auto const alphabetic = object["Alphabetic"];
+    if(
+        alphabetic.type() == mongo::String
+        && !object.hasField(dopamine::normalized_alphabetic))
+    {
+        builder.append(
+            dopamine::normalized_alphabetic,
+            dopamine::normalize_person_name(alphabetic.String()));
+        added = true;
+    }
+
+    return added;
+}
+
+}
 
 namespace dopamine
 {
@@ -28,11 +144,41 @@ namespace dopamine
 namespace archive
 {
 
+Storage::Duplicates
+Storage
+::parse_duplicates(std::string const & name)
+{
+    if(name == "none")
+    {
+        return Duplicates::None;
+    }
+    else if(name == "replace")
+    {
+        return Duplicates::Replace;
+    }
+    else if(name == "version")
+    {
+        return Duplicates::Version;
+    }
+    else if(name == "reject")
+    {
+        return Duplicates::Reject;
+    }
+    else
+    {
+        throw Exception("Unknown duplicates policy: "+name);
+    }
+}
+
 Storage
 ::Storage(
-    mongo::DBClientConnection & connection,
+    ConnectionPool & connection_pool,
     std::string const & database, std::string const & bulk_database)
-: _connection(connection), _database(), _bulk_database(), _gridfs_limit(16000000)
+: _connection_pool(connection_pool), _database(), _bulk_database(),
+  _gridfs_limit(16000000), _gridfs_chunk_size(GridFSWriter::default_chunk_size),
+  _gridfs_readers(4), _compression_level(0), _compression_min_size(0),
+  _bulk_storage(nullptr), _duplicates(Duplicates::None),
+  _schema(Schema::Verbose), _batch_writer(nullptr)
 {
     this->set_database(database);
     this->set_bulk_database(bulk_database);
@@ -80,17 +226,207 @@ Storage
     this->_gridfs_limit = limit;
 }
 
+unsigned int
+Storage
+::get_gridfs_chunk_size() const
+{
+    return this->_gridfs_chunk_size;
+}
+
+void
+Storage
+::set_gridfs_chunk_size(unsigned int chunk_size)
+{
+    this->_gridfs_chunk_size = chunk_size;
+}
+
+unsigned int
+Storage
+::get_gridfs_readers() const
+{
+    return this->_gridfs_readers;
+}
+
+void
+Storage
+::set_gridfs_readers(unsigned int readers)
+{
+    this->_gridfs_readers = readers;
+}
+
+int
+Storage
+::get_compression_level() const
+{
+    return this->_compression_level;
+}
+
+unsigned int
+Storage
+::get_compression_min_size() const
+{
+    return this->_compression_min_size;
+}
+
+void
+Storage
+::set_compression(int level, unsigned int min_size)
+{
+    this->_compression_level = level;
+    this->_compression_min_size = min_size;
+}
+
+std::shared_ptr<bulk::BulkStorageBase>
+Storage
+::get_bulk_storage() const
+{
+    return this->_bulk_storage;
+}
+
+void
+Storage
+::set_bulk_storage(std::shared_ptr<bulk::BulkStorageBase> bulk_storage)
+{
+    this->_bulk_storage = bulk_storage;
+}
+
+Storage::Duplicates
+Storage
+::get_duplicates() const
+{
+    return this->_duplicates;
+}
+
+void
+Storage
+::set_duplicates(Duplicates duplicates)
+{
+    this->_duplicates = duplicates;
+}
+
+Schema
+Storage
+::get_schema() const
+{
+    return this->_schema;
+}
+
+void
+Storage
+::set_schema(Schema schema)
+{
+    this->_schema = schema;
+}
+
+bool
+Storage
+::has_documents(Schema schema) const
+{
+    // The SOP Instance UID has a dictionary VR: it is a sub-document in the
+    // verbose schema and a string in the compact one.
+    std::string const field(odil::registry::SOPInstanceUID);
+    auto const query =
+        (schema == Schema::Verbose)
+        ?BSON(field+".vr" << BSON("$exists" << true))
+        :BSON(field << BSON("$type" << mongo::String));
+
+    auto connection = this->_connection_pool.acquire();
+    mongo::BSONObj const fields(BSON("_id" << 1));
+    try
+    {
+        return !connection->findOne(
+            this->_database+".datasets", query, &fields).isEmpty();
+    }
+    catch(mongo::DBException const & e)
+    {
+        throw Exception(
+            std::string("Could not read the datasets collection: ")+e.what());
+    }
+}
+
+bool
+Storage
+::is_batched() const
+{
+    return static_cast<bool>(this->_batch_writer);
+}
+
+void
+Storage
+::set_batch(
+    unsigned int max_count, unsigned int max_size,
+    std::chrono::milliseconds const & max_delay)
+{
+    if(max_count > 1)
+    {
+        this->_batch_writer = std::make_shared<BatchWriter>(
+            this->_connection_pool, this->_database+".datasets",
+            max_count, max_size, max_delay);
+    }
+    else
+    {
+        this->_batch_writer = nullptr;
+    }
+}
+
 void
 Storage
 ::store(odil::DataSet const & data_set)
+{
+    // A concurrent store of the same SOP instance may be written between the
+    // look-up of the previous version and the write: start again, the data
+    // set is then handled as a new version of the concurrent one.
+    for(int attempt=0; attempt<5; ++attempt)
+    {
+        if(this->_store(data_set))
+        {
+            return;
+        }
+    }
+    throw Exception(
+        "Could not store: too many concurrent stores of "
+        +data_set.as_string(odil::registry::SOPInstanceUID, 0));
+}
+
+bool
+Storage
+::_store(odil::DataSet const & data_set)
 {
     auto const & sop_instance_uid = data_set.as_string(
         odil::registry::SOPInstanceUID, 0);
 
-    // Get the original binary content
-    std::ostringstream content_stream;
-    odil::Writer::write_file(data_set, content_stream);
-    auto const content = content_stream.str();
+    auto connection = this->_connection_pool.acquire();
+
+    // Look for a previous version of the data set: an identical resend is
+    // not stored.
+    mongo::BSONObj previous;
+    if(this->_duplicates != Duplicates::None)
+    {
+        // The attributes of the summaries tell whether the new version
+        // belongs to other summaries.
+        std::set<std::string> summary_fields;
+        for(auto const & summary: get_summaries())
+        {
+            summary_fields.insert(std::string(std::get<1>(summary)));
+            for(auto const & tag: std::get<2>(summary))
+            {
+                summary_fields.insert(std::string(tag));
+            }
+        }
+        mongo::BSONObjBuilder fields_builder;
+        fields_builder << "_id" << 1 << "ContentHash" << 1 << "Content" << 1;
+        for(auto const & field: summary_fields)
+        {
+            fields_builder << field << 1;
+        }
+        auto const fields = fields_builder.obj();
+        previous = connection->findOne(
+            this->_database+".datasets",
+            BSON(
+                get_value_path(odil::registry::SOPInstanceUID, this->_schema)
+                << sop_instance_uid),
+            &fields);
+    }
 
     // Store the BSON data set minus private and binary fields
     odil::DataSet stored_data_set;
@@ -113,139 +449,803 @@ Storage
         stored_data_set.add(tag, element);
     }
 
-    auto const bson_data_set = as_bson(stored_data_set);
-    this->_connection.insert(this->_database+".datasets", bson_data_set);
+    // The original binary content is serialized directly in its final
+    // location: the Content field of the metadata document or of the bulk
+    // document, or GridFS chunks for large data sets. The BSON buffers are
+    // allocated from the estimated size so that they do not have to be
+    // re-allocated while the data set is written.
+    auto const estimated_size = estimate_size(data_set);
+    bool const use_bulk_storage = (this->_bulk_storage != nullptr);
+    bool const use_bson_buffer =
+        !use_bulk_storage && (estimated_size <= this->_gridfs_limit);
+    bool const use_bulk_database =
+        !use_bulk_storage && !this->_bulk_database.empty();
+    bool const use_compression = (
+        this->_compression_level > 0
+        && estimated_size >= this->_compression_min_size);
 
-    std::string error_message = this->_connection.getLastError(this->_database);
-    if(!error_message.empty())
+    // The BSON metadata repeat the tag and VR of each element, about twice
+    // the size of their DICOM encoding.
+    mongo::BSONObjBuilder builder(
+        2*estimate_size(stored_data_set)
+        +((use_bson_buffer && !use_bulk_database)?estimated_size:0)+64);
+    // The _id is required to find which documents of a failed batch were
+    // inserted. A new version replaces the previous one in place.
+    if(previous.isEmpty())
+    {
+        builder.genOID();
+    }
+    else
+    {
+        builder.append(previous["_id"]);
+    }
+    as_bson(stored_data_set, builder, {}, this->_schema);
     {
-        throw Exception("Could not store: "+error_message);
+        // Typed values of the dates and times, for the range matching.
+        mongo::BSONObjBuilder normalized_builder(
+            builder.subobjStart(normalized_field));
+        append_normalized_values(stored_data_set, normalized_builder);
+        normalized_builder.done();
     }
 
-    // Store the bulk data
+    mongo::BSONObjBuilder bulk_builder(
+        (use_bson_buffer && use_bulk_database)?estimated_size+128:64);
+    bulk_builder.genOID();
+    bulk_builder << "SOPInstanceUID" << sop_instance_uid;
+
     auto const database =
-        this->_bulk_database.empty()?this->_database:this->_bulk_database;
-    if(content_stream.tellp() > this->_gridfs_limit)
-    {
-        mongo::GridFS gridfs(this->_connection, database);
-        auto const gridfs_object = gridfs.storeFile(
-            content.c_str(), content.size(),
-            data_set.as_string(odil::registry::SOPInstanceUID, 0));
+        use_bulk_database?this->_bulk_database:this->_database;
+    // Typed reference to the content, when not stored in the metadata
+    // document.
+    auto const make_reference = [&](
+            std::string const & kind,
+            mongo::OID const & id) -> mongo::BSONObj {
+        mongo::BSONObjBuilder reference;
+        reference
+            << "store" << (use_bulk_database?"bulk":"main")
+            << "kind" << kind << "id" << id;
+        if(use_compression)
+        {
+            reference << "codec" << CompressionBuffer::codec;
+        }
+        return reference.obj();
+    };
 
-        error_message = this->_connection.getLastError(database);
-        if(error_message.empty())
+    // Serialize the data set to its final location, compressing it if
+    // required. The uncompressed content is hashed on the way.
+    std::string content_hash;
+    auto const write_content = [&](std::streambuf & sink) {
+        if(use_compression)
         {
-            // Add the reference to GridFS
-            this->_connection.update(
-                this->_database+".datasets",
-                BSON(
-                    std::string(odil::registry::SOPInstanceUID)+".Value"
-                    << sop_instance_uid),
-                BSON(
-                    "$set" << BSON(
-                        "Content"
-                        << gridfs_object.getField("_id").OID().toString())));
+            CompressionBuffer compression_buffer(
+                sink, this->_compression_level);
+            HashBuffer hash_buffer(&compression_buffer);
+            std::ostream stream(&hash_buffer);
+            stream.exceptions(std::ios::badbit);
+            odil::Writer::write_file(data_set, stream);
+            compression_buffer.close();
+            content_hash = hash_buffer.digest();
+        }
+        else
+        {
+            HashBuffer hash_buffer(&sink);
+            std::ostream stream(&hash_buffer);
+            stream.exceptions(std::ios::badbit);
+            odil::Writer::write_file(data_set, stream);
+            content_hash = hash_buffer.digest();
+        }
+    };
+
+    // The content of the previous version is compared once the data set is
+    // serialized and hashed, so that it is serialized only once. Return true
+    // if the data set is an identical resend.
+    auto const is_stored = [&]() {
+        if(previous.isEmpty())
+        {
+            return false;
+        }
+        else if(previous.getStringField("ContentHash") == content_hash)
+        {
+            DOPAMINE_LOG(DEBUG)
+                << "Data set already stored: " << sop_instance_uid;
+            return true;
+        }
+        else if(this->_duplicates == Duplicates::Reject)
+        {
+            throw Exception(
+                "A different data set is already stored: "+sop_instance_uid);
+        }
+        return false;
+    };
+
+    char const * content = nullptr;
+    std::size_t content_size = 0;
+    // Offset of the Content element in its BSON buffer
+    int content_offset = 0;
+    auto & content_builder = use_bulk_database?bulk_builder:builder;
+    mongo::OID bulk_id;
+    std::string bulk_storage_id;
+    if(use_bulk_storage)
+    {
+        // The content is written outside of MongoDB, before the metadata.
+        bulk_storage_id = this->_bulk_storage->store(write_content);
+        mongo::BSONObjBuilder reference;
+        reference
+            << "store" << this->_bulk_storage->get_name()
+            << "kind" << "object" << "id" << bulk_storage_id;
+        if(use_compression)
+        {
+            reference << "codec" << CompressionBuffer::codec;
         }
+        builder << "Content" << reference.obj();
     }
-    else if(this->_bulk_database.empty())
+    else if(!use_bson_buffer)
     {
-        mongo::BSONObjBuilder builder;
-        builder.appendBinData(
-            "Content", content.size(), mongo::BinDataGeneral, content.c_str());
-        this->_connection.update(
-            this->_database+".datasets",
-            BSON(
-                std::string(odil::registry::SOPInstanceUID)+".Value"
-                << sop_instance_uid),
-            BSON("$set" << builder.obj()));
+        // Large data set: write the GridFS chunks as the data set is
+        // serialized.
+        // NOTE: the GridFS object creates the index on the chunks.
+        mongo::GridFS const gridfs(*connection, database);
+        GridFSWriter writer(
+            *connection, database, sop_instance_uid, this->_gridfs_chunk_size);
+        try
+        {
+            write_content(writer);
+            if(is_stored())
+            {
+                // The writer removes the chunks.
+                return true;
+            }
+            writer.close();
+        }
+        catch(mongo::DBException const & e)
+        {
+            throw Exception(std::string("Could not store: ")+e.what());
+        }
+        content_size = writer.size();
+        bulk_id = writer.get_id();
+        builder << "Content" << make_reference("gridfs", bulk_id);
     }
     else
     {
-        mongo::BSONObjBuilder builder;
-        builder.genOID();
-        builder << "SOPInstanceUID" << sop_instance_uid;
-        builder.appendBinData(
-            "Content", content.size(), mongo::BinDataGeneral, content.c_str());
-        auto const bulk_object = builder.obj();
-        this->_connection.insert(
-            this->_bulk_database+".datasets", bulk_object);
-        this->_connection.update(
-            this->_database+".datasets",
-            BSON(
-                std::string(odil::registry::SOPInstanceUID)+".Value"
-                << sop_instance_uid),
-            BSON(
-                "$set" << BSON(
-                    "Content" << bulk_object["_id"].OID().toString())
-            )
-        );
+        auto & buffer = content_builder.bb();
+        content_offset = buffer.len();
+
+        // Compressed content in the metadata document is stored with its
+        // codec: {store, kind, codec, data}.
+        std::unique_ptr<mongo::BSONObjBuilder> reference_builder;
+        if(use_compression && !use_bulk_database)
+        {
+            reference_builder.reset(
+                new mongo::BSONObjBuilder(builder.subobjStart("Content")));
+            *reference_builder
+                << "store" << "main" << "kind" << "inline"
+                << "codec" << CompressionBuffer::codec;
+        }
+
+        // BinData element header: type, name, length (unknown yet), subtype
+        buffer.appendNum(static_cast<char>(mongo::BinData));
+        buffer.appendStr(reference_builder?"data":"Content");
+        int const length_offset = buffer.len();
+        buffer.appendNum(static_cast<int>(0));
+        buffer.appendNum(static_cast<char>(mongo::BinDataGeneral));
+        int const data_offset = buffer.len();
+
+        ContentBuffer content_buffer(buffer);
+        write_content(content_buffer);
+
+        content_size = content_buffer.size();
+        // BSON lengths are little-endian, as is the host.
+        int const length = content_size;
+        std::memcpy(buffer.buf()+length_offset, &length, sizeof(length));
+        if(reference_builder)
+        {
+            reference_builder->done();
+        }
+        content = buffer.buf()+data_offset;
     }
 
-    error_message = this->_connection.getLastError(database);
-    if(!error_message.empty())
+    // An identical object of the bulk storage is the object of the previous
+    // version, and the serialized BSON content is dropped with its builder.
+    if((use_bulk_storage || use_bson_buffer) && is_stored())
     {
-        this->_connection.remove(
-            this->_database+".datasets",
-            BSON(
-                std::string(odil::registry::SOPInstanceUID)+".Value"
-                << sop_instance_uid));
-        throw Exception("Could not store: "+error_message);
+        return true;
     }
-}
 
-odil::DataSet
-Storage
-::retrieve(std::string const & sop_instance_uid) const
-{
-    mongo::BSONObj const fields(BSON("Content" << 1));
-    auto const object = this->_connection.findOne(
-        this->_database+".datasets",
-        BSON(
-            std::string(odil::registry::SOPInstanceUID)+".Value"
-            << sop_instance_uid),
-        &fields);
-    if(object.isEmpty())
+    // Store the bulk data first, so that the metadata document can be written
+    // with its content or with a reference to its content in a single insert.
+    bool const use_gridfs =
+        !use_bulk_storage
+        && (!use_bson_buffer || content_size > this->_gridfs_limit);
+    if(use_bson_buffer && use_gridfs)
     {
-        throw Exception("No such data set: "+sop_instance_uid);
+        mongo::GridFS gridfs(*connection, database);
+        gridfs.setChunkSize(this->_gridfs_chunk_size);
+        mongo::BSONObj gridfs_object;
+        try
+        {
+            gridfs_object = gridfs.storeFile(
+                content, content_size, sop_instance_uid);
+        }
+        catch(mongo::DBException const & e)
+        {
+            throw Exception(std::string("Could not store: ")+e.what());
+        }
+        // The estimate was too low: drop the serialized Content element.
+        content_builder.bb().setlen(content_offset);
+        bulk_id = gridfs_object.getField("_id").OID();
+        builder << "Content" << make_reference("gridfs", bulk_id);
     }
 
-    auto const content = object.getField("Content");
-    std::stringstream stream;
+    if(!use_gridfs && use_bulk_database)
+    {
+        auto const bulk_object = bulk_builder.obj();
+        try
+        {
+            connection->insert(
+                this->_bulk_database+".datasets", bulk_object, 0,
+                &mongo::WriteConcern::acknowledged);
+        }
+        catch(mongo::DBException const & e)
+        {
+            throw Exception(std::string("Could not store: ")+e.what());
+        }
+        bulk_id = bulk_object["_id"].OID();
+        builder << "Content" << make_reference("inline", bulk_id);
+    }
+
+    builder << "ContentHash" << content_hash;
 
-    if(content.type() == mongo::BSONType::String)
+    auto const sop_instance_query = BSON(
+        get_value_path(odil::registry::SOPInstanceUID, this->_schema)
+        << sop_instance_uid);
+
+    std::string error;
+    // Set if a concurrent store of the same SOP instance was written first.
+    bool conflict = false;
+    // Full document of the previous version, as replaced.
+    mongo::BSONObj superseded;
+    try
     {
-        // WARNING: GridFile has a private pointer to the GridFS instance
-        bool found = false;
-        if(!found)
+        if(!previous.isEmpty())
         {
-            // Look in main GridFS
-            mongo::GridFS const gridfs(this->_connection, this->_database);
-            auto file = gridfs.findFileByName(sop_instance_uid);
-            if(file.exists())
+            // Replace the previous version in place, so that the SOP
+            // Instance UID can be unique, unless it was replaced by a
+            // concurrent store.
+            mongo::BSONObjBuilder query;
+            query.append(previous["_id"]);
+            if(previous.hasField("ContentHash"))
             {
-                file.write(stream);
-                found = true;
+                query.append(previous["ContentHash"]);
+            }
+            else
+            {
+                query << "ContentHash" << BSON("$exists" << false);
+            }
+            mongo::BSONObj result;
+            if(!connection->runCommand(
+                this->_database,
+                BSON(
+                    "findAndModify" << "datasets" << "query" << query.obj()
+                    << "update" << builder.obj()),
+                result))
+            {
+                error = result.getStringField("errmsg");
+            }
+            else if(result["value"].type() == mongo::Object)
+            {
+                superseded = result["value"].Obj().getOwned();
+            }
+            else
+            {
+                conflict = true;
             }
         }
-        if(!found)
+        else if(this->_batch_writer)
         {
-            // Look in bulk GridFS
-            mongo::GridFS const gridfs(this->_connection, this->_bulk_database);
-            auto file = gridfs.findFileByName(sop_instance_uid);
-            if(file.exists())
+            // Return the connection to the pool while waiting for the batch:
+            // the batch is written with another connection.
             {
-                file.write(stream);
-                found = true;
+                auto const released = std::move(connection);
             }
+            this->_batch_writer->insert(builder.obj());
         }
-        if(!found)
+        else
         {
-            // Look in bulk data Content
-            auto const bulk_data = this->_connection.findOne(
-                this->_bulk_database+".datasets",
-                BSON("SOPInstanceUID" << sop_instance_uid));
-            if(bulk_data.isEmpty())
-            {
+            connection->insert(
+                this->_database+".datasets", builder.obj(), 0,
+                &mongo::WriteConcern::acknowledged);
+        }
+    }
+    catch(mongo::DBException const & e)
+    {
+        error = e.what();
+    }
+    catch(Exception const & e)
+    {
+        error = e.what();
+    }
+
+    if(this->_batch_writer && previous.isEmpty())
+    {
+        connection = this->_connection_pool.acquire();
+    }
+
+    if(
+        !error.empty() && previous.isEmpty()
+        && this->_duplicates != Duplicates::None)
+    {
+        // The SOP Instance UID is unique: the insert fails if a concurrent
+        // store inserted the same SOP instance.
+        mongo::BSONObj const fields(BSON("_id" << 1));
+        try
+        {
+            conflict = !connection->findOne(
+                this->_database+".datasets", sop_instance_query,
+                &fields).isEmpty();
+        }
+        catch(mongo::DBException const &)
+        {
+            // Report the original error.
+        }
+    }
+
+    if(!error.empty() || conflict)
+    {
+        // Do not leave orphan bulk data.
+        if(use_gridfs)
+        {
+            connection->remove(database+".fs.files", BSON("_id" << bulk_id));
+            connection->remove(
+                database+".fs.chunks", BSON("files_id" << bulk_id));
+        }
+        else if(use_bulk_database)
+        {
+            connection->remove(
+                this->_bulk_database+".datasets", BSON("_id" << bulk_id));
+        }
+        // An object of the bulk storage may be shared with another data set
+        // being stored: leave it to sweep_bulk_storage.
+        if(conflict)
+        {
+            DOPAMINE_LOG(DEBUG)
+                << "Concurrent store of " << sop_instance_uid << ", retrying";
+            return false;
+        }
+        throw Exception("Could not store: "+error);
+    }
+
+    // A new version does not add an instance, unless it was moved to other
+    // summaries.
+    bool moved = false;
+    if(!previous.isEmpty())
+    {
+        this->_supersede(*connection, superseded);
+
+        for(auto const & summary: get_summaries())
+        {
+            std::vector<odil::Tag> tags{ std::get<1>(summary) };
+            tags.insert(
+                tags.end(), std::get<2>(summary).begin(),
+                std::get<2>(summary).end());
+            for(auto const & tag: tags)
+            {
+                moved = moved || (
+                    get_string(previous, tag) != get_string(data_set, tag));
+            }
+        }
+        if(moved)
+        {
+            this->_invalidate_summaries(*connection, previous);
+        }
+    }
+
+    // Each metadata document is an instance, including a resend stored
+    // without duplicates check. The distinct values of the summaries cannot
+    // be updated incrementally after a move.
+    this->_update_summaries(
+        *connection, data_set, previous.isEmpty()?1:0, moved);
+
+    return true;
+}
+
+void
+Storage
+::rebuild_summaries(
+    odil::Tag const & primary, std::set<std::string> const & values)
+{
+    Summary const * summary = nullptr;
+    for(auto const & item: get_summaries())
+    {
+        if(std::get<1>(item) == primary)
+        {
+            summary = &item;
+        }
+    }
+    if(summary == nullptr || values.empty())
+    {
+        return;
+    }
+
+    auto const & attributes = std::get<2>(*summary);
+    auto const collection = this->_database+"."+std::get<0>(*summary);
+
+    auto const make_array = [](std::set<std::string> const & items) {
+        mongo::BSONArrayBuilder builder;
+        for(auto const & item: items)
+        {
+            builder << item;
+        }
+        return builder.arr();
+    };
+
+    auto connection = this->_connection_pool.acquire();
+
+    // Revisions of the existing summaries, read before the aggregation: a
+    // summary updated in the meantime is not overwritten.
+    auto missing = values;
+    std::map<std::string, long long> revisions;
+    mongo::BSONObj const revision_fields(BSON("revision" << 1 << "stale" << 1));
+    auto cursor = connection->query(
+        collection, BSON("_id" << BSON("$in" << make_array(values))), 0, 0,
+        &revision_fields);
+    while(cursor->more())
+    {
+        auto const object = cursor->next();
+        if(object["_id"].type() != mongo::String)
+        {
+            continue;
+        }
+        auto const value = object["_id"].String();
+        if(object["stale"].trueValue())
+        {
+            revisions[value] = object["revision"].numberLong();
+        }
+        else
+        {
+            missing.erase(value);
+        }
+    }
+    if(missing.empty())
+    {
+        return;
+    }
+
+    mongo::BSONObjBuilder group_builder;
+    group_builder
+        << "_id" << "$"+get_value_path(primary, this->_schema)
+        << "instances" << BSON("$sum" << 1);
+    for(auto const & tag: attributes)
+    {
+        group_builder
+            << std::string(tag)
+            << BSON("$addToSet" << "$"+get_value_path(tag, this->_schema));
+    }
+    auto const pipeline = BSON_ARRAY(
+        BSON("$match" << BSON(
+            get_value_path(primary, this->_schema)
+            << BSON("$in" << make_array(missing))))
+        << BSON("$group" << group_builder.obj()));
+
+    mongo::BSONObj info;
+    if(!connection->runCommand(
+        this->_database,
+        BSON("aggregate" << "datasets" << "pipeline" << pipeline), info))
+    {
+        DOPAMINE_LOG(ERROR)
+            << "Could not rebuild " << std::get<0>(*summary) << " summaries: "
+            << info["errmsg"].String();
+        return;
+    }
+
+    for(auto const & result: info["result"].Array())
+    {
+        auto const id = get_first_value(result["_id"]);
+        if(id.type() != mongo::String)
+        {
+            continue;
+        }
+        auto const value = id.String();
+
+        // Each element of the sets holds the values of a data set.
+        auto const get_distinct = [&](std::string const & field) {
+            std::set<std::string> distinct;
+            for(auto const & element: result[field].Array())
+            {
+                auto const item = get_first_value(element);
+                if(item.type() == mongo::String)
+                {
+                    distinct.insert(item.String());
+                }
+            }
+            return distinct;
+        };
+
+        mongo::BSONObjBuilder set_builder;
+        set_builder
+            << "instances"
+            << static_cast<long long>(result["instances"].numberLong());
+        for(auto const & tag: attributes)
+        {
+            mongo::BSONArrayBuilder distinct_builder;
+            for(auto const & item: get_distinct(std::string(tag)))
+            {
+                distinct_builder << item;
+            }
+            set_builder << std::string(tag) << distinct_builder.arr();
+        }
+
+        auto const revision = revisions.find(value);
+        mongo::BSONObj const query = (revision != revisions.end())
+            ?BSON("_id" << value << "revision" << revision->second)
+            :BSON("_id" << value << "revision" << BSON("$exists" << false));
+        try
+        {
+            // If a store created the summary in the meantime, the upsert
+            // fails on its _id.
+            connection->update(
+                collection, query,
+                BSON(
+                    "$set" << set_builder.obj()
+                    << "$unset" << BSON("stale" << "")),
+                revision == revisions.end(), false,
+                &mongo::WriteConcern::acknowledged);
+        }
+        catch(mongo::DBException const & e)
+        {
+            DOPAMINE_LOG(DEBUG)
+                << "Summary of " << value << " not rebuilt: " << e.what();
+        }
+    }
+}
+
+unsigned int
+Storage
+::rebuild_summaries()
+{
+    // Values rebuilt per aggregation
+    std::size_t const chunk_size = 1000;
+
+    unsigned int count = 0;
+    for(auto const & summary: get_summaries())
+    {
+        auto const & primary = std::get<1>(summary);
+
+        std::set<std::string> values;
+        {
+            auto connection = this->_connection_pool.acquire();
+            mongo::BSONObj const fields(
+                BSON(std::string(primary) << 1 << "_id" << 0));
+            auto cursor = connection->query(
+                this->_database+".datasets", mongo::BSONObj(), 0, 0, &fields,
+                mongo::QueryOption_NoCursorTimeout);
+            while(cursor->more())
+            {
+                auto const value = get_string(cursor->next(), primary);
+                if(!value.empty())
+                {
+                    values.insert(value);
+                }
+            }
+        }
+
+        std::set<std::string> chunk;
+        for(auto const & value: values)
+        {
+            chunk.insert(value);
+            if(chunk.size() == chunk_size)
+            {
+                this->rebuild_summaries(primary, chunk);
+                chunk.clear();
+            }
+        }
+        this->rebuild_summaries(primary, chunk);
+
+        count += values.size();
+    }
+
+    return count;
+}
+
+odil::DataSet
+Storage
+::retrieve(std::string const & sop_instance_uid) const
+{
+    auto const view = this->retrieve_view(sop_instance_uid);
+    std::string transfer_syntax;
+    auto const offset = this->_skip_meta_information(
+        *view, sop_instance_uid, transfer_syntax);
+
+    // Parse directly from the stored content, without copying it to a stream.
+    bulk::ViewBuffer buffer(view->data()+offset, view->size()-offset);
+    std::istream stream(&buffer);
+    odil::Reader reader(stream, transfer_syntax);
+    return reader.read_data_set();
+}
+
+std::shared_ptr<bulk::View>
+Storage
+::retrieve_view(std::string const & sop_instance_uid) const
+{
+    return this->_read_content(sop_instance_uid);
+}
+
+std::size_t
+Storage
+::_skip_meta_information(
+    bulk::View const & view, std::string const & sop_instance_uid,
+    std::string & transfer_syntax) const
+{
+    auto const * data = view.data();
+
+    // Preamble, "DICM" prefix and File Meta Information Group Length, which is
+    // encoded in Explicit VR Little Endian: tag, VR, 16-bits length, value.
+    std::size_t const prefix_end = 128+4;
+    std::size_t const meta_begin = prefix_end+12;
+    if(
+        view.size() < meta_begin
+        || std::memcmp(data+128, "DICM", 4) != 0
+        || std::memcmp(data+prefix_end, "\x02\x00\x00\x00UL", 6) != 0)
+    {
+        throw Exception("Invalid Part 10 content: "+sop_instance_uid);
+    }
+
+    uint32_t meta_length = 0;
+    for(int i=3; i>=0; --i)
+    {
+        meta_length = (meta_length << 8)
+            + static_cast<unsigned char>(data[prefix_end+8+i]);
+    }
+    if(view.size() < meta_begin+meta_length)
+    {
+        throw Exception("Invalid Part 10 content: "+sop_instance_uid);
+    }
+
+    bulk::ViewBuffer meta_buffer(data+meta_begin, meta_length);
+    std::istream meta_stream(&meta_buffer);
+    odil::Reader meta_reader(meta_stream, odil::registry::ExplicitVRLittleEndian);
+    auto const meta_information = meta_reader.read_data_set();
+    if(
+        !meta_information.has(odil::registry::TransferSyntaxUID)
+        || meta_information.empty(odil::registry::TransferSyntaxUID))
+    {
+        throw Exception("No transfer syntax: "+sop_instance_uid);
+    }
+    transfer_syntax = meta_information.as_string(
+        odil::registry::TransferSyntaxUID, 0);
+
+    return meta_begin+meta_length;
+}
+
+std::shared_ptr<bulk::View>
+Storage
+::_read_content(std::string const & sop_instance_uid) const
+{
+    auto connection = this->_connection_pool.acquire();
+
+    mongo::BSONObj const fields(BSON("Content" << 1));
+    auto const object = connection->findOne(
+        this->_database+".datasets",
+        BSON(
+            get_value_path(odil::registry::SOPInstanceUID, this->_schema)
+            << sop_instance_uid),
+        &fields);
+    if(object.isEmpty())
+    {
+        throw Exception("No such data set: "+sop_instance_uid);
+    }
+
+    auto const content = object.getField("Content");
+    std::ostringstream stream;
+
+    if(content.type() == mongo::BSONType::Object)
+    {
+        auto const reference = content.Obj();
+        auto const store = reference.getStringField("store");
+        auto const kind = reference.getStringField("kind");
+        std::string const codec = reference.getStringField("codec");
+        auto const id = reference.getField("id");
+
+        std::string database;
+        if(store == std::string("main"))
+        {
+            database = this->_database;
+        }
+        else if(store == std::string("bulk"))
+        {
+            database = this->_bulk_database;
+        }
+
+        if(
+            this->_bulk_storage
+            && store == this->_bulk_storage->get_name()
+            && kind == std::string("object"))
+        {
+            std::string const id = reference.getStringField("id");
+            if(codec.empty())
+            {
+                // Memory-mapped if supported by the bulk storage.
+                return this->_bulk_storage->view(id);
+            }
+            return std::make_shared<bulk::StringView>(
+                decompress(codec, this->_bulk_storage->retrieve(id)));
+        }
+
+        if(kind == std::string("inline") && reference.hasField("data"))
+        {
+            // Compressed content stored in the metadata document
+            int size=0;
+            char const * begin = reference.getField("data").binData(size);
+            return std::make_shared<bulk::StringView>(
+                decompress(codec, std::string(begin, size)));
+        }
+
+        if(database.empty() || id.type() != mongo::jstOID)
+        {
+            throw Exception("Invalid Content reference: "+reference.toString());
+        }
+
+        if(kind == std::string("gridfs"))
+        {
+            GridFSReader const reader(
+                this->_connection_pool, database, this->_gridfs_readers);
+            return std::make_shared<bulk::StringView>(
+                decompress(codec, reader.read(*connection, id.OID())));
+        }
+        else if(kind == std::string("inline"))
+        {
+            auto const bulk_data = connection->findOne(
+                database+".datasets", BSON("_id" << id.OID()));
+            if(bulk_data.isEmpty())
+            {
+                throw Exception(
+                    "No such data set in bulk data: "+sop_instance_uid);
+            }
+            int size=0;
+            char const * begin = bulk_data.getField("Content").binDataClean(
+                size);
+            return std::make_shared<bulk::StringView>(
+                decompress(codec, std::string(begin, size)));
+        }
+        else
+        {
+            throw Exception("Invalid Content reference: "+reference.toString());
+        }
+    }
+    else if(content.type() == mongo::BSONType::String)
+    {
+        // Untyped reference written by older versions, see migrate_content.
+        // WARNING: GridFile has a private pointer to the GridFS instance
+        bool found = false;
+        if(!found)
+        {
+            // Look in main GridFS
+            mongo::GridFS const gridfs(*connection, this->_database);
+            auto file = gridfs.findFileByName(sop_instance_uid);
+            if(file.exists())
+            {
+                file.write(stream);
+                found = true;
+            }
+        }
+        if(!found)
+        {
+            // Look in bulk GridFS
+            mongo::GridFS const gridfs(*connection, this->_bulk_database);
+            auto file = gridfs.findFileByName(sop_instance_uid);
+            if(file.exists())
+            {
+                file.write(stream);
+                found = true;
+            }
+        }
+        if(!found)
+        {
+            // Look in bulk data Content
+            auto const bulk_data = connection->findOne(
+                this->_bulk_database+".datasets",
+                BSON("SOPInstanceUID" << sop_instance_uid));
+            if(bulk_data.isEmpty())
+            {
                 throw Exception(
                     "No such data set in bulk data: "+sop_instance_uid);
             }
@@ -266,7 +1266,468 @@ Storage
         throw Exception("Unknown Content type: "+std::to_string(content.type()));
     }
 
-    return odil::Reader::read_file(stream).second;
+    return std::make_shared<bulk::StringView>(stream.str());
+}
+
+unsigned int
+Storage
+::migrate_content()
+{
+    auto connection = this->_connection_pool.acquire();
+    // The documents are updated while the cursor is open.
+    auto update_connection = this->_connection_pool.acquire();
+
+    mongo::BSONObj const fields(
+        BSON(std::string(odil::registry::SOPInstanceUID) << 1));
+    auto cursor = connection->query(
+        this->_database+".datasets",
+        BSON("Content" << BSON("$type" << mongo::String)), 0, 0, &fields,
+        mongo::QueryOption_NoCursorTimeout);
+
+    unsigned int count = 0;
+    while(cursor->more())
+    {
+        auto const object = cursor->next();
+        auto const sop_instance_uid = get_first_value(
+            object[std::string(odil::registry::SOPInstanceUID)]).String();
+
+        // Same look-up order as the untyped references in retrieve.
+        mongo::BSONObj reference;
+        std::vector<std::pair<std::string, std::string>> const stores{
+            { "main", this->_database }, { "bulk", this->_bulk_database } };
+        for(auto const & store: stores)
+        {
+            if(store.second.empty())
+            {
+                continue;
+            }
+            mongo::BSONObj const file_fields(BSON("_id" << 1));
+            auto const file = update_connection->findOne(
+                store.second+".fs.files", BSON("filename" << sop_instance_uid),
+                &file_fields);
+            if(!file.isEmpty())
+            {
+                reference = BSON(
+                    "store" << store.first << "kind" << "gridfs"
+                    << "id" << file["_id"].OID());
+                break;
+            }
+        }
+        if(reference.isEmpty() && !this->_bulk_database.empty())
+        {
+            mongo::BSONObj const bulk_fields(BSON("_id" << 1));
+            auto const bulk_data = update_connection->findOne(
+                this->_bulk_database+".datasets",
+                BSON("SOPInstanceUID" << sop_instance_uid), &bulk_fields);
+            if(!bulk_data.isEmpty())
+            {
+                reference = BSON(
+                    "store" << "bulk" << "kind" << "inline"
+                    << "id" << bulk_data["_id"].OID());
+            }
+        }
+
+        if(reference.isEmpty())
+        {
+            DOPAMINE_LOG(ERROR) << "No content found for " << sop_instance_uid;
+            continue;
+        }
+
+        try
+        {
+            update_connection->update(
+                this->_database+".datasets", BSON("_id" << object["_id"]),
+                BSON("$set" << BSON("Content" << reference)), false, false,
+                &mongo::WriteConcern::acknowledged);
+        }
+        catch(mongo::DBException const & e)
+        {
+            throw Exception(
+                "Could not migrate "+sop_instance_uid+": "+e.what());
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+unsigned int
+Storage
+::migrate_metadata()
+{
+    auto connection = this->_connection_pool.acquire();
+    // The documents are updated while the cursor is open.
+    auto update_connection = this->_connection_pool.acquire();
+
+    mongo::BSONObj const fields(BSON("Content" << 0));
+    auto cursor = connection->query(
+        this->_database+".datasets", mongo::BSONObj(), 0, 0, &fields,
+        mongo::QueryOption_NoCursorTimeout);
+
+    unsigned int count = 0;
+    while(cursor->more())
+    {
+        auto const object = cursor->next();
+
+        // Only update the elements which changed.
+        mongo::BSONObjBuilder set;
+        // DICOM elements of the document, keyed by tag.
+        mongo::BSONObjBuilder elements;
+        for(auto it = object.begin(); it.more(); /* Nothing */)
+        {
+            auto const element = it.next();
+            std::string const name = element.fieldName();
+            if(
+                name.size() == 8
+                && name.find_first_not_of("0123456789ABCDEFabcdef")
+                    == std::string::npos)
+            {
+                elements.append(element);
+            }
+
+            if(
+                name == "_id" || name == normalized_field
+                || (
+                    element.type() != mongo::Object
+                    && element.type() != mongo::Array))
+            {
+                continue;
+            }
+
+            mongo::BSONObjBuilder builder;
+            if(add_normalized_alphabetic(element.Obj(), builder))
+            {
+                if(element.type() == mongo::Array)
+                {
+                    set.appendArray(name, builder.obj());
+                }
+                else
+                {
+                    set.append(name, builder.obj());
+                }
+            }
+        }
+
+        if(!object.hasField(normalized_field))
+        {
+            // Typed values of the dates and times, for the range matching.
+            try
+            {
+                mongo::BSONObjBuilder normalized;
+                append_normalized_values(
+                    as_dataset(elements.obj()), normalized);
+                set.append(normalized_field, normalized.obj());
+            }
+            catch(std::exception const & e)
+            {
+                DOPAMINE_LOG(ERROR)
+                    << "Could not normalize the values of "
+                    << object["_id"].toString(false) << ": " << e.what();
+            }
+        }
+
+        auto const update = set.obj();
+        if(update.isEmpty())
+        {
+            continue;
+        }
+
+        try
+        {
+            update_connection->update(
+                this->_database+".datasets", BSON("_id" << object["_id"]),
+                BSON("$set" << update), false, false,
+                &mongo::WriteConcern::acknowledged);
+        }
+        catch(mongo::DBException const & e)
+        {
+            throw Exception(
+                "Could not migrate "+object["_id"].toString(false)+": "
+                +e.what());
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+unsigned int
+Storage
+::sweep_bulk_storage(std::chrono::seconds grace_period)
+{
+    if(!this->_bulk_storage)
+    {
+        return 0;
+    }
+
+    // Objects stored after this point are kept even if the references read
+    // below miss them: their data set may not be inserted yet.
+    auto const before = std::chrono::system_clock::to_time_t(
+        std::chrono::system_clock::now()-grace_period);
+
+    std::set<std::string> referenced;
+    auto connection = this->_connection_pool.acquire();
+    mongo::BSONObj const fields(BSON("Content.id" << 1));
+    for(auto const & collection: {"datasets", "versions"})
+    {
+        try
+        {
+            auto cursor = connection->query(
+                this->_database+"."+collection,
+                BSON(
+                    "Content.store" << this->_bulk_storage->get_name()
+                    << "Content.kind" << "object"),
+                0, 0, &fields, mongo::QueryOption_NoCursorTimeout);
+            while(cursor->more())
+            {
+                referenced.insert(
+                    cursor->next()["Content"].Obj().getStringField("id"));
+            }
+        }
+        catch(mongo::DBException const & e)
+        {
+            throw Exception(
+                std::string("Could not read the references of ")
+                +collection+": "+e.what());
+        }
+    }
+
+    unsigned int count = 0;
+    for(auto const & id: this->_bulk_storage->list(before))
+    {
+        if(referenced.find(id) == referenced.end())
+        {
+            this->_bulk_storage->remove(id);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+void
+Storage
+::_supersede(
+    mongo::DBClientConnection & connection,
+    mongo::BSONObj const & superseded) const
+{
+    auto const id = superseded["_id"];
+    try
+    {
+        if(this->_duplicates == Duplicates::Version)
+        {
+            // The _id is kept by the new version.
+            mongo::BSONObjBuilder builder;
+            builder.genOID();
+            builder.appendElements(superseded.removeField("_id"));
+            builder.appendDate(
+                "Superseded",
+                mongo::Date_t(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()
+                    ).count()));
+            connection.insert(
+                this->_database+".versions", builder.obj(), 0,
+                &mongo::WriteConcern::acknowledged);
+        }
+        else if(this->_duplicates == Duplicates::Replace)
+        {
+            this->_remove_content(connection, superseded["Content"]);
+        }
+    }
+    catch(mongo::DBException const & e)
+    {
+        // The new version is stored: do not report a failure to the peer.
+        DOPAMINE_LOG(ERROR)
+            << "Could not supersede " << id.toString(false) << ": "
+            << e.what();
+    }
+}
+
+void
+Storage
+::_remove_content(
+    mongo::DBClientConnection & connection,
+    mongo::BSONElement const & content) const
+{
+    if(content.type() == mongo::BinData)
+    {
+        // Stored in the metadata document.
+        return;
+    }
+    else if(content.type() != mongo::Object)
+    {
+        DOPAMINE_LOG(WARN)
+            << "Cannot remove untyped content: " << content.toString(false);
+        return;
+    }
+
+    auto const reference = content.Obj();
+    auto const store = reference.getStringField("store");
+    auto const kind = reference.getStringField("kind");
+
+    if(
+        this->_bulk_storage
+        && store == this->_bulk_storage->get_name()
+        && kind == std::string("object"))
+    {
+        // Shared with the identical contents: leave it to sweep_bulk_storage.
+        return;
+    }
+
+    std::string database;
+    if(store == std::string("main"))
+    {
+        database = this->_database;
+    }
+    else if(store == std::string("bulk"))
+    {
+        database = this->_bulk_database;
+    }
+    auto const id = reference.getField("id");
+    if(database.empty() || id.type() != mongo::jstOID)
+    {
+        // Stored in the metadata document.
+        return;
+    }
+
+    if(kind == std::string("gridfs"))
+    {
+        connection.remove(database+".fs.files", BSON("_id" << id.OID()));
+        connection.remove(
+            database+".fs.chunks", BSON("files_id" << id.OID()));
+    }
+    else if(kind == std::string("inline"))
+    {
+        connection.remove(database+".datasets", BSON("_id" << id.OID()));
+    }
+}
+
+void
+Storage
+::_update_summaries(
+    mongo::DBClientConnection & connection,
+    odil::DataSet const & data_set, int instances, bool stale) const
+{
+    for(auto const & summary: get_summaries())
+    {
+        auto const & primary = std::get<1>(summary);
+        auto const primary_value = get_string(data_set, primary);
+        if(primary_value.empty())
+        {
+            continue;
+        }
+
+        mongo::BSONObjBuilder add_to_set;
+        for(auto const & tag: std::get<2>(summary))
+        {
+            auto const value = get_string(data_set, tag);
+            if(!value.empty())
+            {
+                add_to_set << std::string(tag) << value;
+            }
+        }
+
+        mongo::BSONObjBuilder update_builder;
+        update_builder << "$inc" << BSON(
+            "instances" << instances << "revision" << 1);
+        auto const add_to_set_object = add_to_set.obj();
+        if(!add_to_set_object.isEmpty())
+        {
+            update_builder << "$addToSet" << add_to_set_object;
+        }
+        if(stale)
+        {
+            update_builder << "$set" << BSON("stale" << true);
+        }
+        auto const update = update_builder.obj();
+
+        try
+        {
+            // The previous state of the summary, returned by the upsert,
+            // tells whether it was created; concurrent upserts creating the
+            // same summary may fail on its _id once.
+            mongo::BSONObj result;
+            bool ok = false;
+            for(int attempt=0; attempt<2 && !ok; ++attempt)
+            {
+                ok = connection.runCommand(
+                    this->_database,
+                    BSON(
+                        "findAndModify" << std::get<0>(summary)
+                        << "query" << BSON("_id" << primary_value)
+                        << "update" << update << "upsert" << true
+                        << "fields" << BSON("_id" << 1)),
+                    result);
+            }
+            if(!ok)
+            {
+                DOPAMINE_LOG(ERROR)
+                    << "Could not update " << std::get<0>(summary)
+                    << " summary of " << primary_value << ": "
+                    << result.getStringField("errmsg");
+                continue;
+            }
+
+            // A new summary is partial if data sets were stored before it:
+            // only then are the data sets counted.
+            if(
+                result["value"].type() != mongo::Object && !stale
+                && connection.count(
+                    this->_database+".datasets",
+                    BSON(
+                        get_value_path(primary, this->_schema)
+                        << primary_value))
+                    > static_cast<unsigned long long>(instances))
+            {
+                connection.update(
+                    this->_database+"."+std::get<0>(summary),
+                    BSON("_id" << primary_value),
+                    BSON("$set" << BSON("stale" << true)), false, false,
+                    &mongo::WriteConcern::acknowledged);
+            }
+        }
+        catch(mongo::DBException const & e)
+        {
+            // The data set is stored: do not report a failure to the peer.
+            DOPAMINE_LOG(ERROR)
+                << "Could not update " << std::get<0>(summary)
+                << " summary of " << primary_value << ": " << e.what();
+        }
+    }
+}
+
+void
+Storage
+::_invalidate_summaries(
+    mongo::DBClientConnection & connection,
+    mongo::BSONObj const & previous) const
+{
+    for(auto const & summary: get_summaries())
+    {
+        auto const primary_value = get_string(previous, std::get<1>(summary));
+        if(primary_value.empty())
+        {
+            continue;
+        }
+
+        try
+        {
+            connection.update(
+                this->_database+"."+std::get<0>(summary),
+                BSON("_id" << primary_value),
+                BSON(
+                    "$inc" << BSON("revision" << 1)
+                    << "$set" << BSON("stale" << true)),
+                false, false, &mongo::WriteConcern::acknowledged);
+        }
+        catch(mongo::DBException const & e)
+        {
+            DOPAMINE_LOG(ERROR)
+                << "Could not invalidate " << std::get<0>(summary)
+                << " summary of " << primary_value << ": " << e.what();
+        }
+    }
 }
 
 } // namespace archive
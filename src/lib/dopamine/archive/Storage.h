@@ -9,12 +9,22 @@
 #ifndef _a764d5b8_42ae_4f90_9ec2_cf377e3015a8
 #define _a764d5b8_42ae_4f90_9ec2_cf377e3015a8
 
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <set>
 #include <string>
 
 #include <mongo/client/dbclient.h>
 
 #include <odil/DataSet.h>
 
+#include "dopamine/archive/BatchWriter.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/bulk/BulkStorageBase.h"
+#include "dopamine/bulk/View.h"
+#include "dopamine/ConnectionPool.h"
+
 namespace dopamine
 {
 
@@ -25,9 +35,28 @@ namespace archive
 class Storage
 {
 public:
+    /// @brief Handling of a data set whose SOP instance UID is already stored.
+    enum class Duplicates
+    {
+        /// @brief Store both data sets, without checking for duplicates.
+        None,
+        /// @brief Replace the stored data set and remove its content.
+        Replace,
+        /// @brief Move the stored data set to the "versions" collection.
+        Version,
+        /// @brief Keep the stored data set and reject the new one.
+        Reject
+    };
+
+    /**
+     * @brief Return the duplicates policy from its name ("none", "replace",
+     * "version" or "reject"); throw an exception if the name is unknown.
+     */
+    static Duplicates parse_duplicates(std::string const & name);
+
     /// @brief Constructor.
     Storage(
-        mongo::DBClientConnection & connection,
+        ConnectionPool & connection_pool,
         std::string const & database, std::string const & bulk_database="");
 
     /// @brief Return the name of the main database.
@@ -51,20 +80,229 @@ public:
      */
     void set_gridfs_limit(unsigned int limit);
 
-    /// @brief Store the data set.
+    /// @brief Return the size of the GridFS chunks of the stored data sets.
+    unsigned int get_gridfs_chunk_size() const;
+
+    /**
+     * @brief Set the size of the GridFS chunks of the stored data sets,
+     * default to 255kB.
+     */
+    void set_gridfs_chunk_size(unsigned int chunk_size);
+
+    /// @brief Return the maximum number of parallel reads of a GridFS file.
+    unsigned int get_gridfs_readers() const;
+
+    /**
+     * @brief Set the maximum number of parallel reads of a GridFS file, each
+     * of them using a connection of the pool, default to 4.
+     */
+    void set_gridfs_readers(unsigned int readers);
+
+    /// @brief Return the zstd compression level of the content, 0 if disabled.
+    int get_compression_level() const;
+
+    /// @brief Return the minimum size of the compressed contents.
+    unsigned int get_compression_min_size() const;
+
+    /**
+     * @brief Compress with zstd the contents whose estimated size is at least
+     * min_size; compression is disabled if level is 0, which is the default.
+     * The codec is stored in the Content reference.
+     */
+    void set_compression(int level, unsigned int min_size);
+
+    /// @brief Return the storage of the content outside MongoDB, may be null.
+    std::shared_ptr<bulk::BulkStorageBase> get_bulk_storage() const;
+
+    /**
+     * @brief Set the storage of the content outside MongoDB. If not null,
+     * which is the default, the content of all stored data sets is written
+     * there instead of the metadata document, bulk database or GridFS.
+     */
+    void set_bulk_storage(std::shared_ptr<bulk::BulkStorageBase> bulk_storage);
+
+    /// @brief Return the handling of already stored data sets.
+    Duplicates get_duplicates() const;
+
+    /**
+     * @brief Set the handling of already stored data sets, default to None.
+     * Except with None, a data set identical to the stored one, as per the
+     * hash of its content, is not stored again.
+     */
+    void set_duplicates(Duplicates duplicates);
+
+    /// @brief Return the schema of the stored metadata documents.
+    Schema get_schema() const;
+
+    /**
+     * @brief Set the schema of the stored metadata documents, default to
+     * Verbose. The documents are looked up, queried and indexed with the
+     * paths of this schema only: all of them must use it, see has_documents.
+     */
+    void set_schema(Schema schema);
+
+    /**
+     * @brief Test whether the datasets collection holds metadata documents
+     * stored with the given schema.
+     */
+    bool has_documents(Schema schema) const;
+
+    /// @brief Test whether metadata documents are inserted in batches.
+    bool is_batched() const;
+
+    /**
+     * @brief Insert the metadata documents of concurrent stores in batches
+     * of at most max_count documents and max_size bytes, waiting at most
+     * max_delay for a batch to fill; batches are disabled if max_count is 1,
+     * which is the default.
+     */
+    void set_batch(
+        unsigned int max_count, unsigned int max_size,
+        std::chrono::milliseconds const & max_delay);
+
+    /**
+     * @brief Store the data set and update the patient, study and series
+     * summaries.
+     *
+     * The summaries are stored in the "patients", "studies" and "series"
+     * collections, with the primary UID as _id; they hold the number of
+     * instances, i.e. of metadata documents, and the distinct values of the
+     * related attributes, keyed by tag, and a revision incremented by each
+     * update. A summary which may not match the stored data sets, e.g. after
+     * a data set moved to other summaries or when data sets were stored
+     * before it was created, is flagged as stale until it is rebuilt by
+     * rebuild_summaries.
+     *
+     * The hash of the Part 10 content is stored in the ContentHash field of
+     * the metadata document and used to detect identical data sets. A new
+     * version replaces the metadata document of the previous one in place,
+     * keeping its _id, so that the SOP Instance UID index can be unique.
+     */
     void store(odil::DataSet const & data_set);
 
+    /**
+     * @brief Rebuild from the stored data sets the summaries of the given
+     * primary values (PatientID, StudyInstanceUID or SeriesInstanceUID)
+     * which are missing or stale. A summary updated by a store during the
+     * rebuild is left as is.
+     */
+    void rebuild_summaries(
+        odil::Tag const & primary, std::set<std::string> const & values);
+
+    /**
+     * @brief Rebuild all the summaries which are missing or stale, reading
+     * every stored data set; return the number of checked primary values.
+     * This is meant to run offline, e.g. from dopamine_migrate.
+     */
+    unsigned int rebuild_summaries();
+
     /**
      * @brief Return the data set with given SOP instance UID; throw an
      * exception if no such data set is stored.
      */
     odil::DataSet retrieve(std::string const & sop_instance_uid) const;
 
+    /**
+     * @brief Return a view of the stored Part 10 content of the data set
+     * with given SOP instance UID, memory-mapped if the bulk storage allows
+     * it and the content is not compressed; throw an exception if no such
+     * data set is stored.
+     */
+    std::shared_ptr<bulk::View> retrieve_view(
+        std::string const & sop_instance_uid) const;
+
+    /**
+     * @brief Replace the untyped Content references written by older
+     * versions (a string, the content being looked up by SOP instance UID)
+     * by typed references; return the number of updated documents.
+     *
+     * Typed references are sub-documents holding the "store" ("main" or
+     * "bulk" database), the "kind" ("gridfs" file or "inline" bulk document)
+     * and the "id" of the content. Content stored in the metadata document
+     * remains a binary field.
+     */
+    unsigned int migrate_content();
+
+    /**
+     * @brief Add to the metadata documents written by older versions the
+     * fields used by the indexed matching: the normalized Alphabetic
+     * component of the person names and the Normalized values of the dates
+     * and times; return the number of updated documents.
+     */
+    unsigned int migrate_metadata();
+
+    /**
+     * @brief Remove the objects of the bulk storage which are referenced
+     * neither by a data set nor by a version and were not stored during the
+     * grace period; return the number of removed objects.
+     *
+     * Since identical contents share an object, the objects are never
+     * removed while storing or superseding a data set: this must run
+     * offline, e.g. from dopamine_migrate.
+     */
+    unsigned int sweep_bulk_storage(std::chrono::seconds grace_period);
+
 private:
-    mongo::DBClientConnection & _connection;
+    ConnectionPool & _connection_pool;
     std::string _database;
     std::string _bulk_database;
     unsigned int _gridfs_limit;
+    unsigned int _gridfs_chunk_size;
+    unsigned int _gridfs_readers;
+    int _compression_level;
+    unsigned int _compression_min_size;
+    std::shared_ptr<bulk::BulkStorageBase> _bulk_storage;
+    Duplicates _duplicates;
+    Schema _schema;
+    /// @brief Shared by the copies of this object, null if not batched.
+    std::shared_ptr<BatchWriter> _batch_writer;
+
+    /// @brief Return the stored Part 10 content of a data set.
+    std::shared_ptr<bulk::View> _read_content(
+        std::string const & sop_instance_uid) const;
+
+    /**
+     * @brief Return the offset of the data set after the Part 10 header and
+     * set its transfer syntax.
+     */
+    std::size_t _skip_meta_information(
+        bulk::View const & view, std::string const & sop_instance_uid,
+        std::string & transfer_syntax) const;
+
+    /**
+     * @brief Store the data set; return false if a concurrent store of the
+     * same SOP instance was written first.
+     */
+    bool _store(odil::DataSet const & data_set);
+
+    /**
+     * @brief Remove the content of, or archive, the replaced metadata
+     * document of the previous version, according to the duplicates policy.
+     */
+    void _supersede(
+        mongo::DBClientConnection & connection,
+        mongo::BSONObj const & superseded) const;
+
+    /**
+     * @brief Remove the content of a metadata document, except for objects
+     * of the bulk storage, see sweep_bulk_storage.
+     */
+    void _remove_content(
+        mongo::DBClientConnection & connection,
+        mongo::BSONElement const & content) const;
+
+    /**
+     * @brief Update the summaries, incrementing their number of instances
+     * by the given value, and flag them as stale if required.
+     */
+    void _update_summaries(
+        mongo::DBClientConnection & connection,
+        odil::DataSet const & data_set, int instances, bool stale) const;
+
+    /// @brief Flag as stale the summaries of a superseded metadata document.
+    void _invalidate_summaries(
+        mongo::DBClientConnection & connection,
+        mongo::BSONObj const & previous) const;
 };
 
 } // namespace archive
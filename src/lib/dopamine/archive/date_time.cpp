@@ -0,0 +1,502 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/archive/date_time.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mongo/bson/bson.h>
+#include <odil/DataSet.h>
+#include <odil/registry.h>
+#include <odil/Tag.h>
+#include <odil/VR.h>
+
+namespace
+{
+
+int64_t const microseconds_per_second = 1000000;
+int64_t const microseconds_per_day = 86400*microseconds_per_second;
+int64_t const milliseconds_per_day = 86400000;
+
+/// @brief Parse a fixed number of digits, return false if one is missing.
+bool parse_digits(
+    std::string const & value, std::size_t position, std::size_t count,
+    int & result)
+{
+    if(position+count > value.size())
+    {
+        return false;
+    }
+    result = 0;
+    for(std::size_t i=position; i<position+count; ++i)
+    {
+        if(value[i] < '0' || value[i] > '9')
+        {
+            return false;
+        }
+        result = 10*result+(value[i]-'0');
+    }
+    return true;
+}
+
+/// @brief Number of days from 1970-01-01 to a date of the Gregorian calendar.
+int64_t days_from_civil(int64_t year, int month, int day)
+{
+    year -= (month <= 2)?1:0;
+    int64_t const era = (year >= 0?year:year-399)/400;
+    int64_t const year_of_era = year-era*400;
+    int64_t const day_of_year = (153*(month+(month>2?-3:9))+2)/5+day-1;
+    int64_t const day_of_era =
+        year_of_era*365+year_of_era/4-year_of_era/100+day_of_year;
+    return era*146097+day_of_era-719468;
+}
+
+int days_in_month(int year, int month)
+{
+    static int const days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool const leap = (year%4 == 0 && (year%100 != 0 || year%400 == 0));
+    return (month == 2 && leap)?29:days[month-1];
+}
+
+/// @brief Remove the padding and the given separator.
+std::string normalize(std::string const & value, char separator)
+{
+    auto const begin = value.find_first_not_of(' ');
+    if(begin == std::string::npos)
+    {
+        return "";
+    }
+    auto const end = value.find_last_not_of(' ');
+
+    std::string result;
+    result.reserve(end+1-begin);
+    for(auto i=begin; i<=end; ++i)
+    {
+        if(value[i] != separator)
+        {
+            result += value[i];
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Parse a time (HH[MM[SS[.F{1,6}]]]) starting at a given position, in
+ * microseconds, and the duration of its precision.
+ */
+bool parse_time(
+    std::string const & value, std::size_t position,
+    int64_t & time, int64_t & precision)
+{
+    auto const size = value.size()-position;
+    int hours=0, minutes=0, seconds=0;
+    if(!parse_digits(value, position, 2, hours) || hours > 23)
+    {
+        return false;
+    }
+    precision = 3600*microseconds_per_second;
+    if(size >= 4)
+    {
+        if(!parse_digits(value, position+2, 2, minutes) || minutes > 59)
+        {
+            return false;
+        }
+        precision = 60*microseconds_per_second;
+    }
+    if(size >= 6)
+    {
+        // Leap seconds are allowed.
+        if(!parse_digits(value, position+4, 2, seconds) || seconds > 60)
+        {
+            return false;
+        }
+        precision = microseconds_per_second;
+    }
+    int64_t fraction = 0;
+    if(size > 6)
+    {
+        auto const digits = size-7;
+        if(value[position+6] != '.' || digits < 1 || digits > 6)
+        {
+            return false;
+        }
+        for(std::size_t i=0; i<digits; ++i)
+        {
+            int digit;
+            if(!parse_digits(value, position+7+i, 1, digit))
+            {
+                return false;
+            }
+            fraction = 10*fraction+digit;
+            precision /= 10;
+        }
+        fraction *= precision;
+    }
+    else if(size != 2 && size != 4 && size != 6)
+    {
+        return false;
+    }
+
+    time =
+        (3600*hours+60*minutes+seconds)*microseconds_per_second+fraction;
+    return true;
+}
+
+bool parse_da(
+    std::string const & value, dopamine::archive::DateTimeInterval & interval)
+{
+    // Legacy format: YYYY.MM.DD
+    auto const date = normalize(value, '.');
+    int year, month, day;
+    if(
+        date.size() != 8
+        || !parse_digits(date, 0, 4, year)
+        || !parse_digits(date, 4, 2, month) || month < 1 || month > 12
+        || !parse_digits(date, 6, 2, day)
+        || day < 1 || day > days_in_month(year, month))
+    {
+        return false;
+    }
+
+    interval.begin = days_from_civil(year, month, day)*milliseconds_per_day;
+    interval.end = interval.begin+milliseconds_per_day;
+    return true;
+}
+
+bool parse_tm(
+    std::string const & value, dopamine::archive::DateTimeInterval & interval)
+{
+    // Legacy format: HH:MM:SS.F
+    auto const time = normalize(value, ':');
+    int64_t precision;
+    if(time.empty() || !parse_time(time, 0, interval.begin, precision))
+    {
+        return false;
+    }
+    interval.end = interval.begin+precision;
+    return true;
+}
+
+int64_t floor_divide(int64_t value, int64_t divisor)
+{
+    return value/divisor-((value%divisor < 0)?1:0);
+}
+
+bool parse_dt(
+    std::string const & value, dopamine::archive::DateTimeInterval & interval)
+{
+    auto date_time = normalize(value, '\0');
+
+    // UTC offset: &ZZXX
+    int64_t offset = 0;
+    if(
+        date_time.size() > 4
+        && (date_time[date_time.size()-5] == '+'
+            || date_time[date_time.size()-5] == '-'))
+    {
+        auto const position = date_time.size()-4;
+        int hours, minutes;
+        if(
+            !parse_digits(date_time, position, 2, hours)
+            || !parse_digits(date_time, position+2, 2, minutes))
+        {
+            return false;
+        }
+        offset = (3600*hours+60*minutes)*microseconds_per_second;
+        if(date_time[position-1] == '-')
+        {
+            offset = -offset;
+        }
+        date_time.erase(position-1);
+    }
+
+    auto const size = date_time.size();
+    int year, month=1, day=1;
+    if(!parse_digits(date_time, 0, 4, year))
+    {
+        return false;
+    }
+    if(
+        size >= 6 && (
+            !parse_digits(date_time, 4, 2, month) || month < 1 || month > 12))
+    {
+        return false;
+    }
+    if(
+        size >= 8 && (
+            !parse_digits(date_time, 6, 2, day)
+            || day < 1 || day > days_in_month(year, month)))
+    {
+        return false;
+    }
+
+    // Microseconds since the epoch, and end of the precision of the value.
+    int64_t begin = days_from_civil(year, month, day)*microseconds_per_day;
+    int64_t end;
+    if(size == 4)
+    {
+        end = days_from_civil(year+1, 1, 1)*microseconds_per_day;
+    }
+    else if(size == 6)
+    {
+        end = (month == 12)
+            ?days_from_civil(year+1, 1, 1)*microseconds_per_day
+            :days_from_civil(year, month+1, 1)*microseconds_per_day;
+    }
+    else if(size == 8)
+    {
+        end = begin+microseconds_per_day;
+    }
+    else if(size >= 10)
+    {
+        int64_t time, precision;
+        if(!parse_time(date_time, 8, time, precision))
+        {
+            return false;
+        }
+        begin += time;
+        end = begin+precision;
+    }
+    else
+    {
+        return false;
+    }
+
+    interval.begin = floor_divide(begin-offset, 1000);
+    interval.end = -floor_divide(-(end-offset), 1000);
+    return true;
+}
+
+}
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+std::string const normalized_field = "Normalized";
+
+DateTimeInterval
+::DateTimeInterval()
+: begin(std::numeric_limits<int64_t>::min()),
+  end(std::numeric_limits<int64_t>::max())
+{
+    // Nothing else.
+}
+
+bool
+DateTimeInterval
+::has_begin() const
+{
+    return this->begin != std::numeric_limits<int64_t>::min();
+}
+
+bool
+DateTimeInterval
+::has_end() const
+{
+    return this->end != std::numeric_limits<int64_t>::max();
+}
+
+bool parse_date_time(
+    std::string const & vr, std::string const & value,
+    DateTimeInterval & interval)
+{
+    if(vr == "DA")
+    {
+        return parse_da(value, interval);
+    }
+    else if(vr == "TM")
+    {
+        return parse_tm(value, interval);
+    }
+    else if(vr == "DT")
+    {
+        return parse_dt(value, interval);
+    }
+    else
+    {
+        return false;
+    }
+}
+
+bool parse_date_time_range(
+    std::string const & vr, std::string const & value,
+    DateTimeInterval & interval)
+{
+    // The UTC offset of a DT may also contain a "-": use the first separator
+    // between two valid bounds.
+    for(
+        auto separator = value.find('-'); separator != std::string::npos;
+        separator = value.find('-', separator+1))
+    {
+        auto const begin = normalize(value.substr(0, separator), '\0');
+        auto const end = normalize(value.substr(separator+1), '\0');
+        if(begin.empty() && end.empty())
+        {
+            return false;
+        }
+
+        DateTimeInterval begin_interval, end_interval;
+        if(
+            (begin.empty() || parse_date_time(vr, begin, begin_interval))
+            && (end.empty() || parse_date_time(vr, end, end_interval)))
+        {
+            interval = DateTimeInterval();
+            interval.begin = begin_interval.begin;
+            interval.end = end_interval.end;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+DateTimeInterval combine_date_time(
+    DateTimeInterval const & dates, DateTimeInterval const & times)
+{
+    DateTimeInterval result;
+    if(dates.has_begin())
+    {
+        result.begin = dates.begin;
+        if(times.has_begin())
+        {
+            result.begin += times.begin/1000;
+        }
+    }
+    if(dates.has_end())
+    {
+        // The end of a date range is the end of its last day.
+        result.end = dates.end;
+        if(times.has_end())
+        {
+            result.end += (times.end+999)/1000-milliseconds_per_day;
+        }
+    }
+    return result;
+}
+
+std::vector<std::pair<odil::Tag, odil::Tag>> const & get_date_time_pairs()
+{
+    static std::vector<std::pair<odil::Tag, odil::Tag>> const pairs{
+        { odil::registry::StudyDate, odil::registry::StudyTime },
+        { odil::registry::SeriesDate, odil::registry::SeriesTime },
+        { odil::registry::AcquisitionDate, odil::registry::AcquisitionTime },
+        { odil::registry::ContentDate, odil::registry::ContentTime },
+        {
+            odil::registry::InstanceCreationDate,
+            odil::registry::InstanceCreationTime
+        },
+        { odil::registry::PatientBirthDate, odil::registry::PatientBirthTime },
+        {
+            odil::registry::PerformedProcedureStepStartDate,
+            odil::registry::PerformedProcedureStepStartTime
+        },
+    };
+    return pairs;
+}
+
+std::string get_date_time_field(odil::Tag const & date, odil::Tag const & time)
+{
+    return std::string(date)+"_"+std::string(time);
+}
+
+void append_normalized_values(
+    odil::DataSet const & data_set, mongo::BSONObjBuilder & builder)
+{
+    auto const append = [&](
+            std::string const & field, odil::VR vr, int64_t value) {
+        if(vr == odil::VR::TM)
+        {
+            builder.append(field, static_cast<long long>(value));
+        }
+        else
+        {
+            builder.appendDate(
+                field, mongo::Date_t(static_cast<unsigned long long>(value)));
+        }
+    };
+
+    // Interval of a single-valued date or time element.
+    auto const get_interval = [&](
+            odil::Element const & element,
+            DateTimeInterval & interval) {
+        return (
+            (
+                element.vr == odil::VR::DA || element.vr == odil::VR::TM
+                || element.vr == odil::VR::DT)
+            && element.size() == 1
+            && parse_date_time(
+                odil::as_string(element.vr), element.as_string()[0], interval));
+    };
+
+    for(auto const & item: data_set)
+    {
+        DateTimeInterval interval;
+        if(get_interval(item.second, interval))
+        {
+            append(std::string(item.first), item.second.vr, interval.begin);
+        }
+    }
+
+    for(auto const & pair: get_date_time_pairs())
+    {
+        DateTimeInterval date, time;
+        if(
+            data_set.has(pair.first) && data_set.has(pair.second)
+            && data_set[pair.first].vr == odil::VR::DA
+            && data_set[pair.second].vr == odil::VR::TM
+            && get_interval(data_set[pair.first], date)
+            && get_interval(data_set[pair.second], time))
+        {
+            append(
+                get_date_time_field(pair.first, pair.second), odil::VR::DT,
+                date.begin+time.begin/1000);
+        }
+    }
+}
+
+void append_range_condition(
+    std::string const & field, std::string const & vr,
+    DateTimeInterval const & interval, mongo::BSONObjBuilder & builder)
+{
+    auto const append = [&](
+            mongo::BSONObjBuilder & condition, std::string const & name,
+            int64_t value) {
+        if(vr == "TM")
+        {
+            condition.append(name, static_cast<long long>(value));
+        }
+        else
+        {
+            condition.appendDate(
+                name, mongo::Date_t(static_cast<unsigned long long>(value)));
+        }
+    };
+
+    mongo::BSONObjBuilder condition(builder.subobjStart(field));
+    if(interval.has_begin())
+    {
+        append(condition, "$gte", interval.begin);
+    }
+    if(interval.has_end())
+    {
+        append(condition, "$lt", interval.end);
+    }
+    condition.done();
+}
+
+} // namespace archive
+
+} // namespace dopamine
@@ -0,0 +1,96 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _0d7f553f_5643_45f7_975b_a5f5295cec44
+#define _0d7f553f_5643_45f7_975b_a5f5295cec44
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mongo/bson/bson.h>
+#include <odil/DataSet.h>
+#include <odil/Tag.h>
+
+namespace dopamine
+{
+
+namespace archive
+{
+
+/**
+ * @brief Half-open interval covered by a date, time or date-time value, in
+ * milliseconds since the epoch (UTC) for DA and DT, and in microseconds
+ * since midnight for TM. Open bounds are the extreme values of int64_t.
+ */
+struct DateTimeInterval
+{
+    int64_t begin;
+    int64_t end;
+
+    /// @brief Create an unbounded interval.
+    DateTimeInterval();
+
+    bool has_begin() const;
+    bool has_end() const;
+};
+
+/**
+ * @brief Field of the metadata documents holding the normalized values of
+ * the date and time elements, by tag.
+ */
+extern std::string const normalized_field;
+
+/**
+ * @brief Parse a DA, TM or DT value, with partial precision and the legacy
+ * DA and TM formats; return false if the value is invalid.
+ */
+bool parse_date_time(
+    std::string const & vr, std::string const & value,
+    DateTimeInterval & interval);
+
+/**
+ * @brief Parse a range of DA, TM or DT values (PS 3.4, C.2.2.2.5), one of
+ * its bounds may be empty; return false if the range is invalid.
+ */
+bool parse_date_time_range(
+    std::string const & vr, std::string const & value,
+    DateTimeInterval & interval);
+
+/**
+ * @brief Combine a range of dates and a range of times to a range of
+ * date-times (PS 3.4, C.2.2.2.5.1).
+ */
+DateTimeInterval combine_date_time(
+    DateTimeInterval const & dates, DateTimeInterval const & times);
+
+/// @brief Pairs of date and time attributes matched as combined ranges.
+std::vector<std::pair<odil::Tag, odil::Tag>> const & get_date_time_pairs();
+
+/// @brief Return the normalized field of a pair of date and time attributes.
+std::string get_date_time_field(odil::Tag const & date, odil::Tag const & time);
+
+/**
+ * @brief Append the normalized values of the single-valued DA, TM and DT
+ * elements of a data set and of its pairs of date and time elements: dates
+ * and date-times as BSON dates, times as 64-bits integers.
+ */
+void append_normalized_values(
+    odil::DataSet const & data_set, mongo::BSONObjBuilder & builder);
+
+/// @brief Append the condition matching a normalized value to an interval.
+void append_range_condition(
+    std::string const & field, std::string const & vr,
+    DateTimeInterval const & interval, mongo::BSONObjBuilder & builder);
+
+} // namespace archive
+
+} // namespace dopamine
+
+#endif // _0d7f553f_5643_45f7_975b_a5f5295cec44
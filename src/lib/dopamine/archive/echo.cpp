@@ -16,6 +16,8 @@
 #include <odil/Value.h>
 
 #include "dopamine/AccessControlList.h"
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/Exception.h"
 #include "dopamine/utils.h"
 
 namespace dopamine
@@ -25,13 +27,24 @@ namespace archive
 {
 
 odil::Value::Integer echo(
-    mongo::DBClientConnection const & connection,
+    ConnectionPool & connection_pool,
     AccessControlList const & acl,
     odil::AssociationParameters const & parameters,
     odil::message::CEchoRequest const & /* not used */)
 {
+    bool connected = false;
+    try
+    {
+        auto connection = connection_pool.acquire();
+        connected = !connection->isFailed();
+    }
+    catch(Exception const &)
+    {
+        connected = false;
+    }
+
     odil::Value::Integer status;
-    if(connection.isFailed())
+    if(!connected)
     {
         status = odil::message::Response::ProcessingFailure;
     }
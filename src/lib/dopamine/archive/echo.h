@@ -16,6 +16,7 @@
 #include <odil/Value.h>
 
 #include "dopamine/AccessControlList.h"
+#include "dopamine/ConnectionPool.h"
 
 namespace dopamine
 {
@@ -25,7 +26,7 @@ namespace archive
 
 /// @brief Echo callback checking that the DB connection is alive.
 odil::Value::Integer echo(
-    mongo::DBClientConnection const & connection,
+    ConnectionPool & connection_pool,
     AccessControlList const & acl,
     odil::AssociationParameters const & parameters,
     odil::message::CEchoRequest const & request);
@@ -8,8 +8,13 @@
 
 #include "dopamine/archive/mongo_query.h"
 
+#include <cstddef>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <set>
 #include <string>
+#include <vector>
 
 #include <mongo/bson/bson.h>
 #include <odil/DataSet.h>
@@ -19,8 +24,131 @@
 #include <odil/Tag.h>
 #include <odil/VR.h>
 
+#include "dopamine/archive/date_time.h"
+#include "dopamine/archive/QueryPlanCache.h"
 #include "dopamine/bson_converter.h"
-#include "dopamine/utils.h"
+
+namespace
+{
+
+/**
+ * @brief Parse the range of a single-valued element of a query, return false
+ * if it is missing or is not a range.
+ */
+bool get_range(
+    odil::DataSet const & data_set, odil::Tag const & tag,
+    std::string const & vr, dopamine::archive::DateTimeInterval & interval)
+{
+    if(
+        !data_set.has(tag) || !data_set.is_string(tag)
+        || data_set.as_string(tag).size() != 1)
+    {
+        return false;
+    }
+    auto const & value = data_set.as_string(tag, 0);
+    return (
+        value.find('-') != std::string::npos
+        && dopamine::archive::parse_date_time_range(vr, value, interval));
+}
+
+/// @brief Create the plan of a query from its elements.
+std::shared_ptr<dopamine::archive::QueryPlan> create_plan(
+    std::string const & query_retrieve_level,
+    std::vector<mongo::BSONElement> const & elements,
+    std::vector<mongo::BSONElement> const & values,
+    std::vector<dopamine::archive::MatchType> const & match_types,
+    dopamine::Schema schema)
+{
+    using namespace dopamine::archive;
+
+    auto plan = std::make_shared<QueryPlan>();
+
+    mongo::BSONObjBuilder fields;
+    std::set<std::string> ranges;
+    for(std::size_t i=0; i<elements.size(); ++i)
+    {
+        auto const & element = elements[i];
+        auto const vr = element.Obj().getField("vr").String();
+
+        QueryPlan::Term term;
+        term.vr = vr;
+        if(!values[i].eoo())
+        {
+            term.path = dopamine::get_value_path(
+                odil::Tag(element.fieldName()), odil::as_vr(vr), schema);
+            term.converter = get_query_converter(match_types[i]);
+            if(match_types[i] == MatchType::Range)
+            {
+                ranges.insert(element.fieldName());
+            }
+        }
+        plan->terms.push_back(term);
+
+        // Include the query fields in the results.
+        fields << element.fieldName() << 1;
+    }
+
+    for(auto const & pair: get_date_time_pairs())
+    {
+        if(
+            ranges.count(std::string(pair.first))
+            && ranges.count(std::string(pair.second)))
+        {
+            plan->date_time_pairs.push_back(pair);
+        }
+    }
+
+    // Always include mandatory fields
+    std::vector<odil::Tag> mandatory_fields = {
+        odil::registry::PatientID,
+    };
+
+    if(query_retrieve_level=="STUDY" || query_retrieve_level=="SERIES" ||
+        query_retrieve_level=="IMAGE")
+    {
+        mandatory_fields.push_back(odil::registry::StudyInstanceUID);
+    }
+    if(query_retrieve_level=="SERIES" || query_retrieve_level=="IMAGE")
+    {
+        mandatory_fields.push_back(odil::registry::SeriesInstanceUID);
+    }
+    if(query_retrieve_level=="IMAGE")
+    {
+        mandatory_fields.push_back(odil::registry::SOPInstanceUID);
+    }
+    for(auto const & field: mandatory_fields)
+    {
+        std::string const field_as_string(field);
+        if(!fields.hasField(field_as_string))
+        {
+            fields << field_as_string << 1;
+        }
+    }
+    plan->fields = fields.obj();
+
+    return plan;
+}
+
+/**
+ * @brief Return the smallest string greater than all the strings starting
+ * with prefix, or an empty string if there is none.
+ */
+std::string get_upper_bound(std::string prefix)
+{
+    while(!prefix.empty())
+    {
+        auto & last = reinterpret_cast<unsigned char &>(prefix.back());
+        if(last != 0xff)
+        {
+            ++last;
+            return prefix;
+        }
+        prefix.pop_back();
+    }
+    return prefix;
+}
+
+}
 
 namespace dopamine
 {
@@ -31,7 +159,8 @@ namespace archive
 void as_mongo_query(
     odil::DataSet const & data_set,
     mongo::BSONArrayBuilder & query_terms,
-    mongo::BSONObjBuilder & query_fields)
+    mongo::BSONObjBuilder & query_fields,
+    Schema schema, QueryPlanCache * cache)
 {
     if(
         !data_set.has(odil::registry::QueryRetrieveLevel) ||
@@ -50,15 +179,28 @@ void as_mongo_query(
         odil::registry::QueryRetrieveLevel, 0);
 
     // Query with DICOM syntax matches
-    auto dicom_query = as_bson(data_set);
-    // Remove unused elements
-    dicom_query = dicom_query.removeField("00080005"); // SpecificCharacterSet
-    dicom_query = dicom_query.removeField("00080052"); // QueryRetrieveLevel
-
-    // Build the MongoDB query and query fields from the DICOM query
+    auto const dicom_query = as_bson(data_set);
+
+    // Values and match types of the elements, and shape of the query
+    std::vector<mongo::BSONElement> elements;
+    std::vector<mongo::BSONElement> values;
+    std::vector<MatchType> match_types;
+    std::string shape;
+    shape.reserve(256);
+    shape += query_retrieve_level;
+    shape += '/';
+    shape += static_cast<char>('0'+static_cast<int>(schema));
     for(auto it = dicom_query.begin(); it.more(); /* nothing */)
     {
         auto const element = it.next();
+        // Skip the unused elements, SpecificCharacterSet and
+        // QueryRetrieveLevel, without copying the query.
+        if(
+            !std::strcmp(element.fieldName(), "00080005")
+            || !std::strcmp(element.fieldName(), "00080052"))
+        {
+            continue;
+        }
         auto const object = element.Obj();
 
         auto const vr = object.getField("vr").String();
@@ -66,9 +208,11 @@ void as_mongo_query(
         std::string const field =
             odil::is_binary(odil::as_vr(vr))?"InlineBinary":"Value";
 
+        mongo::BSONElement value;
+        auto match_type = MatchType::Unknown;
         if(object.hasField(field))
         {
-            auto value = object.getField(field);
+            value = object.getField(field);
             auto const array = value.Array();
             if(array.empty())
             {
@@ -82,46 +226,74 @@ void as_mongo_query(
             {
                 value = array[0];
             }
+            match_type = get_match_type(vr, value);
+        }
 
-            // Convert the DICOM query term to MongoDB syntax
-            mongo::BSONObjBuilder term;
-            auto const converter = get_query_converter(
-                get_match_type(vr, value));
-            converter(
-                std::string(element.fieldName())+"."+field, vr, value, term);
-            query_terms << term.obj();
+        shape += '/';
+        shape += element.fieldName();
+        shape += ':';
+        shape += vr;
+        shape += ':';
+        if(!value.eoo())
+        {
+            shape += static_cast<char>('0'+static_cast<int>(match_type));
         }
 
-        // Include the query fields in the results.
-        query_fields << element.fieldName() << 1;
+        elements.push_back(element);
+        values.push_back(value);
+        match_types.push_back(match_type);
     }
 
-    // Always include mandatory fields
-    std::vector<odil::Tag> mandatory_fields = {
-        odil::registry::PatientID,
-    };
-
-    if(query_retrieve_level=="STUDY" || query_retrieve_level=="SERIES" ||
-        query_retrieve_level=="IMAGE")
+    std::shared_ptr<QueryPlan const> plan;
+    if(cache)
     {
-        mandatory_fields.push_back(odil::registry::StudyInstanceUID);
+        plan = cache->find(shape);
     }
-    if(query_retrieve_level=="SERIES" || query_retrieve_level=="IMAGE")
+    if(!plan)
     {
-        mandatory_fields.push_back(odil::registry::SeriesInstanceUID);
+        plan = create_plan(
+            query_retrieve_level, elements, values, match_types, schema);
+        if(cache)
+        {
+            cache->insert(shape, plan);
+        }
     }
-    if(query_retrieve_level=="IMAGE")
+
+    // Ranges of a pair of date and time attributes are matched as a range of
+    // date-times (PS 3.4, C.2.2.2.5.1).
+    std::set<std::string> combined;
+    for(auto const & pair: plan->date_time_pairs)
     {
-        mandatory_fields.push_back(odil::registry::SOPInstanceUID);
+        DateTimeInterval dates, times;
+        if(
+            get_range(data_set, pair.first, "DA", dates)
+            && get_range(data_set, pair.second, "TM", times))
+        {
+            auto const field =
+                normalized_field+"."
+                +get_date_time_field(pair.first, pair.second);
+            mongo::BSONObjBuilder term;
+            append_range_condition(
+                field, "DT", combine_date_time(dates, times), term);
+            query_terms << term.obj();
+            combined.insert(std::string(pair.first));
+            combined.insert(std::string(pair.second));
+        }
     }
-    for(auto const & field: mandatory_fields)
+
+    // Convert the DICOM query terms to MongoDB syntax
+    for(std::size_t i=0; i<elements.size(); ++i)
     {
-        std::string const field_as_string(field);
-        if(!query_fields.hasField(field_as_string))
+        auto const & term = plan->terms[i];
+        if(term.converter && !combined.count(elements[i].fieldName()))
         {
-            query_fields << field_as_string << 1;
+            mongo::BSONObjBuilder term_builder;
+            term.converter(term.path, term.vr, values[i], term_builder);
+            query_terms << term_builder.obj();
         }
     }
+
+    query_fields.appendElements(plan->fields);
 }
 
 // Define Unknown specialization first, since other specializations use it.
@@ -202,58 +374,129 @@ as_mongo_query<MatchType::WildCard>(
     std::string const & field, std::string const & vr,
     mongo::BSONElement const & value, mongo::BSONObjBuilder & builder)
 {
+    std::string pattern;
+    std::string subfield;
+    if(vr == "PN")
+    {
+        if(
+            value.type() == mongo::BSONType::Object
+            && value.Obj().hasField("Alphabetic"))
+        {
+            pattern = value.Obj().getField("Alphabetic").String();
+        }
+        else
+        {
+            pattern = value.String();
+        }
+
+        // Person names are matched case-insensitively on the normalized
+        // shadow field of their Alphabetic component, which can be indexed.
+        pattern = normalize_person_name(pattern);
+        subfield = normalized_alphabetic;
+    }
+    else
+    {
+        pattern = value.String();
+    }
+
+    // Convert DICOM regex to PCRE in a single pass: replace "*" by ".*", "?"
+    // by ".", escape the PCRE metacharacters and add the anchors.
+    static std::string const metacharacters = "\\^$.|[]()+{}";
     std::string regex;
-    if(vr == "PN" && value.type() == mongo::BSONType::Object)
+    regex.reserve(2*pattern.size()+2);
+    regex += '^';
+    for(auto const c: pattern)
     {
-        if(value.Obj().hasField("Alphabetic"))
+        if(c == '*')
+        {
+            regex += ".*";
+        }
+        else if(c == '?')
         {
-            regex = value.Obj().getField("Alphabetic").String();
+            regex += '.';
         }
         else
         {
-            regex = value.String();
+            if(metacharacters.find(c) != std::string::npos)
+            {
+                regex += '\\';
+            }
+            regex += c;
         }
     }
+    regex += '$';
+
+    auto const prefix = pattern.substr(0, pattern.find_first_of("*?"));
+    if(prefix.empty())
+    {
+        // No literal prefix to bound an index scan.
+        builder.appendRegex(subfield.empty()?field:field+"."+subfield, regex);
+        return;
+    }
+
+    // The literal prefix is matched by a range, which bounds the index scan
+    // tightly. The range and the pattern must be matched by the same value:
+    // in the verbose schema the values are always in an array, in the compact
+    // schema only multiple values are.
+    auto const in_array = (
+        field.size() >= 6 && field.compare(field.size()-6, 6, ".Value") == 0);
+
+    auto const upper_bound = get_upper_bound(prefix);
+    auto const get_condition = [&](bool with_regex) {
+        mongo::BSONObjBuilder condition;
+        condition << "$gte" << prefix;
+        if(!upper_bound.empty())
+        {
+            condition << "$lt" << upper_bound;
+        }
+        if(with_regex)
+        {
+            condition.appendRegex("$regex", regex);
+        }
+        return condition.obj();
+    };
+    // A pattern made of the prefix followed by "*" is fully matched by the
+    // range.
+    auto const condition = get_condition(pattern != prefix+"*");
+
+    auto const element_match = BSON(
+        field << BSON(
+            "$elemMatch" << (
+                subfield.empty()?condition:BSON(subfield << condition))));
+    if(in_array)
+    {
+        builder.appendElements(element_match);
+    }
     else
     {
-        regex = value.String();
-    }
-
-    // Convert DICOM regex to PCRE: replace "*" by ".*", "?" by ".",
-    // and escape other special PCRE characters (these are :
-    // \^$.[]()+{}
-    //
-    // Escape "\\" first since we're using it to replace "."
-    regex = replace(regex, "\\", "\\\\");
-    // Escape "." first since we're using it to replace "*"
-    regex = replace(regex, ".", "\\.");
-    regex = replace(regex, "*", ".*");
-    regex = replace(regex, "?", ".");
-    // Escape other PCRE metacharacters
-    regex = replace(regex, "^", "\\^");
-    regex = replace(regex, "$", "\\$");
-    regex = replace(regex, "[", "\\[");
-    regex = replace(regex, "]", "\\]");
-    regex = replace(regex, "(", "\\(");
-    regex = replace(regex, ")", "\\)");
-    regex = replace(regex, "+", "\\+");
-    regex = replace(regex, "{", "\\{");
-    regex = replace(regex, "}", "\\}");
-    // Add the start and end anchors
-    regex = "^"+regex+"$";
-
-    // Use case-insensitive match for PN
-    builder.appendRegex(
-        field+(vr=="PN"?".Alphabetic":""), regex, (vr=="PN")?"i":"");
+        // Single value, not in an array
+        auto const single_value = BSON(
+            (subfield.empty()?field:field+"."+subfield) << condition
+            << field+".0" << BSON("$exists" << false));
+        builder << "$or" << BSON_ARRAY(element_match << single_value);
+    }
 }
 
 template<>
 void
 as_mongo_query<MatchType::Range>(
-    std::string const & field, std::string const & /* unused */,
+    std::string const & field, std::string const & vr,
     mongo::BSONElement const & value, mongo::BSONObjBuilder & builder)
 {
     auto const range = value.String();
+
+    // Top-level elements are matched on their typed normalized value.
+    auto const tag = field.substr(0, field.find('.'));
+    DateTimeInterval interval;
+    if(
+        tag.size() == 8 && (field == tag || field == tag+".Value")
+        && parse_date_time_range(vr, range, interval))
+    {
+        append_range_condition(
+            normalized_field+"."+tag, vr, interval, builder);
+        return;
+    }
+
     auto const separator = range.find("-");
     auto const begin = range.substr(0, separator);
     auto const end = range.substr(separator+1, std::string::npos);
@@ -15,17 +15,26 @@
 #include <mongo/bson/bson.h>
 #include <odil/DataSet.h>
 
+#include "dopamine/bson_converter.h"
+
 namespace dopamine
 {
 
 namespace archive
 {
 
-/// @brief Convert DICOM query to a MongoDB query.
+class QueryPlanCache;
+
+/**
+ * @brief Convert DICOM query to a MongoDB query on data sets stored with the
+ * given schema; the translation of the shape of the query is looked up in and
+ * stored to the cache, if any.
+ */
 void as_mongo_query(
     odil::DataSet const & data_set,
     mongo::BSONArrayBuilder & query_terms,
-    mongo::BSONObjBuilder & query_fields);
+    mongo::BSONObjBuilder & query_fields,
+    Schema schema=Schema::Verbose, QueryPlanCache * cache=nullptr);
 
 /// @brief DICOM match type, see PS 3.4, C.2.2.2
 enum class MatchType
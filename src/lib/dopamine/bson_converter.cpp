@@ -8,6 +8,9 @@
 
 #include "dopamine/bson_converter.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -24,124 +27,205 @@
 namespace
 {
 
-struct AsBSON
+/**
+ * @brief Append the BSON representation of an element without intermediate
+ * objects: arrays and sub-documents are written in the buffer of the
+ * builder.
+ *
+ * In the verbose schema, the builder is the one of the element, and the
+ * values are appended to its "Value" (or "InlineBinary") array. In the
+ * compact schema, the builder is the one of the data set, and the values
+ * are appended to the field of the element, single values not in an array.
+ */
+struct BSONAppender
 {
 public:
-    typedef mongo::BSONObj result_type;
-
-    AsBSON(odil::Value::Strings const & specific_char_set)
-    : _specific_character_set(specific_char_set)
+    typedef void result_type;
+
+    BSONAppender(
+        mongo::BSONObjBuilder & builder, std::string const & field,
+        dopamine::Schema schema,
+        odil::Value::Strings const & specific_char_set)
+    : _builder(builder), _field(field), _schema(schema),
+      _specific_character_set(specific_char_set)
     {
         // Nothing else
     }
 
     result_type operator()(odil::VR const vr) const
     {
-        return BSON("vr" << odil::as_string(vr));
+        if(this->_schema == dopamine::Schema::Compact)
+        {
+            mongo::BSONObjBuilder array(
+                this->_builder.subarrayStart(this->_field));
+            array.done();
+        }
+        else
+        {
+            this->_builder.append("vr", odil::as_string(vr));
+        }
     }
 
     template<typename T>
     result_type operator()(odil::VR const vr, T const & value) const
     {
-        mongo::BSONArrayBuilder array;
-        for(auto const & item: value)
-        {
-            array << item;
-        }
-
-        return BSON("vr" << odil::as_string(vr) << "Value" << array.arr());
+        this->_append(
+            vr, "Value", value,
+            [](
+                mongo::BSONObjBuilder & builder, std::string const & name,
+                typename T::value_type const & item)
+            {
+                builder.append(name, item);
+            });
     }
 
     result_type operator()(
         odil::VR const vr, odil::Value::Integers const & value) const
     {
-        mongo::BSONArrayBuilder array;
-        for(auto const & item: value)
-        {
-            array << static_cast<long long>(item);
-        }
-
-        return BSON("vr" << odil::as_string(vr) << "Value" << array.arr());
+        this->_append(
+            vr, "Value", value,
+            [](
+                mongo::BSONObjBuilder & builder, std::string const & name,
+                odil::Value::Integer const & item)
+            {
+                builder.append(name, static_cast<long long>(item));
+            });
     }
 
     result_type operator()(
         odil::VR const vr, odil::Value::Strings const & value) const
     {
-        mongo::BSONArrayBuilder array;
-
         if(vr == odil::VR::PN)
         {
-            for(auto const & item: value)
-            {
-                array << this->_convert_pn(item);
-            }
+            this->_append(
+                vr, "Value", value,
+                [&](
+                    mongo::BSONObjBuilder & builder, std::string const & name,
+                    odil::Value::String const & item)
+                {
+                    mongo::BSONObjBuilder item_builder(
+                        builder.subobjStart(name));
+                    this->_append_pn(item, item_builder);
+                    item_builder.done();
+                });
+        }
+        else if(_needs_conversion(vr))
+        {
+            this->_append(
+                vr, "Value", value,
+                [&](
+                    mongo::BSONObjBuilder & builder, std::string const & name,
+                    odil::Value::String const & item)
+                {
+                    builder.append(name, this->_convert_string(vr, item));
+                });
         }
         else
         {
-            for(auto const & item: value)
-            {
-                array << this->_convert_string(vr, item);
-            }
+            this->_append(
+                vr, "Value", value,
+                [](
+                    mongo::BSONObjBuilder & builder, std::string const & name,
+                    odil::Value::String const & item)
+                {
+                    builder.append(name, item);
+                });
         }
-
-        return BSON("vr" << odil::as_string(vr) << "Value" << array.arr());
     }
 
     result_type operator()(
         odil::VR const vr, odil::Value::DataSets const & value) const
     {
-        mongo::BSONArrayBuilder array;
-        for(auto const & item: value)
-        {
-            array << dopamine::as_bson(item, this->_specific_character_set);
-        }
-
-        return BSON("vr" << odil::as_string(vr) << "Value" << array.arr());
+        this->_append(
+            vr, "Value", value,
+            [&](
+                mongo::BSONObjBuilder & builder, std::string const & name,
+                odil::DataSet const & item)
+            {
+                mongo::BSONObjBuilder item_builder(builder.subobjStart(name));
+                dopamine::as_bson(
+                    item, item_builder, this->_specific_character_set,
+                    this->_schema);
+                item_builder.done();
+            });
     }
 
     result_type operator()(
         odil::VR const vr, odil::Value::Binary const & value) const
     {
-        mongo::BSONArrayBuilder array;
-        for(auto const & item: value)
-        {
-            mongo::BSONObjBuilder item_builder;
-            item_builder.appendBinData(
-                "data", item.size(), mongo::BinDataGeneral, &item[0]);
-            array.append(item_builder.obj()["data"]);
-        }
-
-        return BSON("vr" << odil::as_string(vr) << "InlineBinary" << array.arr());
+        this->_append(
+            vr, "InlineBinary", value,
+            [](
+                mongo::BSONObjBuilder & builder, std::string const & name,
+                odil::Value::Binary::value_type const & item)
+            {
+                builder.appendBinData(
+                    name, item.size(), mongo::BinDataGeneral, item.data());
+            });
     }
 
 private:
+    mongo::BSONObjBuilder & _builder;
+
+    /// Field of the element, in the compact schema
+    std::string const & _field;
+
+    dopamine::Schema _schema;
+
     /// Character Set
-    odil::Value::Strings _specific_character_set;
+    odil::Value::Strings const & _specific_character_set;
 
-    std::string _convert_string(
-        odil::VR const vr, odil::Value::String const & value) const
+    template<typename TValue, typename TAppender>
+    void _append(
+        odil::VR const vr, char const * verbose_field, TValue const & value,
+        TAppender const & append) const
     {
-        if(
-            vr != odil::VR::LO && vr != odil::VR::LT &&
-            vr != odil::VR::PN && vr != odil::VR::SH &&
-            vr != odil::VR::ST && vr != odil::VR::UT)
+        if(this->_schema == dopamine::Schema::Compact)
+        {
+            if(value.size() == 1)
+            {
+                append(this->_builder, this->_field, value[0]);
+                return;
+            }
+        }
+        else
         {
-            // Nothing to do
-            return value;
+            this->_builder.append("vr", odil::as_string(vr));
         }
 
+        mongo::BSONObjBuilder array(
+            this->_builder.subarrayStart(
+                (this->_schema == dopamine::Schema::Compact)
+                ?this->_field:verbose_field));
+        for(std::size_t i=0; i<value.size(); ++i)
+        {
+            append(array, mongo::BSONObjBuilder::numStr(i), value[i]);
+        }
+        array.done();
+    }
+
+    static bool _needs_conversion(odil::VR const vr)
+    {
+        return (
+            vr == odil::VR::LO || vr == odil::VR::LT ||
+            vr == odil::VR::PN || vr == odil::VR::SH ||
+            vr == odil::VR::ST || vr == odil::VR::UT);
+    }
+
+    std::string _convert_string(
+        odil::VR const vr, odil::Value::String const & value) const
+    {
         return odil::as_utf8(
             value, this->_specific_character_set, vr==odil::VR::PN);
     }
 
-    mongo::BSONObj _convert_pn(odil::Value::String const & value) const
+    void _append_pn(
+        odil::Value::String const & value, mongo::BSONObjBuilder & bson) const
     {
         static auto const fields = { "Alphabetic", "Ideographic", "Phonetic" };
 
         auto fields_it = fields.begin();
 
-        mongo::BSONObjBuilder bson;
-
         std::string::size_type begin=0;
         while(begin != std::string::npos)
         {
@@ -157,8 +241,16 @@ private:
                 size = std::string::npos;
             }
 
-            auto const component = value.substr(begin, size);
-            bson << *fields_it << this->_convert_string(odil::VR::PN, component);
+            auto const component = this->_convert_string(
+                odil::VR::PN, value.substr(begin, size));
+            bson.append(*fields_it, component);
+            if(fields_it == fields.begin())
+            {
+                // Shadow field for the indexed wildcard matching.
+                bson.append(
+                    dopamine::normalized_alphabetic,
+                    dopamine::normalize_person_name(component));
+            }
 
             if(end != std::string::npos)
             {
@@ -174,23 +266,308 @@ private:
                 begin = end;
             }
         }
+    }
+};
+
+/**
+ * @brief Set the VR of a tag from the public dictionary; return false for
+ * private tags, unknown tags and tags with several possible VRs.
+ */
+bool get_dictionary_vr(odil::Tag const & tag, odil::VR & vr)
+{
+    if(tag.group%2 == 1)
+    {
+        return false;
+    }
 
-        return bson.obj();
+    try
+    {
+        vr = odil::as_vr(tag);
+    }
+    catch(odil::Exception const &)
+    {
+        return false;
     }
+    return (vr != odil::VR::UNKNOWN && vr != odil::VR::INVALID);
+}
+
+/// @brief Iterate over the items of a BSON array, or over a single element.
+class Items
+{
+public:
+    Items(mongo::BSONElement const & element)
+    : _single(element.type() != mongo::Array), _element(element),
+      _iterator(_single?mongo::BSONObj():element.Obj())
+    {
+        // Nothing else.
+    }
+
+    bool more()
+    {
+        return this->_single?!this->_element.eoo():this->_iterator.more();
+    }
+
+    mongo::BSONElement next()
+    {
+        if(this->_single)
+        {
+            auto const element = this->_element;
+            this->_element = mongo::BSONElement();
+            return element;
+        }
+        return this->_iterator.next();
+    }
+
+private:
+    bool _single;
+    mongo::BSONElement _element;
+    mongo::BSONObjIterator _iterator;
 };
 
+/// @brief Lookup table of the VRs, indexed by their two letters.
+class VRTable
+{
+public:
+    VRTable()
+    {
+        std::fill(this->_known, this->_known+26*26, false);
+        for(auto const vr: {
+            odil::VR::AE, odil::VR::AS, odil::VR::AT, odil::VR::CS,
+            odil::VR::DA, odil::VR::DS, odil::VR::DT, odil::VR::FD,
+            odil::VR::FL, odil::VR::IS, odil::VR::LO, odil::VR::LT,
+            odil::VR::OB, odil::VR::OF, odil::VR::OW, odil::VR::PN,
+            odil::VR::SH, odil::VR::SL, odil::VR::SQ, odil::VR::SS,
+            odil::VR::ST, odil::VR::TM, odil::VR::UI, odil::VR::UL,
+            odil::VR::UN, odil::VR::US, odil::VR::UT })
+        {
+            auto const name = odil::as_string(vr);
+            auto const index = (name[0]-'A')*26+(name[1]-'A');
+            this->_vrs[index] = vr;
+            this->_known[index] = true;
+        }
+    }
+
+    /// @brief Return the VR, using odil for those not in the table.
+    odil::VR get(char const * name, std::size_t size) const
+    {
+        if(
+            size == 2
+            && name[0] >= 'A' && name[0] <= 'Z'
+            && name[1] >= 'A' && name[1] <= 'Z')
+        {
+            auto const index = (name[0]-'A')*26+(name[1]-'A');
+            if(this->_known[index])
+            {
+                return this->_vrs[index];
+            }
+        }
+        return odil::as_vr(std::string(name, size));
+    }
+
+private:
+    odil::VR _vrs[26*26];
+    bool _known[26*26];
+};
+
+/**
+ * @brief Parse a field name made of 8 hexadecimal digits as a tag; return
+ * false if the field name has another form.
+ */
+bool parse_tag(char const * name, odil::Tag & tag)
+{
+    uint32_t value = 0;
+    int i=0;
+    for(/* */; i<8 && name[i] != '\0'; ++i)
+    {
+        auto const c = name[i];
+        uint32_t digit;
+        if(c >= '0' && c <= '9')
+        {
+            digit = c-'0';
+        }
+        else if(c >= 'a' && c <= 'f')
+        {
+            digit = 10+c-'a';
+        }
+        else if(c >= 'A' && c <= 'F')
+        {
+            digit = 10+c-'A';
+        }
+        else
+        {
+            return false;
+        }
+        value = (value << 4) + digit;
+    }
+    if(i != 8 || name[i] != '\0')
+    {
+        return false;
+    }
+
+    tag = odil::Tag(value >> 16, value & 0xffff);
+    return true;
+}
+
+/// @brief Return the string value of a BSON element, without copy.
+void get_string(
+    mongo::BSONElement const & element, char const * & data, std::size_t & size)
+{
+    if(element.type() != mongo::String)
+    {
+        throw dopamine::Exception(
+            "Invalid string value: "+element.toString(false));
+    }
+    data = element.valuestr();
+    size = element.valuestrsize()-1;
+}
+
+/**
+ * @brief Append a string to the values of an element, converted to the
+ * specific character set. ASCII strings are the same in all character sets
+ * and are not converted.
+ */
+void append_string(
+    char const * data, std::size_t size,
+    odil::Value::Strings const & specific_character_set,
+    odil::Value::Strings & values)
+{
+    bool const is_ascii = std::all_of(
+        data, data+size,
+        [](char c) { return static_cast<unsigned char>(c) < 0x80; });
+    if(is_ascii)
+    {
+        values.emplace_back(data, size);
+    }
+    else
+    {
+        values.push_back(
+            odil::as_specific_character_set(
+                std::string(data, size), specific_character_set));
+    }
+}
+
 }
 
 namespace dopamine
 {
 
+std::string const normalized_alphabetic = "Alphabetic_norm";
+
+std::string normalize_person_name(std::string const & value)
+{
+    std::string result(value);
+    for(auto & c: result)
+    {
+        // Only ASCII: the bytes of multi-byte UTF-8 sequences are >= 0x80.
+        if(c >= 'a' && c <= 'z')
+        {
+            c += 'A'-'a';
+        }
+    }
+    return result;
+}
+
+Schema as_schema(std::string const & name)
+{
+    if(name == "verbose")
+    {
+        return Schema::Verbose;
+    }
+    else if(name == "compact")
+    {
+        return Schema::Compact;
+    }
+    else
+    {
+        throw Exception("Unknown schema: "+name);
+    }
+}
+
+bool is_compact(odil::Tag const & tag, odil::VR vr, Schema schema)
+{
+    odil::VR dictionary_vr;
+    return (
+        schema == Schema::Compact
+        && get_dictionary_vr(tag, dictionary_vr) && dictionary_vr == vr);
+}
+
+std::string get_value_path(odil::Tag const & tag, odil::VR vr, Schema schema)
+{
+    if(is_compact(tag, vr, schema))
+    {
+        return std::string(tag);
+    }
+    else
+    {
+        return std::string(tag)+(odil::is_binary(vr)?".InlineBinary":".Value");
+    }
+}
+
+std::string get_value_path(odil::Tag const & tag, Schema schema)
+{
+    odil::VR vr;
+    if(!get_dictionary_vr(tag, vr))
+    {
+        return std::string(tag)+".Value";
+    }
+    return get_value_path(tag, vr, schema);
+}
+
+mongo::BSONElement get_first_value(mongo::BSONElement const & element)
+{
+    mongo::BSONElement values;
+    if(element.type() == mongo::Object)
+    {
+        auto const object = element.Obj();
+        auto const vr = object["vr"];
+        if(vr.eoo())
+        {
+            // Compact single value: sequence item or person name.
+            return element;
+        }
+        values = object[
+            odil::is_binary(odil::as_vr(vr.String()))?"InlineBinary":"Value"];
+    }
+    else
+    {
+        values = element;
+    }
+
+    if(values.type() == mongo::Array)
+    {
+        auto it = values.Obj().begin();
+        return it.more()?it.next():mongo::BSONElement();
+    }
+    else if(values.isNull())
+    {
+        return mongo::BSONElement();
+    }
+    return values;
+}
+
 mongo::BSONObj as_bson(
     odil::DataSet const & data_set,
-    odil::Value::Strings const & specific_character_set)
+    odil::Value::Strings const & specific_character_set, Schema schema)
+{
+    // The document is built in a per-thread buffer which is kept between
+    // calls, and copied once to the result.
+    static thread_local mongo::BufBuilder buffer;
+    buffer.reset();
+
+    mongo::BSONObjBuilder builder(buffer);
+    as_bson(data_set, builder, specific_character_set, schema);
+    builder.done();
+
+    return mongo::BSONObj(buffer.buf()).getOwned();
+}
+
+void as_bson(
+    odil::DataSet const & data_set, mongo::BSONObjBuilder & builder,
+    odil::Value::Strings const & specific_character_set, Schema schema)
 {
-    auto current_specific_char_set = specific_character_set;
+    odil::Value::Strings current_specific_char_set;
+    auto const * specific_char_set = &specific_character_set;
 
-    mongo::BSONObjBuilder builder;
     for(auto const & item: data_set)
     {
         auto const & tag = item.first;
@@ -199,6 +576,7 @@ mongo::BSONObj as_bson(
         if(tag == odil::registry::SpecificCharacterSet)
         {
             current_specific_char_set = element.as_string();
+            specific_char_set = &current_specific_char_set;
         }
 
         if(tag.element == 0)
@@ -207,20 +585,38 @@ mongo::BSONObj as_bson(
             continue;
         }
 
-        AsBSON const visitor(current_specific_char_set);
-        builder << std::string(tag) << odil::apply_visitor(visitor, element);
+        std::string const field(tag);
+        if(is_compact(tag, element.vr, schema))
+        {
+            BSONAppender const visitor(
+                builder, field, schema, *specific_char_set);
+            odil::apply_visitor(visitor, element);
+        }
+        else
+        {
+            // Verbose form, also used in the compact schema for the private
+            // tags and for the VRs which differ from the dictionary.
+            mongo::BSONObjBuilder element_builder(builder.subobjStart(field));
+            BSONAppender const visitor(
+                element_builder, field, Schema::Verbose, *specific_char_set);
+            odil::apply_visitor(visitor, element);
+            element_builder.done();
+        }
     }
-
-    return builder.obj();
 }
 
 odil::DataSet as_dataset(
     mongo::BSONObj const & bson,
     odil::Value::Strings const & specific_character_set)
 {
-    auto current_specific_char_set = specific_character_set;
+    static VRTable const vr_table;
+
+    odil::Value::Strings current_specific_char_set;
+    auto const * specific_char_set = &specific_character_set;
 
     odil::DataSet data_set;
+    // Re-used for the Person Names.
+    std::string buffer;
 
     for(auto it = bson.begin(); it.more();)
     {
@@ -232,134 +628,162 @@ odil::DataSet as_dataset(
             continue;
         }
 
-        // Skip elements that do not look like DICOM tags
-        odil::Tag tag;
-        try
-        {
-            tag = bson_element.fieldName();
-        }
-        catch(odil::Exception const &)
+        // Skip elements that are not DICOM tags written by as_bson, e.g. _id
+        // or the normalized values, without throwing.
+        odil::Tag tag(0, 0);
+        if(!parse_tag(bson_element.fieldName(), tag))
         {
             continue;
         }
 
-        mongo::BSONObj const object = bson_element.Obj();
-        std::shared_ptr<odil::Element> dicom_element;
-        auto const vr = odil::as_vr(object.getField("vr").String());
-
-        if(object.hasField("Value") && !object.getField("Value").isNull())
+        // Single pass over the fields of a verbose element; the values of a
+        // compact element are stored in its field.
+        bool has_vr = false;
+        odil::VR vr = odil::VR::UNKNOWN;
+        mongo::BSONElement value;
+        mongo::BSONElement inline_binary;
+        if(bson_element.type() == mongo::Object)
+        {
+            for(auto field_it = bson_element.Obj().begin(); field_it.more();)
+            {
+                auto const field = field_it.next();
+                auto const name = field.fieldNameStringData();
+                if(name == "vr")
+                {
+                    char const * data;
+                    std::size_t size;
+                    get_string(field, data, size);
+                    vr = vr_table.get(data, size);
+                    has_vr = true;
+                }
+                else if(name == "Value")
+                {
+                    value = field;
+                }
+                else if(name == "InlineBinary")
+                {
+                    inline_binary = field;
+                }
+            }
+        }
+        if(!has_vr)
         {
-            auto const values = object.getField("Value").Array();
+            if(!get_dictionary_vr(tag, vr))
+            {
+                throw Exception("No VR for "+std::string(tag));
+            }
+            if(odil::is_binary(vr))
+            {
+                inline_binary = bson_element;
+                value = mongo::BSONElement();
+            }
+            else
+            {
+                value = bson_element;
+            }
+        }
 
+        // The elements are added empty and filled in place.
+        if(!value.eoo() && !value.isNull())
+        {
+            Items items(value);
             if(odil::is_string(vr))
             {
-                dicom_element = std::make_shared<odil::Element>(
-                    odil::Value::Strings(), vr);
-                if(vr != odil::VR::PN)
+                data_set.add(tag, odil::Value::Strings(), vr);
+                auto & dicom_items = data_set.as_string(tag);
+                while(items.more())
                 {
-                    for(auto const & item: values)
+                    auto const bson_item = items.next();
+                    char const * data;
+                    std::size_t size;
+                    if(vr != odil::VR::PN)
                     {
-                        dicom_element->as_string().push_back(
-                            odil::as_specific_character_set(
-                                item.String(), current_specific_char_set));
+                        get_string(bson_item, data, size);
                     }
-                }
-                else
-                {
-                    for(auto const & bson_item: values)
+                    else
                     {
-                        odil::Value::Strings::value_type dicom_item;
+                        buffer.clear();
+                        auto const components = bson_item.Obj();
                         auto const fields = {
                             "Alphabetic", "Ideographic", "Phonetic" };
                         for(auto const & field: fields)
                         {
-                            if(bson_item.Obj().hasField(field))
+                            auto const component = components.getField(field);
+                            if(!component.eoo())
                             {
-                                dicom_item += bson_item.Obj().getField(field).String();
+                                get_string(component, data, size);
+                                buffer.append(data, size);
                             }
-                            dicom_item += "=";
-                        }
-
-                        while(*dicom_item.rbegin() == '=')
-                        {
-                            dicom_item = dicom_item.substr(0, dicom_item.size()-1);
+                            buffer += '=';
                         }
 
-                        dicom_element->as_string().push_back(
-                            odil::as_specific_character_set(
-                                dicom_item, current_specific_char_set));
+                        auto const end = buffer.find_last_not_of('=');
+                        buffer.erase(
+                            (end == std::string::npos)?0:end+1);
+                        data = buffer.c_str();
+                        size = buffer.size();
                     }
+
+                    append_string(
+                        data, size, *specific_char_set, dicom_items);
                 }
             }
             else if(odil::is_real(vr))
             {
-                dicom_element = std::make_shared<odil::Element>(
-                    odil::Value::Reals(), vr);
-
-                for(auto const & bson_item: values)
+                data_set.add(tag, odil::Value::Reals(), vr);
+                auto & dicom_items = data_set.as_real(tag);
+                while(items.more())
                 {
-                    dicom_element->as_real().push_back(bson_item.Double());
+                    dicom_items.push_back(items.next().Double());
                 }
             }
             else if(odil::is_int(vr))
             {
-                dicom_element = std::make_shared<odil::Element>(
-                    odil::Value::Integers(), vr);
-
-                for(auto const & bson_item: values)
+                data_set.add(tag, odil::Value::Integers(), vr);
+                auto & dicom_items = data_set.as_int(tag);
+                while(items.more())
                 {
-                    odil::Value::Integers::value_type dicom_item;
-                    if(bson_item.type() == mongo::BSONType::NumberLong)
-                    {
-                        dicom_item = bson_item.Long();
-                    }
-                    else if (bson_item.type() == mongo::BSONType::NumberDouble)
-                    {
-                        dicom_item = bson_item.Double();
-                    }
-                    else
-                    {
-                        dicom_item = bson_item.Int();
-                    }
-                    dicom_element->as_int().push_back(dicom_item);
+                    // Int, Long or Double
+                    dicom_items.push_back(items.next().numberLong());
                 }
             }
             else if(vr == odil::VR::SQ)
             {
-                dicom_element = std::make_shared<odil::Element>(
-                    odil::Value::DataSets(), vr);
-
-                for(auto const & bson_item: values)
+                data_set.add(tag, odil::Value::DataSets(), vr);
+                auto & dicom_items = data_set.as_data_set(tag);
+                while(items.more())
                 {
-                    auto const dicom_item = as_dataset(
-                        bson_item.Obj(), current_specific_char_set);
-                    dicom_element->as_data_set().push_back(dicom_item);
+                    dicom_items.push_back(
+                        as_dataset(items.next().Obj(), *specific_char_set));
                 }
             }
+            else
+            {
+                data_set.add(tag, odil::Element(vr));
+            }
         }
-        else if(object.hasField("InlineBinary") && !object.getField("InlineBinary").isNull())
+        else if(!inline_binary.eoo() && !inline_binary.isNull())
         {
-            dicom_element = std::make_shared<odil::Element>(
-                odil::Value::Binary(), vr);
-            auto const values = object.getField("InlineBinary").Array();
-            for(auto const & bson_item: values)
+            data_set.add(tag, odil::Value::Binary(), vr);
+            auto & dicom_items = data_set.as_binary(tag);
+            Items items(inline_binary);
+            while(items.more())
             {
                 int size=0;
-                char const * const begin = bson_item.binDataClean(size);
-                dicom_element->as_binary().emplace_back(begin, begin+size);
+                char const * const begin = items.next().binDataClean(size);
+                dicom_items.emplace_back(begin, begin+size);
             }
         }
         else
         {
-            dicom_element = std::make_shared<odil::Element>(vr);
+            data_set.add(tag, odil::Element(vr));
         }
 
         if(tag == odil::registry::SpecificCharacterSet)
         {
-            current_specific_char_set = dicom_element->as_string();
+            current_specific_char_set = data_set.as_string(tag);
+            specific_char_set = &current_specific_char_set;
         }
-        
-        data_set.add(tag, std::move(*dicom_element));
     }
 
     return data_set;
@@ -9,19 +9,84 @@
 #ifndef _c31aa1cf_ad8a_44f1_9d23_97c045ad81fd
 #define _c31aa1cf_ad8a_44f1_9d23_97c045ad81fd
 
+#include <string>
+
 #include <mongo/bson/bson.h>
 #include <odil/DataSet.h>
+#include <odil/Tag.h>
 #include <odil/Value.h>
+#include <odil/VR.h>
 
 namespace dopamine
 {
 
+/// @brief Layout of the data sets in BSON.
+enum class Schema
+{
+    /**
+     * @brief DICOM JSON-like layout: each element is a sub-document holding
+     * its VR and the array of its values, e.g.
+     * {"00100020": {"vr": "LO", "Value": ["1234"]}}.
+     */
+    Verbose,
+    /**
+     * @brief Public elements whose VR is the one of the dictionary store
+     * their values directly in their field, single values not in an array,
+     * e.g. {"00100020": "1234"}; the other elements use the verbose layout.
+     */
+    Compact
+};
+
+/**
+ * @brief Field of a person name holding the normalized form of its
+ * Alphabetic component, used by the indexed wildcard matching.
+ */
+extern std::string const normalized_alphabetic;
+
+/**
+ * @brief Return the normalized form of a person name, for case-insensitive
+ * matching: ASCII letters are upper-cased.
+ */
+std::string normalize_person_name(std::string const & value);
+
+/**
+ * @brief Return the schema from its name ("verbose" or "compact"); throw an
+ * exception if the name is unknown.
+ */
+Schema as_schema(std::string const & name);
+
+/// @brief Test whether an element is stored in the compact layout.
+bool is_compact(odil::Tag const & tag, odil::VR vr, Schema schema);
+
+/// @brief Return the path of the values of an element, e.g. for a query.
+std::string get_value_path(odil::Tag const & tag, odil::VR vr, Schema schema);
+
+/// @brief Return the path of the values of an element with dictionary VR.
+std::string get_value_path(odil::Tag const & tag, Schema schema);
+
+/**
+ * @brief Return the first value of an element stored with either schema,
+ * or an EOO element if it has no value. Array values, such as the results
+ * of a $group on a value path, are also accepted.
+ */
+mongo::BSONElement get_first_value(mongo::BSONElement const & element);
+
 /// @brief Convert a data set to its BSON representation.
 mongo::BSONObj as_bson(
     odil::DataSet const & data_set,
-    odil::Value::Strings const & specific_character_set = {});
+    odil::Value::Strings const & specific_character_set = {},
+    Schema schema = Schema::Verbose);
+
+/**
+ * @brief Append the BSON representation of a data set to a builder, in a
+ * single pass and without intermediate objects.
+ */
+void as_bson(
+    odil::DataSet const & data_set, mongo::BSONObjBuilder & builder,
+    odil::Value::Strings const & specific_character_set = {},
+    Schema schema = Schema::Verbose);
 
-/// @brief Create a data set from its BSON representation.
+/// @brief Create a data set from its BSON representation, in either schema.
 odil::DataSet as_dataset(
     mongo::BSONObj const & bson,
     odil::Value::Strings const & specific_character_set = {});
@@ -0,0 +1,43 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/bulk/BulkStorageBase.h"
+
+#include <memory>
+#include <string>
+
+#include "dopamine/bulk/View.h"
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+BulkStorageBase
+::BulkStorageBase()
+{
+    // Nothing to do.
+}
+
+BulkStorageBase
+::~BulkStorageBase()
+{
+    // Nothing to do.
+}
+
+std::shared_ptr<View>
+BulkStorageBase
+::view(std::string const & id) const
+{
+    return std::make_shared<StringView>(this->retrieve(id));
+}
+
+} // namespace bulk
+
+} // namespace dopamine
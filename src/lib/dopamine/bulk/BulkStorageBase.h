@@ -0,0 +1,76 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _fabcbc08_7eb3_468a_8e6a_7a1c783caa5f
+#define _fabcbc08_7eb3_468a_8e6a_7a1c783caa5f
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "dopamine/bulk/View.h"
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+/// @brief Abstract base class for the storages of bulk content outside MongoDB.
+class BulkStorageBase
+{
+public:
+    /// @brief Function writing the content to a stream buffer.
+    typedef std::function<void(std::streambuf &)> Writer;
+
+    /// @brief Constructor.
+    BulkStorageBase();
+
+    /// @brief Destructor.
+    virtual ~BulkStorageBase() =0;
+
+    /// @brief Return the name of the storage, recorded in the Content references.
+    virtual std::string get_name() const =0;
+
+    /**
+     * @brief Store the content written by the writer and return its
+     * identifier; throw an exception if the content cannot be stored.
+     */
+    virtual std::string store(Writer const & writer) =0;
+
+    /**
+     * @brief Return the content with given identifier; throw an exception if
+     * it cannot be read.
+     */
+    virtual std::string retrieve(std::string const & id) const =0;
+
+    /**
+     * @brief Return a view of the content with given identifier; throw an
+     * exception if it cannot be read. The default implementation owns the
+     * result of retrieve.
+     */
+    virtual std::shared_ptr<View> view(std::string const & id) const;
+
+    /// @brief Remove the content with given identifier, if it exists.
+    virtual void remove(std::string const & id) =0;
+
+    /**
+     * @brief Return the identifiers of the contents which were not stored
+     * since the given time.
+     */
+    virtual std::vector<std::string> list(std::time_t before) const =0;
+};
+
+} // namespace bulk
+
+} // namespace dopamine
+
+#endif // _fabcbc08_7eb3_468a_8e6a_7a1c783caa5f
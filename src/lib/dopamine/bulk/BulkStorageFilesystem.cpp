@@ -0,0 +1,367 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/bulk/BulkStorageFilesystem.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+#include <openssl/evp.h>
+
+#include "dopamine/bulk/BulkStorageBase.h"
+#include "dopamine/bulk/View.h"
+#include "dopamine/Exception.h"
+
+namespace
+{
+
+std::string get_error(std::string const & message, std::string const & path)
+{
+    return message+" '"+path+"': "+std::strerror(errno);
+}
+
+/// @brief Output stream buffer writing to a file descriptor and hashing.
+class FileWriter: public std::streambuf
+{
+public:
+    FileWriter(int fd, std::string const & path)
+    : _fd(fd), _path(path), _buffer(1024*1024, '\0'),
+      _context(EVP_MD_CTX_new(), EVP_MD_CTX_free)
+    {
+        if(!this->_context || !EVP_DigestInit_ex(
+            this->_context.get(), EVP_sha1(), nullptr))
+        {
+            throw dopamine::Exception("Could not initialize sha1");
+        }
+        this->setp(&this->_buffer[0], &this->_buffer[0]+this->_buffer.size());
+    }
+
+    /// @brief Write the pending data and return the hex digest.
+    std::string flush()
+    {
+        this->_write(this->pbase(), this->pptr()-this->pbase());
+        this->setp(&this->_buffer[0], &this->_buffer[0]+this->_buffer.size());
+
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int size = 0;
+        if(!EVP_DigestFinal_ex(this->_context.get(), digest, &size))
+        {
+            throw dopamine::Exception("Could not compute sha1");
+        }
+        std::ostringstream stream;
+        stream << std::hex << std::setfill('0');
+        for(unsigned int i=0; i<size; ++i)
+        {
+            stream << std::setw(2) << static_cast<unsigned int>(digest[i]);
+        }
+        return stream.str();
+    }
+
+protected:
+    virtual int_type overflow(int_type c)
+    {
+        this->_write(this->pbase(), this->pptr()-this->pbase());
+        this->setp(&this->_buffer[0], &this->_buffer[0]+this->_buffer.size());
+        if(!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *this->pptr() = traits_type::to_char_type(c);
+            this->pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    virtual std::streamsize xsputn(char const * s, std::streamsize count)
+    {
+        if(count < this->epptr()-this->pptr())
+        {
+            return std::streambuf::xsputn(s, count);
+        }
+
+        this->_write(this->pbase(), this->pptr()-this->pbase());
+        this->setp(&this->_buffer[0], &this->_buffer[0]+this->_buffer.size());
+        this->_write(s, count);
+        return count;
+    }
+
+private:
+    int _fd;
+    std::string _path;
+    std::string _buffer;
+    std::unique_ptr<EVP_MD_CTX, void(*)(EVP_MD_CTX*)> _context;
+
+    void _write(char const * data, std::size_t size)
+    {
+        EVP_DigestUpdate(this->_context.get(), data, size);
+        while(size > 0)
+        {
+            auto const written = ::write(this->_fd, data, size);
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                throw dopamine::Exception(
+                    get_error("Could not write", this->_path));
+            }
+            data += written;
+            size -= written;
+        }
+    }
+};
+
+void synchronize(std::string const & path, int flags)
+{
+    auto const fd = ::open(path.c_str(), flags);
+    if(fd < 0)
+    {
+        throw dopamine::Exception(get_error("Could not open", path));
+    }
+    auto const result = ::fsync(fd);
+    ::close(fd);
+    if(result != 0)
+    {
+        throw dopamine::Exception(get_error("Could not synchronize", path));
+    }
+}
+
+}
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+BulkStorageFilesystem
+::BulkStorageFilesystem(std::string const & root, bool fsync)
+: _root(root), _fsync(fsync)
+{
+    // Nothing else.
+}
+
+BulkStorageFilesystem
+::~BulkStorageFilesystem()
+{
+    // Nothing to do.
+}
+
+std::string const &
+BulkStorageFilesystem
+::get_root() const
+{
+    return this->_root;
+}
+
+bool
+BulkStorageFilesystem
+::get_fsync() const
+{
+    return this->_fsync;
+}
+
+std::string
+BulkStorageFilesystem
+::get_name() const
+{
+    return "filesystem";
+}
+
+std::string
+BulkStorageFilesystem
+::store(Writer const & writer)
+{
+    auto const temporary_directory =
+        boost::filesystem::path(this->_root)/"tmp";
+    boost::filesystem::create_directories(temporary_directory);
+    auto const temporary_path = (
+        temporary_directory
+        /boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%")).string();
+
+    auto const fd = ::open(
+        temporary_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if(fd < 0)
+    {
+        throw Exception(get_error("Could not create", temporary_path));
+    }
+
+    std::string id;
+    try
+    {
+        FileWriter file_writer(fd, temporary_path);
+        writer(file_writer);
+        id = file_writer.flush();
+        if(this->_fsync && ::fsync(fd) != 0)
+        {
+            throw Exception(
+                get_error("Could not synchronize", temporary_path));
+        }
+    }
+    catch(...)
+    {
+        ::close(fd);
+        boost::system::error_code error;
+        boost::filesystem::remove(temporary_path, error);
+        throw;
+    }
+    if(::close(fd) != 0)
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove(temporary_path, error);
+        throw Exception(get_error("Could not close", temporary_path));
+    }
+
+    auto const path = boost::filesystem::path(this->get_path(id));
+    if(boost::filesystem::exists(path))
+    {
+        // Same content already stored: make sure that it is not swept as
+        // an orphan before the new reference is written.
+        boost::filesystem::remove(temporary_path);
+        boost::system::error_code error;
+        boost::filesystem::last_write_time(path, std::time(nullptr), error);
+        return id;
+    }
+
+    boost::filesystem::create_directories(path.parent_path());
+    if(::rename(temporary_path.c_str(), path.c_str()) != 0)
+    {
+        auto const message = get_error("Could not rename", temporary_path);
+        boost::system::error_code error;
+        boost::filesystem::remove(temporary_path, error);
+        throw Exception(message);
+    }
+    if(this->_fsync)
+    {
+        synchronize(path.parent_path().string(), O_RDONLY | O_DIRECTORY);
+    }
+
+    return id;
+}
+
+std::string
+BulkStorageFilesystem
+::retrieve(std::string const & id) const
+{
+    auto const path = this->get_path(id);
+
+    auto const fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw Exception(get_error("Could not open", path));
+    }
+
+    struct stat status;
+    if(::fstat(fd, &status) != 0)
+    {
+        ::close(fd);
+        throw Exception(get_error("Could not stat", path));
+    }
+
+    // Read directly in the pre-allocated result.
+    std::string content(status.st_size, '\0');
+    std::size_t offset = 0;
+    while(offset < content.size())
+    {
+        auto const size = ::read(
+            fd, &content[0]+offset, content.size()-offset);
+        if(size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if(size <= 0)
+        {
+            auto const message = get_error("Could not read", path);
+            ::close(fd);
+            throw Exception(message);
+        }
+        offset += size;
+    }
+    ::close(fd);
+
+    return content;
+}
+
+std::shared_ptr<View>
+BulkStorageFilesystem
+::view(std::string const & id) const
+{
+    return std::make_shared<MappedView>(this->get_path(id));
+}
+
+void
+BulkStorageFilesystem
+::remove(std::string const & id)
+{
+    boost::filesystem::remove(this->get_path(id));
+}
+
+std::vector<std::string>
+BulkStorageFilesystem
+::list(std::time_t before) const
+{
+    std::vector<std::string> ids;
+    if(!boost::filesystem::exists(this->_root))
+    {
+        return ids;
+    }
+
+    boost::filesystem::recursive_directory_iterator it(this->_root);
+    for(; it != boost::filesystem::recursive_directory_iterator(); ++it)
+    {
+        auto const & path = it->path();
+        auto const id = path.filename().string();
+        // Skip the temporary files and anything not stored by this object.
+        if(
+            !boost::filesystem::is_regular_file(it->status())
+            || id.size() < 4
+            || id.find_first_not_of("0123456789abcdef") != std::string::npos
+            || path != boost::filesystem::path(this->get_path(id)))
+        {
+            continue;
+        }
+        if(boost::filesystem::last_write_time(path) < before)
+        {
+            ids.push_back(id);
+        }
+    }
+
+    return ids;
+}
+
+std::string
+BulkStorageFilesystem
+::get_path(std::string const & id) const
+{
+    // Do not let an invalid identifier escape the root directory.
+    if(
+        id.size() < 4
+        || id.find_first_not_of("0123456789abcdef") != std::string::npos)
+    {
+        throw Exception("Invalid identifier: '"+id+"'");
+    }
+
+    return (
+        boost::filesystem::path(this->_root)
+        /id.substr(0, 2)/id.substr(2, 2)/id).string();
+}
+
+} // namespace bulk
+
+} // namespace dopamine
@@ -0,0 +1,79 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _811e7d82_b9e9_4bfd_a01c_f428541203f0
+#define _811e7d82_b9e9_4bfd_a01c_f428541203f0
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dopamine/bulk/BulkStorageBase.h"
+#include "dopamine/bulk/View.h"
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+/**
+ * @brief Content-addressed storage in a local directory.
+ *
+ * The identifier of a content is its SHA-1 digest, and the content is stored
+ * in root/ab/cd/abcd... . Contents are first written in root/tmp, then
+ * renamed, so that a file is either complete or absent. Identical contents
+ * are stored once, storing an existing content updates its modification
+ * time.
+ */
+class BulkStorageFilesystem: public BulkStorageBase
+{
+public:
+    /**
+     * @brief Constructor; if fsync is true, the files and their directory are
+     * synchronized to disk before store returns.
+     */
+    BulkStorageFilesystem(std::string const & root, bool fsync=true);
+
+    /// @brief Destructor.
+    virtual ~BulkStorageFilesystem();
+
+    /// @brief Return the root directory.
+    std::string const & get_root() const;
+
+    /// @brief Test whether the stored files are synchronized to disk.
+    bool get_fsync() const;
+
+    virtual std::string get_name() const;
+
+    virtual std::string store(Writer const & writer);
+
+    virtual std::string retrieve(std::string const & id) const;
+
+    /// @brief Return a memory-mapped view of the file.
+    virtual std::shared_ptr<View> view(std::string const & id) const;
+
+    virtual void remove(std::string const & id);
+
+    /// @brief Return the contents whose file was last modified before.
+    virtual std::vector<std::string> list(std::time_t before) const;
+
+    /// @brief Return the path of the content with given identifier.
+    std::string get_path(std::string const & id) const;
+
+private:
+    std::string _root;
+    bool _fsync;
+};
+
+} // namespace bulk
+
+} // namespace dopamine
+
+#endif // _811e7d82_b9e9_4bfd_a01c_f428541203f0
@@ -0,0 +1,170 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/bulk/View.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <streambuf>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dopamine/Exception.h"
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+View
+::~View()
+{
+    // Nothing to do.
+}
+
+StringView
+::StringView(std::string content)
+: _content(std::move(content))
+{
+    // Nothing else.
+}
+
+char const *
+StringView
+::data() const
+{
+    return this->_content.data();
+}
+
+std::size_t
+StringView
+::size() const
+{
+    return this->_content.size();
+}
+
+MappedView
+::MappedView(std::string const & path)
+: _data(nullptr), _size(0)
+{
+    auto const fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw Exception(
+            "Could not open '"+path+"': "+std::strerror(errno));
+    }
+
+    struct stat status;
+    if(::fstat(fd, &status) != 0)
+    {
+        auto const message = std::string(std::strerror(errno));
+        ::close(fd);
+        throw Exception("Could not stat '"+path+"': "+message);
+    }
+    this->_size = status.st_size;
+
+    // Empty files cannot be mapped.
+    if(this->_size > 0)
+    {
+        this->_data = ::mmap(
+            nullptr, this->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(this->_data == MAP_FAILED)
+        {
+            auto const message = std::string(std::strerror(errno));
+            ::close(fd);
+            throw Exception("Could not map '"+path+"': "+message);
+        }
+        // The content is read once, from start to end.
+        ::madvise(this->_data, this->_size, MADV_SEQUENTIAL);
+    }
+
+    // The mapping remains valid after the file is closed.
+    ::close(fd);
+}
+
+MappedView
+::~MappedView()
+{
+    if(this->_data != nullptr)
+    {
+        ::munmap(this->_data, this->_size);
+    }
+}
+
+char const *
+MappedView
+::data() const
+{
+    return static_cast<char const *>(this->_data);
+}
+
+std::size_t
+MappedView
+::size() const
+{
+    return this->_size;
+}
+
+ViewBuffer
+::ViewBuffer(char const * data, std::size_t size)
+{
+    // The get area is never written to.
+    auto * begin = const_cast<char *>(data);
+    this->setg(begin, begin, begin+size);
+}
+
+ViewBuffer::pos_type
+ViewBuffer
+::seekoff(
+    off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+    if(!(which & std::ios_base::in))
+    {
+        return pos_type(off_type(-1));
+    }
+
+    off_type position = 0;
+    if(dir == std::ios_base::beg)
+    {
+        position = off;
+    }
+    else if(dir == std::ios_base::cur)
+    {
+        position = (this->gptr()-this->eback())+off;
+    }
+    else
+    {
+        position = (this->egptr()-this->eback())+off;
+    }
+
+    if(position < 0 || position > this->egptr()-this->eback())
+    {
+        return pos_type(off_type(-1));
+    }
+
+    this->setg(this->eback(), this->eback()+position, this->egptr());
+    return pos_type(position);
+}
+
+ViewBuffer::pos_type
+ViewBuffer
+::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return this->seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+} // namespace bulk
+
+} // namespace dopamine
@@ -0,0 +1,93 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _377c9a3e_3f8b_4a01_b389_14db7219e41c
+#define _377c9a3e_3f8b_4a01_b389_14db7219e41c
+
+#include <cstddef>
+#include <streambuf>
+#include <string>
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+/// @brief Read-only view of a stored content, valid as long as it exists.
+class View
+{
+public:
+    /// @brief Destructor.
+    virtual ~View();
+
+    /// @brief Return the first byte of the content.
+    virtual char const * data() const =0;
+
+    /// @brief Return the size of the content.
+    virtual std::size_t size() const =0;
+};
+
+/// @brief View owning its content in a string.
+class StringView: public View
+{
+public:
+    /// @brief Constructor.
+    StringView(std::string content);
+
+    virtual char const * data() const;
+    virtual std::size_t size() const;
+
+private:
+    std::string _content;
+};
+
+/// @brief View of a read-only memory-mapped file.
+class MappedView: public View
+{
+public:
+    /// @brief Map the file; throw an exception if it cannot be mapped.
+    MappedView(std::string const & path);
+
+    /// @brief Destructor, unmap the file.
+    virtual ~MappedView();
+
+    MappedView(MappedView const &) = delete;
+    MappedView & operator=(MappedView const &) = delete;
+
+    virtual char const * data() const;
+    virtual std::size_t size() const;
+
+private:
+    void * _data;
+    std::size_t _size;
+};
+
+/**
+ * @brief Input stream buffer reading directly from memory, e.g. from a
+ * View, so that the content is never copied to a stream.
+ */
+class ViewBuffer: public std::streambuf
+{
+public:
+    /// @brief Constructor.
+    ViewBuffer(char const * data, std::size_t size);
+
+protected:
+    virtual pos_type seekoff(
+        off_type off, std::ios_base::seekdir dir,
+        std::ios_base::openmode which=std::ios_base::in);
+    virtual pos_type seekpos(
+        pos_type pos, std::ios_base::openmode which=std::ios_base::in);
+};
+
+} // namespace bulk
+
+} // namespace dopamine
+
+#endif // _377c9a3e_3f8b_4a01_b389_14db7219e41c
@@ -0,0 +1,51 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#include "dopamine/bulk/factory.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "dopamine/bulk/BulkStorageBase.h"
+#include "dopamine/bulk/BulkStorageFilesystem.h"
+#include "dopamine/Exception.h"
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+std::shared_ptr<BulkStorageBase> factory(
+    std::map<std::string, std::string> const & properties)
+{
+    auto const type_it = properties.find("type");
+    auto const type = (type_it != properties.end())?type_it->second:"MongoDB";
+    if(type == "MongoDB")
+    {
+        return nullptr;
+    }
+    else if(type == "Filesystem")
+    {
+        auto const fsync_it = properties.find("fsync");
+        bool const fsync = (
+            fsync_it == properties.end()
+            || (fsync_it->second != "false" && fsync_it->second != "0"));
+        return std::make_shared<BulkStorageFilesystem>(
+            properties.at("root"), fsync);
+    }
+    else
+    {
+        throw Exception("Unknown bulk storage type: "+type);
+    }
+}
+
+}
+
+}
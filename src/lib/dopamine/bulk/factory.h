@@ -0,0 +1,35 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#ifndef _e47271c6_8662_4b67_8c6c_065cc2c36e41
+#define _e47271c6_8662_4b67_8c6c_065cc2c36e41
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "dopamine/bulk/BulkStorageBase.h"
+
+namespace dopamine
+{
+
+namespace bulk
+{
+
+/**
+ * @brief Create the bulk storage described by the properties; return null
+ * if the bulk content is stored in MongoDB.
+ */
+std::shared_ptr<BulkStorageBase> factory(
+    std::map<std::string, std::string> const & properties);
+
+}
+
+}
+
+#endif // _e47271c6_8662_4b67_8c6c_065cc2c36e41
@@ -0,0 +1,152 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+// Allocations and duration of the conversion of a sequence-heavy data set,
+// similar to an enhanced MR image, to BSON.
+// Usage: benchmark_as_bson [frames] [iterations]
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <mongo/bson/bson.h>
+#include <odil/DataSet.h>
+#include <odil/registry.h>
+#include <odil/Value.h>
+#include <odil/VR.h>
+
+#include "dopamine/bson_converter.h"
+
+namespace
+{
+
+std::atomic<std::size_t> allocations(0);
+
+odil::DataSet get_data_set(unsigned int frames)
+{
+    namespace registry = odil::registry;
+    typedef odil::Value Value;
+
+    odil::DataSet data_set;
+    data_set.add(
+        registry::SOPClassUID,
+        Value::Strings{registry::EnhancedMRImageStorage});
+    data_set.add(registry::SOPInstanceUID, Value::Strings{"1.2.3.4.5.6.7.8.9"});
+    data_set.add(registry::PatientName, Value::Strings{"Doe^John"});
+    data_set.add(registry::NumberOfFrames, Value::Integers{frames});
+
+    Value::DataSets per_frame;
+    for(unsigned int i=0; i<frames; ++i)
+    {
+        odil::DataSet frame_content;
+        frame_content.add(
+            registry::DimensionIndexValues, Value::Integers{1, i+1});
+        frame_content.add(registry::StackID, Value::Strings{"1"});
+        frame_content.add(
+            registry::InStackPositionNumber, Value::Integers{i+1});
+
+        odil::DataSet plane_position;
+        plane_position.add(
+            registry::ImagePositionPatient, Value::Reals{-120., -100., 2.5*i});
+
+        odil::DataSet plane_orientation;
+        plane_orientation.add(
+            registry::ImageOrientationPatient,
+            Value::Reals{1., 0., 0., 0., 1., 0.});
+
+        odil::DataSet transformation;
+        transformation.add(registry::RescaleIntercept, Value::Reals{0.});
+        transformation.add(registry::RescaleSlope, Value::Reals{1.});
+        transformation.add(registry::RescaleType, Value::Strings{"US"});
+
+        odil::DataSet frame;
+        frame.add(
+            registry::FrameContentSequence, Value::DataSets{frame_content});
+        frame.add(
+            registry::PlanePositionSequence, Value::DataSets{plane_position});
+        frame.add(
+            registry::PlaneOrientationSequence,
+            Value::DataSets{plane_orientation});
+        frame.add(
+            registry::PixelValueTransformationSequence,
+            Value::DataSets{transformation});
+        per_frame.push_back(frame);
+    }
+    data_set.add(registry::PerFrameFunctionalGroupsSequence, per_frame);
+
+    return data_set;
+}
+
+template<typename TFunction>
+void run(std::string const & name, unsigned int iterations, TFunction function)
+{
+    // Warm-up, e.g. growth of the reusable buffers.
+    function();
+
+    auto const allocations_begin = allocations.load();
+    auto const begin = std::chrono::steady_clock::now();
+    for(unsigned int i=0; i<iterations; ++i)
+    {
+        function();
+    }
+    auto const end = std::chrono::steady_clock::now();
+    auto const allocations_end = allocations.load();
+
+    std::cout
+        << name << ": "
+        << double(allocations_end-allocations_begin)/iterations
+        << " allocations, "
+        << std::chrono::duration_cast<std::chrono::microseconds>(
+            end-begin).count()/double(iterations)
+        << " us per data set" << std::endl;
+}
+
+}
+
+void * operator new(std::size_t size)
+{
+    ++allocations;
+    auto * pointer = std::malloc(size);
+    if(pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int const frames = (argc>1)?std::stoul(argv[1]):200;
+    unsigned int const iterations = (argc>2)?std::stoul(argv[2]):100;
+
+    auto const data_set = get_data_set(frames);
+    std::cout
+        << frames << " frames, " << iterations << " iterations" << std::endl;
+
+    run("as_bson", iterations, [&]() { dopamine::as_bson(data_set); });
+
+    // Appending to a caller-provided buffer, e.g. the one of a document.
+    mongo::BufBuilder buffer;
+    run("as_bson (builder)", iterations, [&]() {
+        buffer.reset();
+        mongo::BSONObjBuilder builder(buffer);
+        dopamine::as_bson(data_set, builder);
+        builder.done();
+    });
+
+    return EXIT_SUCCESS;
+}
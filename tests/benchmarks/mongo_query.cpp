@@ -0,0 +1,117 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+// Duration of the translation of a study-level C-FIND query to MongoDB, with
+// and without the query plan cache, from concurrent associations.
+// Usage: benchmark_mongo_query [threads] [iterations]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mongo/bson/bson.h>
+#include <odil/DataSet.h>
+#include <odil/registry.h>
+#include <odil/Value.h>
+
+#include "dopamine/archive/mongo_query.h"
+#include "dopamine/archive/QueryPlanCache.h"
+#include "dopamine/bson_converter.h"
+
+namespace
+{
+
+odil::DataSet get_query()
+{
+    namespace registry = odil::registry;
+    typedef odil::Value Value;
+
+    odil::DataSet query;
+    query.add(registry::QueryRetrieveLevel, Value::Strings{"STUDY"});
+    query.add(registry::PatientName, Value::Strings{"Doe*"});
+    query.add(registry::PatientID, Value::Strings{"1234"});
+    query.add(registry::PatientBirthDate);
+    query.add(registry::PatientSex);
+    query.add(registry::StudyDate, Value::Strings{"20060101-20061231"});
+    query.add(registry::StudyTime, Value::Strings{"0800-1800"});
+    query.add(registry::AccessionNumber);
+    query.add(registry::StudyID);
+    query.add(registry::StudyInstanceUID);
+    query.add(registry::ModalitiesInStudy, Value::Strings{"MR"});
+    query.add(registry::StudyDescription);
+    query.add(registry::ReferringPhysicianName);
+    query.add(registry::NumberOfStudyRelatedSeries);
+    query.add(registry::NumberOfStudyRelatedInstances);
+
+    return query;
+}
+
+void run(
+    std::string const & name, unsigned int threads, unsigned int iterations,
+    dopamine::archive::QueryPlanCache * cache)
+{
+    auto const query = get_query();
+    auto const translate = [&]() {
+        mongo::BSONArrayBuilder terms;
+        mongo::BSONObjBuilder fields;
+        dopamine::archive::as_mongo_query(
+            query, terms, fields, dopamine::Schema::Verbose, cache);
+    };
+
+    // Warm-up, e.g. insertion of the plan in the cache.
+    translate();
+
+    auto const begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(unsigned int i=0; i<threads; ++i)
+    {
+        workers.emplace_back([&]() {
+            for(unsigned int j=0; j<iterations; ++j)
+            {
+                translate();
+            }
+        });
+    }
+    for(auto & worker: workers)
+    {
+        worker.join();
+    }
+    auto const end = std::chrono::steady_clock::now();
+
+    std::cout
+        << name << ": "
+        << std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end-begin).count()/double(threads*iterations)
+        << " ns per query" << std::endl;
+}
+
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int const threads = (argc>1)?std::stoul(argv[1]):4;
+    unsigned int const iterations = (argc>2)?std::stoul(argv[2]):100000;
+
+    std::cout
+        << threads << " threads, " << iterations << " iterations"
+        << std::endl;
+
+    run("no cache, 1 thread", 1, iterations, nullptr);
+
+    dopamine::archive::QueryPlanCache cache;
+    run("cache, 1 thread", 1, iterations, &cache);
+
+    auto const suffix = ", "+std::to_string(threads)+" threads";
+    run("no cache"+suffix, threads, iterations, nullptr);
+    run("cache"+suffix, threads, iterations, &cache);
+
+    return EXIT_SUCCESS;
+}
@@ -10,7 +10,9 @@
 #include <boost/test/unit_test.hpp>
 
 #include <algorithm>
+#include <chrono>
 #include <string>
+#include <thread>
 
 #include <mongo/bson/bson.h>
 
@@ -36,13 +38,13 @@ struct Fixture: fixtures::MongoDB
 
 BOOST_FIXTURE_TEST_CASE(Empty, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     BOOST_REQUIRE(acl.get_entries().empty());
 }
 
 BOOST_FIXTURE_TEST_CASE(Entries, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({
         { "principal1", "Echo", BSON("foo" << "bar") },
         { "principal2", "Query", BSON("plip" << "plop") } });
@@ -67,84 +69,84 @@ BOOST_FIXTURE_TEST_CASE(Entries, Fixture)
 
 BOOST_FIXTURE_TEST_CASE(UnAuthenticatedWithNamed, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "principal", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(!acl.is_allowed("", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(UnAuthenticatedWithWildcard, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "*", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(!acl.is_allowed("", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(UnAuthenticated, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(acl.is_allowed("", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(UnAuthenticatedOtherService, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "", "Store", mongo::BSONObj() } });
     BOOST_REQUIRE(!acl.is_allowed("", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(AuthenticatedWithNamed, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "principal", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(acl.is_allowed("principal", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(AuthenticatedWithWildcard, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "*", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(acl.is_allowed("principal", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(Authenticated, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "principal", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(acl.is_allowed("principal", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(AuthenticatedOtherPrincipal, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "principal2", "Echo", mongo::BSONObj() } });
     BOOST_REQUIRE(!acl.is_allowed("principal1", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(AuthenticatedOtherService, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "principal", "Store", mongo::BSONObj() } });
     BOOST_REQUIRE(!acl.is_allowed("principal", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(UnAuthenticatedServiceWildcard, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "", "*", mongo::BSONObj() } });
     BOOST_REQUIRE(acl.is_allowed("", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(AuthenticatedServiceWildcard, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({{ "principal", "*", mongo::BSONObj() } });
     BOOST_REQUIRE(acl.is_allowed("principal", "Echo"));
 }
 
 BOOST_FIXTURE_TEST_CASE(Constraints, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({
         { "principal", "Store", BSON("foo" << "bar") },
         { "principal", "Store", BSON("plip" << "plop") },
@@ -160,7 +162,7 @@ BOOST_FIXTURE_TEST_CASE(Constraints, Fixture)
 
 BOOST_FIXTURE_TEST_CASE(ConstraintsPassThrough, Fixture)
 {
-    dopamine::AccessControlList acl(this->connection, this->database);
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
     acl.set_entries({
         { "principal", "Store", BSON("foo" << "bar") },
         { "principal", "Echo", BSON("plip" << "plop") },
@@ -169,3 +171,64 @@ BOOST_FIXTURE_TEST_CASE(ConstraintsPassThrough, Fixture)
     auto const constraints = acl.get_constraints("principal", "Store");
     BOOST_REQUIRE(constraints.isEmpty());
 }
+
+BOOST_FIXTURE_TEST_CASE(CacheTTL, Fixture)
+{
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
+    BOOST_REQUIRE(acl.get_cache_ttl() == std::chrono::seconds(60));
+    acl.set_cache_ttl(std::chrono::seconds(1));
+    BOOST_REQUIRE(acl.get_cache_ttl() == std::chrono::seconds(1));
+}
+
+BOOST_FIXTURE_TEST_CASE(Cache, Fixture)
+{
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
+    acl.set_entries({{ "principal", "Query", BSON("foo" << "bar") } });
+    BOOST_REQUIRE(acl.is_allowed("principal", "Query"));
+    auto const constraints = acl.get_constraints("principal", "Query");
+
+    // Modify the entries without the ACL object: the results are cached.
+    this->connection.remove(this->collection, mongo::Query());
+    BOOST_REQUIRE(acl.is_allowed("principal", "Query"));
+    BOOST_REQUIRE(acl.get_constraints("principal", "Query") == constraints);
+
+    acl.reload();
+    BOOST_REQUIRE(!acl.is_allowed("principal", "Query"));
+    BOOST_REQUIRE(acl.get_constraints("principal", "Query").isEmpty());
+}
+
+BOOST_FIXTURE_TEST_CASE(CacheSetEntries, Fixture)
+{
+    dopamine::AccessControlList acl(this->connection_pool, this->database);
+    acl.set_entries({{ "principal", "Query", mongo::BSONObj() } });
+    BOOST_REQUIRE(acl.is_allowed("principal", "Query"));
+
+    acl.set_entries({{ "principal", "Echo", mongo::BSONObj() } });
+    BOOST_REQUIRE(!acl.is_allowed("principal", "Query"));
+    BOOST_REQUIRE(acl.is_allowed("principal", "Echo"));
+}
+
+BOOST_FIXTURE_TEST_CASE(CacheExpiration, Fixture)
+{
+    dopamine::AccessControlList acl(
+        this->connection_pool, this->database, std::chrono::seconds(1));
+    acl.set_entries({{ "principal", "Query", mongo::BSONObj() } });
+    BOOST_REQUIRE(acl.is_allowed("principal", "Query"));
+
+    this->connection.remove(this->collection, mongo::Query());
+    BOOST_REQUIRE(acl.is_allowed("principal", "Query"));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    BOOST_REQUIRE(!acl.is_allowed("principal", "Query"));
+}
+
+BOOST_FIXTURE_TEST_CASE(NoCache, Fixture)
+{
+    dopamine::AccessControlList acl(
+        this->connection_pool, this->database, std::chrono::seconds(0));
+    acl.set_entries({{ "principal", "Query", mongo::BSONObj() } });
+    BOOST_REQUIRE(acl.is_allowed("principal", "Query"));
+
+    this->connection.remove(this->collection, mongo::Query());
+    BOOST_REQUIRE(!acl.is_allowed("principal", "Query"));
+}
@@ -31,9 +31,28 @@ BOOST_AUTO_TEST_CASE(Minimal)
     BOOST_REQUIRE(configuration.is_valid());
     BOOST_REQUIRE_EQUAL(configuration.get_mongo_host(), "pacs.example.com");
     BOOST_REQUIRE_EQUAL(configuration.get_mongo_port(), 27017);
+    BOOST_REQUIRE_EQUAL(configuration.get_min_connections(), 1);
+    BOOST_REQUIRE_EQUAL(configuration.get_max_connections(), 16);
+    BOOST_REQUIRE_EQUAL(configuration.get_idle_timeout(), 60);
+    BOOST_REQUIRE_EQUAL(configuration.get_batch_count(), 1);
+    BOOST_REQUIRE_EQUAL(configuration.get_batch_size(), 8000000);
+    BOOST_REQUIRE_EQUAL(configuration.get_batch_delay(), 10);
+    BOOST_REQUIRE_EQUAL(configuration.get_acl_cache_ttl(), 60);
+    BOOST_REQUIRE_EQUAL(configuration.get_gridfs_chunk_size(), 261120);
+    BOOST_REQUIRE_EQUAL(configuration.get_gridfs_readers(), 4);
+    BOOST_REQUIRE_EQUAL(configuration.get_compression_level(), 0);
+    BOOST_REQUIRE_EQUAL(configuration.get_compression_min_size(), 65536);
+    BOOST_REQUIRE_EQUAL(configuration.get_duplicates(), "none");
+    BOOST_REQUIRE_EQUAL(configuration.get_schema(), "verbose");
+    BOOST_REQUIRE(configuration.get_indexes().empty());
+    BOOST_REQUIRE_EQUAL(configuration.get_index_report_threshold(), 100);
     BOOST_REQUIRE_EQUAL(configuration.get_database(), "dopamine");
     BOOST_REQUIRE_EQUAL(configuration.get_bulk_database(), "");
     BOOST_REQUIRE_EQUAL(configuration.get_archive_port(), 11112);
+    BOOST_REQUIRE_EQUAL(configuration.get_max_associations(), 1);
+    BOOST_REQUIRE_EQUAL(configuration.get_retrieve_prefetch(), 2);
+    BOOST_REQUIRE_EQUAL(configuration.get_query_plan_cache_size(), 256);
+    BOOST_REQUIRE(configuration.get_bulk_storage().empty());
     std::map<std::string, std::string> const authentication{{"type", "None"}};
     BOOST_REQUIRE(configuration.get_authentication() == authentication);
     BOOST_REQUIRE_EQUAL(configuration.get_logger_priority(), "WARN");
@@ -46,10 +65,32 @@ BOOST_AUTO_TEST_CASE(Full)
     stream << "[database]" << "\n";
     stream << "hostname = pacs.example.com" << "\n";
     stream << "port = 1234" << "\n";
+    stream << "min_connections = 4" << "\n";
+    stream << "max_connections = 64" << "\n";
+    stream << "idle_timeout = 300" << "\n";
+    stream << "batch_count = 50" << "\n";
+    stream << "batch_size = 1000000" << "\n";
+    stream << "batch_delay = 5" << "\n";
+    stream << "acl_cache_ttl = 0" << "\n";
+    stream << "gridfs_chunk_size = 1048576" << "\n";
+    stream << "gridfs_readers = 8" << "\n";
+    stream << "compression_level = 3" << "\n";
+    stream << "compression_min_size = 1024" << "\n";
+    stream << "duplicates = version" << "\n";
+    stream << "schema = compact" << "\n";
+    stream << "index_report_threshold = 10" << "\n";
     stream << "dbname = dopamine" << "\n";
     stream << "bulk_data = other" << "\n";
     stream << "[dicom]" << "\n";
     stream << "port = 11112" << "\n";
+    stream << "max_associations = 32" << "\n";
+    stream << "retrieve_prefetch = 8" << "\n";
+    stream << "query_plan_cache_size = 16" << "\n";
+    stream << "[indexes]" << "\n";
+    stream << "referring = 00080090" << "\n";
+    stream << "[bulk_storage]" << "\n";
+    stream << "type = Filesystem" << "\n";
+    stream << "root = /var/lib/dopamine" << "\n";
     stream << "[authentication]" << "\n";
     stream << "type = None" << "\n";
     stream << "[logger]" << "\n";
@@ -60,9 +101,31 @@ BOOST_AUTO_TEST_CASE(Full)
     BOOST_REQUIRE(configuration.is_valid());
     BOOST_REQUIRE_EQUAL(configuration.get_mongo_host(), "pacs.example.com");
     BOOST_REQUIRE_EQUAL(configuration.get_mongo_port(), 1234);
+    BOOST_REQUIRE_EQUAL(configuration.get_min_connections(), 4);
+    BOOST_REQUIRE_EQUAL(configuration.get_max_connections(), 64);
+    BOOST_REQUIRE_EQUAL(configuration.get_idle_timeout(), 300);
+    BOOST_REQUIRE_EQUAL(configuration.get_batch_count(), 50);
+    BOOST_REQUIRE_EQUAL(configuration.get_batch_size(), 1000000);
+    BOOST_REQUIRE_EQUAL(configuration.get_batch_delay(), 5);
+    BOOST_REQUIRE_EQUAL(configuration.get_acl_cache_ttl(), 0);
+    BOOST_REQUIRE_EQUAL(configuration.get_gridfs_chunk_size(), 1048576);
+    BOOST_REQUIRE_EQUAL(configuration.get_gridfs_readers(), 8);
+    BOOST_REQUIRE_EQUAL(configuration.get_compression_level(), 3);
+    BOOST_REQUIRE_EQUAL(configuration.get_compression_min_size(), 1024);
+    BOOST_REQUIRE_EQUAL(configuration.get_duplicates(), "version");
+    BOOST_REQUIRE_EQUAL(configuration.get_schema(), "compact");
+    std::map<std::string, std::string> const indexes{{"referring", "00080090"}};
+    BOOST_REQUIRE(configuration.get_indexes() == indexes);
+    BOOST_REQUIRE_EQUAL(configuration.get_index_report_threshold(), 10);
     BOOST_REQUIRE_EQUAL(configuration.get_database(), "dopamine");
     BOOST_REQUIRE_EQUAL(configuration.get_bulk_database(), "other");
     BOOST_REQUIRE_EQUAL(configuration.get_archive_port(), 11112);
+    BOOST_REQUIRE_EQUAL(configuration.get_max_associations(), 32);
+    BOOST_REQUIRE_EQUAL(configuration.get_retrieve_prefetch(), 8);
+    BOOST_REQUIRE_EQUAL(configuration.get_query_plan_cache_size(), 16);
+    std::map<std::string, std::string> const bulk_storage{
+        {"type", "Filesystem"}, {"root", "/var/lib/dopamine"}};
+    BOOST_REQUIRE(configuration.get_bulk_storage() == bulk_storage);
     std::map<std::string, std::string> const authentication{{"type", "None"}};
     BOOST_REQUIRE(configuration.get_authentication() == authentication);
     BOOST_REQUIRE_EQUAL(configuration.get_logger_priority(), "INFO");
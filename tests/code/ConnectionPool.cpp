@@ -0,0 +1,130 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE ConnectionPool
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/ConnectionPool.h"
+#include "dopamine/Exception.h"
+
+#include "fixtures/MongoDB.h"
+
+struct Fixture: public fixtures::MongoDB
+{
+    // Nothing else.
+};
+
+BOOST_FIXTURE_TEST_CASE(Constructor, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost", 2, 4, std::chrono::seconds(10));
+    BOOST_REQUIRE_EQUAL(pool.get_host(), "localhost");
+    BOOST_REQUIRE_EQUAL(pool.get_min_connections(), 2);
+    BOOST_REQUIRE_EQUAL(pool.get_max_connections(), 4);
+    BOOST_REQUIRE(pool.get_idle_timeout() == std::chrono::seconds(10));
+    BOOST_REQUIRE_EQUAL(pool.size(), 0);
+    BOOST_REQUIRE_EQUAL(pool.idle(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(AcquireRelease, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost");
+    {
+        auto connection = pool.acquire();
+        BOOST_REQUIRE(!connection->isFailed());
+        BOOST_REQUIRE_EQUAL(pool.size(), 1);
+        BOOST_REQUIRE_EQUAL(pool.idle(), 0);
+    }
+    BOOST_REQUIRE_EQUAL(pool.size(), 1);
+    BOOST_REQUIRE_EQUAL(pool.idle(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(Reuse, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost");
+    mongo::DBClientConnection * first = nullptr;
+    {
+        auto connection = pool.acquire();
+        first = &(*connection);
+    }
+    {
+        auto connection = pool.acquire();
+        BOOST_REQUIRE_EQUAL(&(*connection), first);
+    }
+    BOOST_REQUIRE_EQUAL(pool.size(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(Concurrent, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost");
+    auto connection_1 = pool.acquire();
+    auto connection_2 = pool.acquire();
+    BOOST_REQUIRE(&(*connection_1) != &(*connection_2));
+    BOOST_REQUIRE_EQUAL(pool.size(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(MaxConnections, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost", 1, 1);
+    pool.set_acquire_timeout(std::chrono::seconds(1));
+    auto connection = pool.acquire();
+    BOOST_REQUIRE_THROW(pool.acquire(), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(TryAcquire, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost", 1, 1);
+    auto connection = pool.try_acquire();
+    BOOST_REQUIRE(connection);
+    BOOST_REQUIRE(!pool.try_acquire());
+
+    connection.reset();
+    BOOST_REQUIRE(pool.try_acquire());
+}
+
+BOOST_FIXTURE_TEST_CASE(WaitForConnection, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost", 1, 1);
+    auto connection = std::make_shared<dopamine::ConnectionPool::Connection>(
+        pool.acquire());
+    std::thread release(
+        [connection]() mutable {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            connection.reset();
+        });
+    connection.reset();
+
+    // Blocks until the connection is released by the other thread.
+    auto other = pool.acquire();
+    BOOST_REQUIRE_EQUAL(pool.size(), 1);
+    release.join();
+}
+
+BOOST_FIXTURE_TEST_CASE(IdleTimeout, Fixture)
+{
+    dopamine::ConnectionPool pool("localhost", 0, 4, std::chrono::seconds(0));
+    {
+        auto connection_1 = pool.acquire();
+        auto connection_2 = pool.acquire();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto connection = pool.acquire();
+    BOOST_REQUIRE_EQUAL(pool.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(Unreachable)
+{
+    dopamine::ConnectionPool pool("localhost:1");
+    BOOST_REQUIRE_THROW(pool.acquire(), dopamine::Exception);
+    BOOST_REQUIRE_EQUAL(pool.size(), 0);
+}
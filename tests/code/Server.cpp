@@ -67,12 +67,13 @@ public:
     }
 
     static void run_server(
-        mongo::DBClientConnection & connection,
-        std::string const & database, uint16_t port, Status & status)
+        dopamine::ConnectionPool & connection_pool,
+        std::string const & database, uint16_t port,
+        unsigned int max_associations, Status & status)
     {
         dopamine::authentication::AuthenticatorNone authenticator;
         dopamine::Server server(
-            connection, database, "", port, authenticator);
+            connection_pool, database, "", port, authenticator, max_associations);
         status.server = &server;
         server.run();
     }
@@ -189,7 +190,7 @@ BOOST_FIXTURE_TEST_CASE(Nothing, Fixture)
 {
     std::thread server(
         Fixture::run_server,
-        std::ref(this->connection), this->database, this->port,
+        std::ref(this->connection_pool), this->database, this->port, 1,
         std::ref(this->status));
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
@@ -206,7 +207,7 @@ BOOST_FIXTURE_TEST_CASE(Echo, Fixture)
 {
     std::thread server(
         Fixture::run_server,
-        std::ref(this->connection), this->database, this->port,
+        std::ref(this->connection_pool), this->database, this->port, 1,
         std::ref(this->status));
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     std::thread client(Fixture::echo, this->port, std::ref(status));
@@ -223,11 +224,38 @@ BOOST_FIXTURE_TEST_CASE(Echo, Fixture)
     BOOST_REQUIRE(this->status.responses.empty());
 }
 
+BOOST_FIXTURE_TEST_CASE(ConcurrentEcho, Fixture)
+{
+    std::thread server(
+        Fixture::run_server,
+        std::ref(this->connection_pool), this->database, this->port, 2,
+        std::ref(this->status));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    Status other_status{ -1, {}, nullptr };
+    std::thread client(Fixture::echo, this->port, std::ref(status));
+    // WARNING: the listening socket is re-created for each association, leave
+    // time for the first one to be handed to a worker.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::thread other_client(Fixture::echo, this->port, std::ref(other_status));
+
+    // Disable the ERROR message
+    log4cpp::Category::getInstance("dopamine").setPriority(log4cpp::Priority::FATAL);
+
+    client.join();
+    other_client.join();
+    status.server->shutdown();
+    server.join();
+
+    BOOST_REQUIRE_EQUAL(status.client, 0);
+    BOOST_REQUIRE_EQUAL(other_status.client, 0);
+}
+
 BOOST_FIXTURE_TEST_CASE(Find, Fixture)
 {
     std::thread server(
         Fixture::run_server,
-        std::ref(this->connection), this->database, this->port,
+        std::ref(this->connection_pool), this->database, this->port, 1,
         std::ref(this->status));
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     std::thread client(
@@ -265,7 +293,7 @@ BOOST_FIXTURE_TEST_CASE(Move, Fixture)
 
     std::thread server(
         Fixture::run_server,
-        std::ref(this->connection), this->database, this->port,
+        std::ref(this->connection_pool), this->database, this->port, 1,
         std::ref(this->status));
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     std::thread client(
@@ -300,7 +328,7 @@ BOOST_FIXTURE_TEST_CASE(Get, Fixture)
 {
     std::thread server(
         Fixture::run_server,
-        std::ref(this->connection), this->database, this->port,
+        std::ref(this->connection_pool), this->database, this->port, 1,
         std::ref(this->status));
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     std::thread client(Fixture::get, this->port, std::ref(status));
@@ -0,0 +1,149 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE BatchWriter
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/archive/BatchWriter.h"
+#include "dopamine/Exception.h"
+
+#include "fixtures/MongoDB.h"
+
+struct Fixture: public fixtures::MongoDB
+{
+    std::string const ns;
+
+    Fixture()
+    : ns(this->database+".datasets")
+    {
+        // Nothing else.
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Constructor, Fixture)
+{
+    dopamine::archive::BatchWriter const writer(
+        this->connection_pool, this->ns, 10, 1000,
+        std::chrono::milliseconds(20));
+    BOOST_REQUIRE_EQUAL(writer.get_namespace(), this->ns);
+    BOOST_REQUIRE_EQUAL(writer.get_max_count(), 10);
+    BOOST_REQUIRE_EQUAL(writer.get_max_size(), 1000);
+    BOOST_REQUIRE(writer.get_max_delay() == std::chrono::milliseconds(20));
+}
+
+BOOST_FIXTURE_TEST_CASE(Single, Fixture)
+{
+    dopamine::archive::BatchWriter writer(
+        this->connection_pool, this->ns, 10, 1000000,
+        std::chrono::milliseconds(20));
+
+    auto const begin = std::chrono::steady_clock::now();
+    writer.insert(BSON(mongo::GENOID << "foo" << 1));
+    auto const end = std::chrono::steady_clock::now();
+
+    // The batch is not full: wait for the delay
+    BOOST_REQUIRE(end-begin >= std::chrono::milliseconds(20));
+    BOOST_REQUIRE_EQUAL(this->connection.count(this->ns), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(Concurrent, Fixture)
+{
+    // Long delay: batches are written because they are full
+    dopamine::archive::BatchWriter writer(
+        this->connection_pool, this->ns, 4, 1000000,
+        std::chrono::seconds(10));
+
+    auto const begin = std::chrono::steady_clock::now();
+    std::atomic<int> inserted(0);
+    std::vector<std::thread> threads;
+    for(int i=0; i<8; ++i)
+    {
+        threads.emplace_back([&, i]() {
+            writer.insert(BSON(mongo::GENOID << "foo" << i));
+            // The document must be visible once insert has returned
+            auto const object = this->connection.findOne(
+                this->ns, BSON("foo" << i));
+            if(!object.isEmpty())
+            {
+                ++inserted;
+            }
+        });
+    }
+    for(auto & thread: threads)
+    {
+        thread.join();
+    }
+    auto const end = std::chrono::steady_clock::now();
+
+    BOOST_REQUIRE_EQUAL(inserted, 8);
+    BOOST_REQUIRE_EQUAL(this->connection.count(this->ns), 8);
+    BOOST_REQUIRE(end-begin < std::chrono::seconds(10));
+}
+
+BOOST_FIXTURE_TEST_CASE(Size, Fixture)
+{
+    dopamine::archive::BatchWriter writer(
+        this->connection_pool, this->ns, 100, 1, std::chrono::seconds(10));
+
+    auto const begin = std::chrono::steady_clock::now();
+    writer.insert(BSON(mongo::GENOID << "foo" << 1));
+    auto const end = std::chrono::steady_clock::now();
+
+    BOOST_REQUIRE(end-begin < std::chrono::seconds(10));
+    BOOST_REQUIRE_EQUAL(this->connection.count(this->ns), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(Error, Fixture)
+{
+    dopamine::archive::BatchWriter writer(
+        this->connection_pool, this->ns, 2, 1000000,
+        std::chrono::seconds(10));
+
+    auto const id = mongo::OID::gen();
+    this->connection.insert(this->ns, BSON("_id" << id << "foo" << 0));
+
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]() {
+        try
+        {
+            writer.insert(BSON("_id" << id << "foo" << 1));
+        }
+        catch(dopamine::Exception const &)
+        {
+            ++errors;
+        }
+    });
+    threads.emplace_back([&]() {
+        try
+        {
+            writer.insert(BSON(mongo::GENOID << "foo" << 2));
+        }
+        catch(dopamine::Exception const &)
+        {
+            ++errors;
+        }
+    });
+    for(auto & thread: threads)
+    {
+        thread.join();
+    }
+
+    // Only the duplicate document is rejected
+    BOOST_REQUIRE_EQUAL(errors, 1);
+    BOOST_REQUIRE_EQUAL(this->connection.count(this->ns), 2);
+    BOOST_REQUIRE(
+        !this->connection.findOne(this->ns, BSON("foo" << 2)).isEmpty());
+}
@@ -0,0 +1,90 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE CompressionBuffer
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#include "dopamine/archive/CompressionBuffer.h"
+#include "dopamine/archive/ContentBuffer.h"
+#include "dopamine/Exception.h"
+
+std::string get_content()
+{
+    std::string content;
+    for(int i=0; i<100000; ++i)
+    {
+        content += std::to_string(i%100);
+    }
+    return content;
+}
+
+std::string compress(std::string const & content, std::size_t write_size)
+{
+    std::string compressed;
+    dopamine::archive::ContentBuffer sink(compressed);
+    dopamine::archive::CompressionBuffer buffer(sink, 3);
+    std::ostream stream(&buffer);
+    for(std::size_t i=0; i<content.size(); i+=write_size)
+    {
+        stream.write(
+            content.c_str()+i, std::min(write_size, content.size()-i));
+    }
+    buffer.close();
+    BOOST_REQUIRE_EQUAL(buffer.size(), content.size());
+    return compressed;
+}
+
+BOOST_AUTO_TEST_CASE(RoundTrip)
+{
+    auto const content = get_content();
+    // Small writes go through the put area, large ones are compressed
+    // directly.
+    for(auto const write_size: {1, 1000, 1000000})
+    {
+        auto const compressed = compress(content, write_size);
+        BOOST_REQUIRE(compressed.size() < content.size());
+        BOOST_REQUIRE(
+            dopamine::archive::decompress(
+                dopamine::archive::CompressionBuffer::codec, compressed)
+            == content);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Empty)
+{
+    auto const compressed = compress("", 1);
+    BOOST_REQUIRE(
+        dopamine::archive::decompress(
+            dopamine::archive::CompressionBuffer::codec, compressed).empty());
+}
+
+BOOST_AUTO_TEST_CASE(NoCodec)
+{
+    BOOST_REQUIRE_EQUAL(dopamine::archive::decompress("", "foo"), "foo");
+}
+
+BOOST_AUTO_TEST_CASE(UnknownCodec)
+{
+    BOOST_REQUIRE_THROW(
+        dopamine::archive::decompress("foo", "bar"), dopamine::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(Truncated)
+{
+    auto const compressed = compress(get_content(), 1000);
+    BOOST_REQUIRE_THROW(
+        dopamine::archive::decompress(
+            dopamine::archive::CompressionBuffer::codec,
+            compressed.substr(0, compressed.size()/2)),
+        dopamine::Exception);
+}
@@ -0,0 +1,98 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE ContentBuffer
+#include <boost/test/unit_test.hpp>
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+#include <odil/DataSet.h>
+#include <odil/registry.h>
+#include <odil/uid.h>
+#include <odil/Writer.h>
+
+#include "dopamine/archive/ContentBuffer.h"
+
+odil::DataSet get_data_set()
+{
+    odil::DataSet item;
+    item.add(odil::registry::CodeValue, {"1234"});
+    item.add(odil::registry::CodeMeaning, {"Something"});
+
+    odil::DataSet data_set;
+    data_set.add(odil::registry::SOPClassUID, {odil::registry::RawDataStorage});
+    data_set.add(odil::registry::SOPInstanceUID, {odil::generate_uid()});
+    data_set.add(odil::registry::PatientName, {"Doe^John"});
+    data_set.add(odil::registry::PatientWeight, {70.5});
+    data_set.add(odil::registry::Rows, {256});
+    data_set.add(odil::registry::ProcedureCodeSequence, {item});
+    data_set.add(
+        odil::registry::PixelData, {
+            odil::Value::Binary::value_type(1000, 'x')
+        }, odil::VR::OB);
+    return data_set;
+}
+
+BOOST_AUTO_TEST_CASE(String)
+{
+    std::string buffer("prefix");
+    dopamine::archive::ContentBuffer content_buffer(buffer);
+    std::ostream stream(&content_buffer);
+    stream << "foo";
+    stream.put('!');
+    stream.write("bar", 3);
+    stream.flush();
+
+    BOOST_REQUIRE_EQUAL(buffer, "prefixfoo!bar");
+    BOOST_REQUIRE_EQUAL(content_buffer.size(), 7);
+}
+
+BOOST_AUTO_TEST_CASE(BSON)
+{
+    mongo::BufBuilder buffer;
+    buffer.appendStr("prefix", false);
+    dopamine::archive::ContentBuffer content_buffer(buffer);
+    std::ostream stream(&content_buffer);
+    stream << "foo";
+    stream.put('!');
+    stream.write("bar", 3);
+    stream.flush();
+
+    BOOST_REQUIRE_EQUAL(
+        std::string(buffer.buf(), buffer.len()), "prefixfoo!bar");
+    BOOST_REQUIRE_EQUAL(content_buffer.size(), 7);
+}
+
+BOOST_AUTO_TEST_CASE(DataSet)
+{
+    auto const data_set = get_data_set();
+
+    std::ostringstream expected;
+    odil::Writer::write_file(data_set, expected);
+
+    std::string buffer;
+    dopamine::archive::ContentBuffer content_buffer(buffer);
+    std::ostream stream(&content_buffer);
+    odil::Writer::write_file(data_set, stream);
+
+    BOOST_REQUIRE(buffer == expected.str());
+}
+
+BOOST_AUTO_TEST_CASE(EstimateSize)
+{
+    auto const data_set = get_data_set();
+
+    std::ostringstream stream;
+    odil::Writer::write_file(data_set, stream);
+
+    BOOST_REQUIRE_GE(
+        dopamine::archive::estimate_size(data_set), stream.str().size());
+}
@@ -35,7 +35,8 @@ struct Fixture: public fixtures::SampleData
     }
 
     std::vector<odil::DataSet> make_query(
-        std::string const & principal, odil::DataSet const & query)
+        std::string const & principal, odil::DataSet const & query,
+        unsigned int batch_size=100, unsigned int prefetch=2)
     {
         odil::message::CGetRequest const request(
             1, odil::registry::PatientRootQueryRetrieveInformationModelGET,
@@ -45,15 +46,26 @@ struct Fixture: public fixtures::SampleData
         parameters.set_user_identity_to_username(principal);
 
         dopamine::archive::GetDataSetGenerator generator(
-            this->connection, this->acl, this->database, "", parameters);
+            this->connection_pool, this->acl, this->database, "", parameters);
+        generator.set_batch_size(batch_size);
+        BOOST_REQUIRE_EQUAL(generator.get_batch_size(), batch_size);
+        generator.set_prefetch(prefetch);
+        BOOST_REQUIRE_EQUAL(generator.get_prefetch(), prefetch);
 
         generator.initialize(request);
+        auto const count = generator.count();
         std::vector<odil::DataSet> data_sets;
         while(!generator.done())
         {
             data_sets.push_back(generator.get());
             generator.next();
         }
+        BOOST_REQUIRE_EQUAL(count, data_sets.size());
+
+        // The connection of the cursor is returned once all data sets are
+        // generated.
+        BOOST_REQUIRE_EQUAL(
+            this->connection_pool.idle(), this->connection_pool.size());
 
         std::sort(
             data_sets.begin(), data_sets.end(), fixtures::SampleData::less);
@@ -184,3 +196,33 @@ BOOST_FIXTURE_TEST_CASE(AllPatient, Fixture)
             odil::Value::Binary({ { 0x2, 0x2, 0x2, 0x2 } }));
 }
 
+
+BOOST_FIXTURE_TEST_CASE(SmallBatches, Fixture)
+{
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"PATIENT"});
+    query.add(odil::registry::PatientID, {"2"});
+
+    auto const data_sets = this->make_query("retrieve", query, 1);
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(NoPrefetch, Fixture)
+{
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"PATIENT"});
+    query.add(odil::registry::PatientID, {"2"});
+
+    auto const data_sets = this->make_query("retrieve", query, 100, 0);
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 4);
+}
+
+BOOST_FIXTURE_TEST_CASE(LongPrefetch, Fixture)
+{
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"PATIENT"});
+    query.add(odil::registry::PatientName, {"*"});
+
+    auto const data_sets = this->make_query("retrieve", query, 1, 10);
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 5);
+}
@@ -0,0 +1,109 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE GridFSReader
+#include <boost/test/unit_test.hpp>
+
+#include <ostream>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+
+#include "dopamine/archive/GridFSReader.h"
+#include "dopamine/archive/GridFSWriter.h"
+#include "dopamine/Exception.h"
+
+#include "fixtures/MongoDB.h"
+
+struct Fixture: public fixtures::MongoDB
+{
+    std::string const content;
+    mongo::OID id;
+
+    Fixture()
+    : content(get_content())
+    {
+        dopamine::archive::GridFSWriter writer(
+            this->connection, this->database, "foo", 100);
+        std::ostream stream(&writer);
+        stream.write(this->content.c_str(), this->content.size());
+        stream.flush();
+        writer.close();
+        this->id = writer.get_id();
+    }
+
+    static std::string get_content()
+    {
+        std::string content;
+        for(int i=0; i<1000; ++i)
+        {
+            content += std::to_string(i);
+        }
+        return content;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Constructor, Fixture)
+{
+    dopamine::archive::GridFSReader const reader(
+        this->connection_pool, this->database, 8);
+    BOOST_REQUIRE_EQUAL(reader.get_max_ranges(), 8);
+}
+
+BOOST_FIXTURE_TEST_CASE(ReadSequential, Fixture)
+{
+    dopamine::archive::GridFSReader const reader(
+        this->connection_pool, this->database, 1);
+    BOOST_REQUIRE(reader.read(this->connection, this->id) == this->content);
+}
+
+BOOST_FIXTURE_TEST_CASE(ReadParallel, Fixture)
+{
+    for(auto const max_ranges: {2, 4, 100})
+    {
+        dopamine::archive::GridFSReader const reader(
+            this->connection_pool, this->database, max_ranges);
+        BOOST_REQUIRE(
+            reader.read(this->connection, this->id) == this->content);
+        BOOST_REQUIRE_EQUAL(
+            this->connection_pool.idle(), this->connection_pool.size());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(Empty, Fixture)
+{
+    dopamine::archive::GridFSWriter writer(
+        this->connection, this->database, "bar", 100);
+    writer.close();
+
+    dopamine::archive::GridFSReader const reader(
+        this->connection_pool, this->database);
+    BOOST_REQUIRE(reader.read(this->connection, writer.get_id()).empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingFile, Fixture)
+{
+    dopamine::archive::GridFSReader const reader(
+        this->connection_pool, this->database);
+    BOOST_REQUIRE_THROW(
+        reader.read(this->connection, mongo::OID::gen()),
+        dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingChunk, Fixture)
+{
+    this->connection.remove(
+        this->database+".fs.chunks", BSON("files_id" << this->id << "n" << 20));
+
+    dopamine::archive::GridFSReader const reader(
+        this->connection_pool, this->database);
+    BOOST_REQUIRE_THROW(
+        reader.read(this->connection, this->id), dopamine::Exception);
+    BOOST_REQUIRE_EQUAL(
+        this->connection_pool.idle(), this->connection_pool.size());
+}
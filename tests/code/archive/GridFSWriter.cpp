@@ -0,0 +1,123 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE GridFSWriter
+#include <boost/test/unit_test.hpp>
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+#include <mongo/client/gridfs.h>
+
+#include "dopamine/archive/GridFSWriter.h"
+#include "dopamine/Exception.h"
+
+#include "fixtures/MongoDB.h"
+
+struct Fixture: public fixtures::MongoDB
+{
+    std::string const content;
+
+    Fixture()
+    : content(get_content())
+    {
+        // Nothing else.
+    }
+
+    static std::string get_content()
+    {
+        std::string content;
+        for(int i=0; i<1000; ++i)
+        {
+            content += std::to_string(i);
+        }
+        return content;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Write, Fixture)
+{
+    dopamine::archive::GridFSWriter writer(
+        this->connection, this->database, "foo", 100);
+    std::ostream stream(&writer);
+    stream.write(this->content.c_str(), this->content.size());
+    stream.flush();
+
+    BOOST_REQUIRE_EQUAL(writer.size(), this->content.size());
+
+    auto const file = writer.close();
+    BOOST_REQUIRE_EQUAL(file["filename"].String(), "foo");
+    BOOST_REQUIRE_EQUAL(file["_id"].OID(), writer.get_id());
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.chunks"),
+        (this->content.size()+99)/100);
+
+    mongo::GridFS const gridfs(this->connection, this->database);
+    auto gridfs_file = gridfs.findFileByName("foo");
+    BOOST_REQUIRE(gridfs_file.exists());
+    BOOST_REQUIRE_EQUAL(gridfs_file.getContentLength(), this->content.size());
+    BOOST_REQUIRE_EQUAL(gridfs_file.getMD5(), file["md5"].String());
+
+    std::ostringstream stored;
+    gridfs_file.write(stored);
+    BOOST_REQUIRE(stored.str() == this->content);
+}
+
+BOOST_FIXTURE_TEST_CASE(Empty, Fixture)
+{
+    dopamine::archive::GridFSWriter writer(
+        this->connection, this->database, "foo", 100);
+    writer.close();
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.chunks"), 0);
+
+    mongo::GridFS const gridfs(this->connection, this->database);
+    auto gridfs_file = gridfs.findFileByName("foo");
+    BOOST_REQUIRE(gridfs_file.exists());
+    BOOST_REQUIRE_EQUAL(gridfs_file.getContentLength(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(NotClosed, Fixture)
+{
+    {
+        dopamine::archive::GridFSWriter writer(
+            this->connection, this->database, "foo", 100);
+        std::ostream stream(&writer);
+        stream.write(this->content.c_str(), this->content.size());
+        stream.flush();
+
+        BOOST_REQUIRE_GT(
+            this->connection.count(this->database+".fs.chunks"), 0);
+    }
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.chunks"), 0);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.files"), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingChunk, Fixture)
+{
+    dopamine::archive::GridFSWriter writer(
+        this->connection, this->database, "foo", 100);
+    std::ostream stream(&writer);
+    stream.write(this->content.c_str(), this->content.size());
+    stream.flush();
+
+    this->connection.remove(
+        this->database+".fs.chunks", BSON("n" << 0), true,
+        &mongo::WriteConcern::acknowledged);
+
+    BOOST_REQUIRE_THROW(writer.close(), dopamine::Exception);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.files"), 0);
+}
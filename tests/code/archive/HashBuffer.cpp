@@ -0,0 +1,45 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE HashBuffer
+#include <boost/test/unit_test.hpp>
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include "dopamine/archive/HashBuffer.h"
+
+BOOST_AUTO_TEST_CASE(Empty)
+{
+    dopamine::archive::HashBuffer buffer;
+    BOOST_REQUIRE_EQUAL(
+        buffer.digest(), "sha1:da39a3ee5e6b4b0d3255bfef95601890afd80709");
+}
+
+BOOST_AUTO_TEST_CASE(Discard)
+{
+    dopamine::archive::HashBuffer buffer;
+    std::ostream stream(&buffer);
+    stream << "abc";
+    BOOST_REQUIRE_EQUAL(
+        buffer.digest(), "sha1:a9993e364706816aba3e25717850c26c9cd0d89d");
+}
+
+BOOST_AUTO_TEST_CASE(Forward)
+{
+    std::ostringstream sink;
+    dopamine::archive::HashBuffer buffer(sink.rdbuf());
+    std::ostream stream(&buffer);
+    // Single characters and blocks
+    stream.put('a');
+    stream.write("bc", 2);
+    BOOST_REQUIRE_EQUAL(sink.str(), "abc");
+    BOOST_REQUIRE_EQUAL(
+        buffer.digest(), "sha1:a9993e364706816aba3e25717850c26c9cd0d89d");
+}
@@ -0,0 +1,188 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE IndexManager
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+#include <string>
+
+#include <mongo/client/dbclient.h>
+#include <odil/registry.h>
+
+#include "dopamine/archive/IndexManager.h"
+#include "dopamine/bson_converter.h"
+#include "dopamine/Exception.h"
+
+#include "fixtures/MongoDB.h"
+
+struct Fixture: public fixtures::MongoDB
+{
+    // Nothing else.
+};
+
+BOOST_FIXTURE_TEST_CASE(DefaultIndexes, Fixture)
+{
+    dopamine::archive::IndexManager const manager(
+        this->connection_pool, this->database);
+    auto const & indexes = manager.get_indexes();
+    BOOST_REQUIRE(!indexes.empty());
+    BOOST_REQUIRE(indexes[0].keys == BSON("00080018.Value" << 1));
+    BOOST_REQUIRE(!indexes[0].unique);
+    BOOST_REQUIRE_EQUAL(manager.get_report_threshold(), 100);
+}
+
+BOOST_AUTO_TEST_CASE(DefaultIndexesUnique)
+{
+    auto const indexes =
+        dopamine::archive::IndexManager::get_default_indexes(
+            dopamine::Schema::Verbose, true);
+    BOOST_REQUIRE(indexes[0].keys == BSON("00080018.Value" << 1));
+    BOOST_REQUIRE(indexes[0].unique);
+}
+
+BOOST_AUTO_TEST_CASE(ParseKeys)
+{
+    BOOST_REQUIRE(
+        dopamine::archive::IndexManager::parse_keys("00100020, 00080020")
+        == BSON("00100020.Value" << 1 << "00080020.Value" << 1));
+    BOOST_REQUIRE(
+        dopamine::archive::IndexManager::parse_keys("0020000D")
+        == BSON(
+            std::string(odil::registry::StudyInstanceUID)+".Value" << 1));
+    BOOST_REQUIRE(
+        dopamine::archive::IndexManager::parse_keys("00100010.Value.Alphabetic")
+        == BSON("00100010.Value.Alphabetic" << 1));
+    BOOST_REQUIRE_THROW(
+        dopamine::archive::IndexManager::parse_keys("00100020,"),
+        dopamine::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(ParseKeysCompact)
+{
+    BOOST_REQUIRE(
+        dopamine::archive::IndexManager::parse_keys(
+            "00100020, 00091001", dopamine::Schema::Compact)
+        == BSON("00100020" << 1 << "00091001.Value" << 1));
+}
+
+BOOST_FIXTURE_TEST_CASE(DefaultIndexesCompact, Fixture)
+{
+    dopamine::archive::IndexManager manager(
+        this->connection_pool, this->database);
+    manager.set_defaults(dopamine::Schema::Compact, true);
+    auto const & indexes = manager.get_indexes();
+    BOOST_REQUIRE(!indexes.empty());
+    BOOST_REQUIRE(indexes[0].keys == BSON("00080018" << 1));
+    BOOST_REQUIRE(indexes[0].unique);
+}
+
+BOOST_FIXTURE_TEST_CASE(CreateIndexes, Fixture)
+{
+    dopamine::archive::IndexManager manager(
+        this->connection_pool, this->database);
+    manager.add_index(
+        dopamine::archive::IndexManager::parse_keys("00080090"));
+    BOOST_REQUIRE_EQUAL(manager.create_indexes(), 0);
+
+    std::set<std::string> created;
+    auto const specs = this->connection.getIndexSpecs(
+        this->database+".datasets");
+    for(auto const & spec: specs)
+    {
+        created.insert(spec["key"].Obj().firstElementFieldName());
+        if(spec["key"].Obj() == BSON("00080018.Value" << 1))
+        {
+            BOOST_REQUIRE(!spec["unique"].trueValue());
+        }
+    }
+    for(auto const & index: manager.get_indexes())
+    {
+        BOOST_REQUIRE(created.count(index.keys.firstElementFieldName()));
+    }
+
+    // Creating existing indexes is not an error
+    BOOST_REQUIRE_EQUAL(manager.create_indexes(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(CreateIndexesDuplicates, Fixture)
+{
+    // Two data sets with the same SOP Instance UID
+    for(int i=0; i<2; ++i)
+    {
+        this->connection.insert(
+            this->database+".datasets",
+            BSON(
+                "00080018" << BSON(
+                    "vr" << "UI" << "Value" << BSON_ARRAY("1.2"))));
+    }
+
+    dopamine::archive::IndexManager manager(
+        this->connection_pool, this->database);
+    BOOST_REQUIRE_EQUAL(manager.create_indexes(), 0);
+
+    this->connection.dropIndexes(this->database+".datasets");
+    manager.set_defaults(dopamine::Schema::Verbose, true);
+    BOOST_REQUIRE_EQUAL(manager.create_indexes(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingIndexes, Fixture)
+{
+    dopamine::archive::IndexManager manager(
+        this->connection_pool, this->database);
+    manager.set_report_threshold(2);
+    BOOST_REQUIRE_EQUAL(manager.get_report_threshold(), 2);
+
+    // Served by an index
+    manager.record_query(
+        BSON("$and" << BSON_ARRAY(
+            BSON("00100020.Value" << "1") << BSON("00081030.Value" << "x"))));
+    // Not served by an index
+    for(int i=0; i<3; ++i)
+    {
+        manager.record_query(
+            BSON("$and" << BSON_ARRAY(
+                BSON("00081030.Value" << "x")
+                << BSON("$or" << BSON_ARRAY(BSON("00080090.Value" << "y"))))));
+    }
+
+    auto const missing = manager.get_missing_indexes();
+    BOOST_REQUIRE_EQUAL(missing.size(), 1);
+    std::set<std::string> const shape{"00080090.Value", "00081030.Value"};
+    BOOST_REQUIRE(missing.begin()->first == shape);
+    BOOST_REQUIRE_EQUAL(missing.begin()->second, 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(MissingIndexesElementMatch, Fixture)
+{
+    dopamine::archive::IndexManager manager(
+        this->connection_pool, this->database);
+    manager.set_report_threshold(1);
+
+    // Served by the index on the normalized patient name
+    manager.record_query(
+        BSON("00100010.Value" << BSON(
+            "$elemMatch" << BSON(
+                "Alphabetic_norm" << BSON("$gte" << "DOE" << "$lt" << "DOF")))));
+    BOOST_REQUIRE(manager.get_missing_indexes().empty());
+
+    // Not served by an index, single value or multiple values
+    manager.record_query(
+        BSON("$or" << BSON_ARRAY(
+            BSON("00080090" << BSON(
+                "$elemMatch" << BSON(
+                    "Alphabetic_norm" << BSON("$gte" << "DOE"))))
+            << BSON(
+                "00080090.Alphabetic_norm" << BSON("$gte" << "DOE")
+                << "00080090.0" << BSON("$exists" << false)))));
+
+    auto const missing = manager.get_missing_indexes();
+    BOOST_REQUIRE_EQUAL(missing.size(), 1);
+    std::set<std::string> const shape{"00080090.Alphabetic_norm"};
+    BOOST_REQUIRE(missing.begin()->first == shape);
+}
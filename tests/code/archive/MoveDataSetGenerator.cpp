@@ -51,7 +51,7 @@ struct Fixture: public fixtures::SampleData
         parameters.set_user_identity_to_username(principal);
 
         dopamine::archive::MoveDataSetGenerator generator(
-            this->connection, this->acl, this->database, "", parameters);
+            this->connection_pool, this->acl, this->database, "", parameters);
 
         generator.initialize(request);
         std::vector<odil::DataSet> data_sets;
@@ -81,7 +81,7 @@ BOOST_FIXTURE_TEST_CASE(Association, Fixture)
     parameters.set_user_identity_to_username("query");
 
     dopamine::archive::MoveDataSetGenerator generator(
-        this->connection, this->acl, this->database, "", parameters);
+        this->connection_pool, this->acl, this->database, "", parameters);
     auto const association = generator.get_association(request);
     BOOST_REQUIRE_EQUAL(association.get_peer_host(), "pacs.example.com");
     BOOST_REQUIRE_EQUAL(association.get_peer_port(), 11112);
@@ -100,7 +100,7 @@ BOOST_FIXTURE_TEST_CASE(UnknownPeer, Fixture)
     parameters.set_user_identity_to_username("query");
 
     dopamine::archive::MoveDataSetGenerator generator(
-        this->connection, this->acl, this->database, "", parameters);
+        this->connection_pool, this->acl, this->database, "", parameters);
     BOOST_REQUIRE_THROW(generator.get_association(request), odil::Exception);
 }
 
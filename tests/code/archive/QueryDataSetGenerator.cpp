@@ -17,8 +17,10 @@
 #include <odil/DataSet.h>
 #include <odil/message/CFindRequest.h>
 #include <odil/registry.h>
+#include <odil/uid.h>
 
 #include "dopamine/archive/QueryDataSetGenerator.h"
+#include "dopamine/archive/Storage.h"
 
 #include "fixtures/SampleData.h"
 
@@ -35,7 +37,8 @@ struct Fixture: public fixtures::SampleData
     }
 
     std::vector<odil::DataSet> make_query(
-        std::string const & principal, odil::DataSet const & query)
+        std::string const & principal, odil::DataSet const & query,
+        dopamine::Schema schema=dopamine::Schema::Verbose)
     {
         odil::message::CFindRequest const request(
             1, odil::registry::PatientRootQueryRetrieveInformationModelFIND,
@@ -45,7 +48,8 @@ struct Fixture: public fixtures::SampleData
         parameters.set_user_identity_to_username(principal);
 
         dopamine::archive::QueryDataSetGenerator generator(
-            this->connection, this->acl, this->database, parameters);
+            this->connection_pool, this->acl, this->database, parameters);
+        generator.set_schema(schema);
 
         generator.initialize(request);
         std::vector<odil::DataSet> data_sets;
@@ -60,6 +64,19 @@ struct Fixture: public fixtures::SampleData
 
         return data_sets;
     }
+
+    odil::DataSet make_data_set(
+        std::string const & series_instance_uid, std::string const & modality)
+    {
+        odil::DataSet data_set;
+        data_set.add(odil::registry::SOPClassUID, {odil::registry::RawDataStorage});
+        data_set.add(odil::registry::SOPInstanceUID, {odil::generate_uid()});
+        data_set.add(odil::registry::PatientID, {"4"});
+        data_set.add(odil::registry::StudyInstanceUID, {"4.1"});
+        data_set.add(odil::registry::SeriesInstanceUID, {series_instance_uid});
+        data_set.add(odil::registry::Modality, {modality});
+        return data_set;
+    }
 };
 
 BOOST_FIXTURE_TEST_CASE(NotAllowed, Fixture)
@@ -445,3 +462,144 @@ BOOST_FIXTURE_TEST_CASE(SOPClassesInStudy, Fixture)
             odil::registry::CTImageStorage, odil::registry::MRImageStorage }));
 }
 
+
+BOOST_FIXTURE_TEST_CASE(AllStudiesComputedAttributes, Fixture)
+{
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"STUDY"});
+    query.add(odil::registry::StudyInstanceUID);
+    query.add(odil::registry::NumberOfStudyRelatedSeries);
+    query.add(odil::registry::NumberOfStudyRelatedInstances);
+    query.add(odil::registry::ModalitiesInStudy);
+
+    auto const data_sets = this->make_query("query", query);
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 3);
+
+    std::vector<odil::Value::Integers> const series{{1}, {1}, {2}};
+    std::vector<odil::Value::Integers> const instances{{1}, {1}, {3}};
+    std::vector<odil::Value::Strings> const modalities{
+        {"MR"}, {"MR"}, {"CT", "MR"}};
+    for(unsigned int i=0; i<data_sets.size(); ++i)
+    {
+        BOOST_REQUIRE(
+            data_sets[i].as_int(odil::registry::NumberOfStudyRelatedSeries)
+                == series[i]);
+        BOOST_REQUIRE(
+            data_sets[i].as_int(odil::registry::NumberOfStudyRelatedInstances)
+                == instances[i]);
+        auto modalities_in_study = data_sets[i].as_string(
+            odil::registry::ModalitiesInStudy);
+        std::sort(modalities_in_study.begin(), modalities_in_study.end());
+        BOOST_REQUIRE(modalities_in_study == modalities[i]);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(ComputedAttributesRestricted, Fixture)
+{
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"PATIENT"});
+    query.add(odil::registry::PatientID);
+    query.add(odil::registry::NumberOfPatientRelatedInstances);
+
+    auto const data_sets = this->make_query("restricted_query", query);
+
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 1);
+    BOOST_REQUIRE(
+        data_sets[0].as_int(odil::registry::NumberOfPatientRelatedInstances)
+            == odil::Value::Integers({1}));
+}
+
+BOOST_FIXTURE_TEST_CASE(ComputedAttributesStored, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    auto const data_set = this->make_data_set("4.1.1", "MR");
+    storage.store(data_set);
+    storage.store(this->make_data_set("4.1.2", "CT"));
+    // Resend, stored twice without duplicates check: another instance.
+    storage.store(data_set);
+
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"STUDY"});
+    query.add(odil::registry::StudyInstanceUID, {"4.1"});
+    query.add(odil::registry::NumberOfStudyRelatedInstances);
+    query.add(odil::registry::ModalitiesInStudy);
+
+    auto const study = this->connection.findOne(
+        this->database+".studies", BSON("_id" << "4.1"));
+    BOOST_REQUIRE(!study["stale"].trueValue());
+
+    auto const data_sets = this->make_query("query", query);
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 1);
+    BOOST_REQUIRE(
+        data_sets[0].as_int(odil::registry::NumberOfStudyRelatedInstances)
+            == odil::Value::Integers({3}));
+    auto modalities_in_study = data_sets[0].as_string(
+        odil::registry::ModalitiesInStudy);
+    std::sort(modalities_in_study.begin(), modalities_in_study.end());
+    BOOST_REQUIRE(modalities_in_study == odil::Value::Strings({"CT", "MR"}));
+
+    // The query does not rebuild the stale summary.
+    auto const study = this->connection.findOne(
+        this->database+".studies", BSON("_id" << "4.1"));
+    BOOST_REQUIRE(study["stale"].trueValue());
+}
+
+BOOST_FIXTURE_TEST_CASE(ComputedAttributesMoved, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Replace);
+    auto const data_set = this->make_data_set("4.1.1", "MR");
+    storage.store(data_set);
+    storage.store(this->make_data_set("4.1.1", "MR"));
+
+    // Corrected modality: the study summary cannot remove "MR" by itself.
+    auto modified = data_set;
+    modified.as_string(odil::registry::Modality) = {"CT"};
+    storage.store(modified);
+
+    odil::DataSet query;
+    query.add(odil::registry::QueryRetrieveLevel, {"STUDY"});
+    query.add(odil::registry::StudyInstanceUID, {"4.1"});
+    query.add(odil::registry::NumberOfStudyRelatedInstances);
+    query.add(odil::registry::ModalitiesInStudy);
+
+    auto const data_sets = this->make_query("query", query);
+    BOOST_REQUIRE_EQUAL(data_sets.size(), 1);
+    BOOST_REQUIRE(
+        data_sets[0].as_int(odil::registry::NumberOfStudyRelatedInstances)
+            == odil::Value::Integers({2}));
+    auto modalities_in_study = data_sets[0].as_string(
+        odil::registry::ModalitiesInStudy);
+    std::sort(modalities_in_study.begin(), modalities_in_study.end());
+    BOOST_REQUIRE(modalities_in_study == odil::Value::Strings({"CT", "MR"}));
+}
+
+BOOST_FIXTURE_TEST_CASE(WildCardMultipleValuesCompact, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_schema(dopamine::Schema::Compact);
+
+    auto data_set = this->make_data_set("4.1.1", "MR");
+    data_set.add(odil::registry::PatientName, {"Doe^Alice", "Zed^Bob"});
+    data_set.add(odil::registry::ImageType, {"ORIGINAL", "PRIMARY"});
+    storage.store(data_set);
+
+    auto const query_name = [&](
+        std::string const & name, std::string const & image_type) {
+        odil::DataSet query;
+        query.add(odil::registry::QueryRetrieveLevel, {"IMAGE"});
+        query.add(odil::registry::PatientID, {"4"});
+        query.add(odil::registry::StudyInstanceUID, {"4.1"});
+        query.add(odil::registry::SeriesInstanceUID, {"4.1.1"});
+        query.add(odil::registry::SOPInstanceUID);
+        query.add(odil::registry::PatientName, {name});
+        query.add(odil::registry::ImageType, {image_type});
+        return this->make_query("query", query, dopamine::Schema::Compact);
+    };
+
+    BOOST_REQUIRE_EQUAL(query_name("zed*", "PRIM*").size(), 1);
+    // Each bound of the ranges is matched by a different value.
+    BOOST_REQUIRE_EQUAL(query_name("E*", "ORIGINAL").size(), 0);
+    BOOST_REQUIRE_EQUAL(query_name("Doe*", "P*").size(), 1);
+    BOOST_REQUIRE_EQUAL(query_name("Doe*", "OS*").size(), 0);
+}
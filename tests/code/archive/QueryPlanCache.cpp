@@ -0,0 +1,66 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE QueryPlanCache
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+
+#include "dopamine/archive/QueryPlanCache.h"
+
+BOOST_AUTO_TEST_CASE(Constructor)
+{
+    dopamine::archive::QueryPlanCache const cache;
+    BOOST_REQUIRE_EQUAL(cache.get_capacity(), 256);
+    BOOST_REQUIRE_EQUAL(cache.size(), 0);
+    BOOST_REQUIRE_EQUAL(cache.get_hits(), 0);
+    BOOST_REQUIRE_EQUAL(cache.get_misses(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(Find)
+{
+    dopamine::archive::QueryPlanCache cache;
+    auto const plan = std::make_shared<dopamine::archive::QueryPlan>();
+
+    BOOST_REQUIRE(!cache.find("a"));
+    cache.insert("a", plan);
+    BOOST_REQUIRE(cache.find("a") == plan);
+    BOOST_REQUIRE(!cache.find("b"));
+
+    BOOST_REQUIRE_EQUAL(cache.size(), 1);
+    BOOST_REQUIRE_EQUAL(cache.get_hits(), 1);
+    BOOST_REQUIRE_EQUAL(cache.get_misses(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(LeastRecentlyUsed)
+{
+    dopamine::archive::QueryPlanCache cache(2);
+    auto const plan = std::make_shared<dopamine::archive::QueryPlan>();
+
+    cache.insert("a", plan);
+    cache.insert("b", plan);
+    BOOST_REQUIRE(cache.find("a"));
+    cache.insert("c", plan);
+
+    BOOST_REQUIRE_EQUAL(cache.size(), 2);
+    BOOST_REQUIRE(cache.find("a"));
+    BOOST_REQUIRE(!cache.find("b"));
+    BOOST_REQUIRE(cache.find("c"));
+
+    cache.set_capacity(1);
+    BOOST_REQUIRE_EQUAL(cache.size(), 1);
+    BOOST_REQUIRE(cache.find("c"));
+}
+
+BOOST_AUTO_TEST_CASE(Disabled)
+{
+    dopamine::archive::QueryPlanCache cache(0);
+    cache.insert("a", std::make_shared<dopamine::archive::QueryPlan>());
+    BOOST_REQUIRE_EQUAL(cache.size(), 0);
+    BOOST_REQUIRE(!cache.find("a"));
+}
@@ -9,11 +9,26 @@
 #define BOOST_TEST_MODULE Storage
 #include <boost/test/unit_test.hpp>
 
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <odil/DataSet.h>
+#include <odil/Reader.h>
 #include <odil/registry.h>
 #include <odil/uid.h>
 
+#include <boost/filesystem.hpp>
+
+#include "dopamine/archive/IndexManager.h"
 #include "dopamine/archive/Storage.h"
+#include "dopamine/bulk/BulkStorageFilesystem.h"
+#include "dopamine/bulk/View.h"
+#include "dopamine/Exception.h"
 
 #include "fixtures/MongoDB.h"
 
@@ -47,7 +62,7 @@ struct Fixture: public fixtures::MongoDB
 
 BOOST_FIXTURE_TEST_CASE(MainContent, Fixture)
 {
-    dopamine::archive::Storage storage(this->connection, this->database);
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
     // Make sure we do not store in GridFS
     storage.set_gridfs_limit(1000);
 
@@ -65,7 +80,7 @@ BOOST_FIXTURE_TEST_CASE(MainContent, Fixture)
 
 BOOST_FIXTURE_TEST_CASE(MainGridFS, Fixture)
 {
-    dopamine::archive::Storage storage(this->connection, this->database);
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
     // Make sure we store in GridFS
     storage.set_gridfs_limit(1);
 
@@ -85,7 +100,7 @@ BOOST_FIXTURE_TEST_CASE(MainGridFS, Fixture)
 BOOST_FIXTURE_TEST_CASE(BulkContent, Fixture)
 {
     dopamine::archive::Storage storage(
-        this->connection, this->database, this->bulk_database);
+        this->connection_pool, this->database, this->bulk_database);
     // Make sure we do not store in GridFS
     storage.set_gridfs_limit(1000);
 
@@ -105,7 +120,7 @@ BOOST_FIXTURE_TEST_CASE(BulkContent, Fixture)
 BOOST_FIXTURE_TEST_CASE(BulkGridFS, Fixture)
 {
     dopamine::archive::Storage storage(
-        this->connection, this->database, this->bulk_database);
+        this->connection_pool, this->database, this->bulk_database);
     // Make sure we store in GridFS
     storage.set_gridfs_limit(1);
 
@@ -122,3 +137,760 @@ BOOST_FIXTURE_TEST_CASE(BulkGridFS, Fixture)
         data_set.as_string(odil::registry::SOPInstanceUID, 0));
     BOOST_REQUIRE(stored == data_set);
 }
+
+BOOST_FIXTURE_TEST_CASE(MetadataWithContent, Fixture)
+{
+    dopamine::archive::Storage storage(
+        this->connection_pool, this->database, this->bulk_database);
+    storage.set_gridfs_limit(1000);
+
+    odil::DataSet const data_set = this->get_data_set();
+    storage.store(data_set);
+
+    auto const metadata = this->connection.findOne(
+        this->database+".datasets",
+        BSON(
+            std::string(odil::registry::SOPInstanceUID)+".Value"
+            << data_set.as_string(odil::registry::SOPInstanceUID, 0)));
+    BOOST_REQUIRE(!metadata.isEmpty());
+    BOOST_REQUIRE(metadata.hasField("Content"));
+
+    auto const bulk = this->connection.findOne(
+        this->bulk_database+".datasets", {});
+    auto const reference = metadata["Content"].Obj();
+    BOOST_REQUIRE_EQUAL(reference["store"].String(), "bulk");
+    BOOST_REQUIRE_EQUAL(reference["kind"].String(), "inline");
+    BOOST_REQUIRE(reference["id"].OID() == bulk["_id"].OID());
+}
+
+BOOST_FIXTURE_TEST_CASE(Batched, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_gridfs_limit(1000);
+    BOOST_REQUIRE(!storage.is_batched());
+    storage.set_batch(4, 1000000, std::chrono::milliseconds(10));
+    BOOST_REQUIRE(storage.is_batched());
+
+    std::vector<odil::DataSet> data_sets;
+    for(int i=0; i<8; ++i)
+    {
+        data_sets.push_back(this->get_data_set());
+    }
+
+    std::vector<std::thread> threads;
+    for(auto const & data_set: data_sets)
+    {
+        threads.emplace_back([&]() { storage.store(data_set); });
+    }
+    for(auto & thread: threads)
+    {
+        thread.join();
+    }
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), data_sets.size());
+    for(auto const & data_set: data_sets)
+    {
+        auto const stored = storage.retrieve(
+            data_set.as_string(odil::registry::SOPInstanceUID, 0));
+        BOOST_REQUIRE(stored == data_set);
+    }
+
+    storage.set_batch(1, 1000000, std::chrono::milliseconds(10));
+    BOOST_REQUIRE(!storage.is_batched());
+}
+
+BOOST_FIXTURE_TEST_CASE(Summaries, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+
+    std::vector<std::string> const modalities{"MR", "CT", "MR"};
+    for(int i=0; i<3; ++i)
+    {
+        auto data_set = this->get_data_set();
+        data_set.add(odil::registry::PatientID, {"patient"});
+        data_set.add(odil::registry::StudyInstanceUID, {"1.2.3"});
+        data_set.add(
+            odil::registry::SeriesInstanceUID, {"1.2.3."+std::to_string(i%2)});
+        data_set.add(odil::registry::Modality, {modalities[i]});
+        storage.store(data_set);
+    }
+
+    auto const patient = this->connection.findOne(
+        this->database+".patients", BSON("_id" << "patient"));
+    BOOST_REQUIRE_EQUAL(patient["instances"].numberLong(), 3);
+    BOOST_REQUIRE_EQUAL(
+        patient[std::string(odil::registry::StudyInstanceUID)].Array().size(), 1);
+    BOOST_REQUIRE_EQUAL(
+        patient[std::string(odil::registry::SeriesInstanceUID)].Array().size(), 2);
+
+    auto const study = this->connection.findOne(
+        this->database+".studies", BSON("_id" << "1.2.3"));
+    BOOST_REQUIRE_EQUAL(study["instances"].numberLong(), 3);
+    BOOST_REQUIRE_EQUAL(
+        study[std::string(odil::registry::SeriesInstanceUID)].Array().size(), 2);
+    BOOST_REQUIRE_EQUAL(
+        study[std::string(odil::registry::Modality)].Array().size(), 2);
+    BOOST_REQUIRE_EQUAL(
+        study[std::string(odil::registry::SOPClassUID)].Array().size(), 1);
+
+    auto const series = this->connection.findOne(
+        this->database+".series", BSON("_id" << "1.2.3.0"));
+    BOOST_REQUIRE_EQUAL(series["instances"].numberLong(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(SummariesResend, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+
+    auto data_set = this->get_data_set();
+    data_set.add(odil::registry::PatientID, {"patient"});
+    storage.store(data_set);
+    storage.store(data_set);
+
+    // Without duplicates check, the resend is another instance.
+    auto const patient = this->connection.findOne(
+        this->database+".patients", BSON("_id" << "patient"));
+    BOOST_REQUIRE_EQUAL(patient["instances"].numberLong(), 2);
+    BOOST_REQUIRE(!patient.hasField("stale"));
+}
+
+BOOST_FIXTURE_TEST_CASE(SummariesPartial, Fixture)
+{
+    // Data set stored before the summaries
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    auto data_set = this->get_data_set();
+    data_set.add(odil::registry::StudyInstanceUID, {"1.2.3"});
+    storage.store(data_set);
+    this->connection.dropCollection(this->database+".studies");
+
+    data_set.as_string(odil::registry::SOPInstanceUID) = {odil::generate_uid()};
+    storage.store(data_set);
+
+    auto study = this->connection.findOne(
+        this->database+".studies", BSON("_id" << "1.2.3"));
+    BOOST_REQUIRE(study["stale"].trueValue());
+
+    storage.rebuild_summaries(odil::registry::StudyInstanceUID, {"1.2.3"});
+    study = this->connection.findOne(
+        this->database+".studies", BSON("_id" << "1.2.3"));
+    BOOST_REQUIRE_EQUAL(study["instances"].numberLong(), 2);
+    BOOST_REQUIRE(!study.hasField("stale"));
+}
+
+BOOST_FIXTURE_TEST_CASE(RebuildAllSummaries, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    for(auto const & series: {"1.2.3.1", "1.2.3.1", "1.2.3.2"})
+    {
+        auto data_set = this->get_data_set();
+        data_set.add(odil::registry::StudyInstanceUID, {"1.2.3"});
+        data_set.add(odil::registry::SeriesInstanceUID, {series});
+        storage.store(data_set);
+    }
+
+    // Data sets stored before the summaries
+    for(auto const & collection: {"patients", "studies", "series"})
+    {
+        this->connection.dropCollection(this->database+"."+collection);
+    }
+
+    // One study and two series
+    BOOST_REQUIRE_EQUAL(storage.rebuild_summaries(), 3);
+
+    auto const study = this->connection.findOne(
+        this->database+".studies", BSON("_id" << "1.2.3"));
+    BOOST_REQUIRE_EQUAL(study["instances"].numberLong(), 3);
+    BOOST_REQUIRE_EQUAL(
+        study[std::string(odil::registry::SeriesInstanceUID)].Array().size(), 2);
+    auto const series = this->connection.findOne(
+        this->database+".series", BSON("_id" << "1.2.3.1"));
+    BOOST_REQUIRE_EQUAL(series["instances"].numberLong(), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(SummariesMoved, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Replace);
+
+    auto data_set = this->get_data_set();
+    data_set.add(odil::registry::SeriesInstanceUID, {"1.2.3.1"});
+    storage.store(data_set);
+    data_set.as_string(odil::registry::SeriesInstanceUID) = {"1.2.3.2"};
+    storage.store(data_set);
+
+    auto const previous = this->connection.findOne(
+        this->database+".series", BSON("_id" << "1.2.3.1"));
+    BOOST_REQUIRE(previous["stale"].trueValue());
+    auto const next = this->connection.findOne(
+        this->database+".series", BSON("_id" << "1.2.3.2"));
+    BOOST_REQUIRE(next["stale"].trueValue());
+}
+
+BOOST_AUTO_TEST_CASE(ParseDuplicates)
+{
+    using dopamine::archive::Storage;
+    BOOST_REQUIRE(Storage::parse_duplicates("none") == Storage::Duplicates::None);
+    BOOST_REQUIRE(
+        Storage::parse_duplicates("replace") == Storage::Duplicates::Replace);
+    BOOST_REQUIRE(
+        Storage::parse_duplicates("version") == Storage::Duplicates::Version);
+    BOOST_REQUIRE(
+        Storage::parse_duplicates("reject") == Storage::Duplicates::Reject);
+    BOOST_REQUIRE_THROW(
+        Storage::parse_duplicates("foo"), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(ContentHash, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    BOOST_REQUIRE(
+        storage.get_duplicates() == dopamine::archive::Storage::Duplicates::None);
+
+    odil::DataSet const data_set = this->get_data_set();
+    storage.store(data_set);
+    storage.store(data_set);
+
+    // No duplicates check: both data sets are stored, with the same hash.
+    auto const cursor = this->connection.query(this->database+".datasets", {});
+    std::vector<std::string> hashes;
+    while(cursor->more())
+    {
+        hashes.push_back(cursor->next().getStringField("ContentHash"));
+    }
+    BOOST_REQUIRE_EQUAL(hashes.size(), 2);
+    BOOST_REQUIRE_EQUAL(hashes[0].substr(0, 5), "sha1:");
+    BOOST_REQUIRE_EQUAL(hashes[0], hashes[1]);
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesIdentical, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Reject);
+
+    odil::DataSet data_set = this->get_data_set();
+    data_set.add(odil::registry::PatientID, {"1234"});
+    storage.store(data_set);
+    storage.store(data_set);
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), 1);
+    auto const patient = this->connection.findOne(
+        this->database+".patients", BSON("_id" << "1234"));
+    BOOST_REQUIRE_EQUAL(patient["instances"].numberLong(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesIdenticalGridFS, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Reject);
+    storage.set_gridfs_limit(1);
+
+    odil::DataSet data_set = this->get_data_set();
+    storage.store(data_set);
+    auto const chunks = this->connection.count(this->database+".fs.chunks");
+
+    // The chunks written while hashing the resend or the rejected data set
+    // are removed.
+    storage.store(data_set);
+    odil::DataSet modified = data_set;
+    modified.add(odil::registry::PatientName, {"Doe^John"});
+    BOOST_REQUIRE_THROW(storage.store(modified), dopamine::Exception);
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), 1);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.files"), 1);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.chunks"), chunks);
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesReject, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Reject);
+
+    odil::DataSet data_set = this->get_data_set();
+    storage.store(data_set);
+    auto const sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+
+    odil::DataSet modified = data_set;
+    modified.add(odil::registry::PatientName, {"Doe^John"});
+    BOOST_REQUIRE_THROW(storage.store(modified), dopamine::Exception);
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), 1);
+    BOOST_REQUIRE(storage.retrieve(sop_instance_uid) == data_set);
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesReplace, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Replace);
+    // Make sure we store in GridFS
+    storage.set_gridfs_limit(1);
+
+    odil::DataSet data_set = this->get_data_set();
+    data_set.add(odil::registry::PatientID, {"1234"});
+    storage.store(data_set);
+    auto const sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+
+    odil::DataSet modified = data_set;
+    modified.add(odil::registry::PatientName, {"Doe^John"});
+    storage.store(modified);
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), 1);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.files"), 1);
+    BOOST_REQUIRE(!this->connection.exists(this->database+".versions"));
+    BOOST_REQUIRE(storage.retrieve(sop_instance_uid) == modified);
+
+    auto const patient = this->connection.findOne(
+        this->database+".patients", BSON("_id" << "1234"));
+    BOOST_REQUIRE_EQUAL(patient["instances"].numberLong(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesVersion, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Version);
+    // Make sure we store in GridFS
+    storage.set_gridfs_limit(1);
+
+    odil::DataSet data_set = this->get_data_set();
+    storage.store(data_set);
+    auto const sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+
+    odil::DataSet modified = data_set;
+    modified.add(odil::registry::PatientName, {"Doe^John"});
+    storage.store(modified);
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), 1);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.files"), 2);
+    BOOST_REQUIRE(storage.retrieve(sop_instance_uid) == modified);
+
+    auto const version = this->connection.findOne(
+        this->database+".versions", {});
+    BOOST_REQUIRE(version.hasField("Superseded"));
+    BOOST_REQUIRE(!version.hasField(std::string(odil::registry::PatientName)));
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesUniqueIndex, Fixture)
+{
+    dopamine::archive::IndexManager index_manager(
+        this->connection_pool, this->database);
+    index_manager.set_defaults(dopamine::Schema::Verbose, true);
+    BOOST_REQUIRE_EQUAL(index_manager.create_indexes(), 0);
+
+    for(auto const duplicates: {
+        dopamine::archive::Storage::Duplicates::Replace,
+        dopamine::archive::Storage::Duplicates::Version})
+    {
+        dopamine::archive::Storage storage(
+            this->connection_pool, this->database);
+        storage.set_duplicates(duplicates);
+
+        odil::DataSet data_set = this->get_data_set();
+        storage.store(data_set);
+        auto const sop_instance_uid = data_set.as_string(
+            odil::registry::SOPInstanceUID, 0);
+
+        odil::DataSet modified = data_set;
+        modified.add(odil::registry::PatientName, {"Doe^John"});
+        storage.store(modified);
+        modified.as_string(odil::registry::PatientName) = {"Doe^Jane"};
+        storage.store(modified);
+
+        BOOST_REQUIRE_EQUAL(
+            this->connection.count(
+                this->database+".datasets",
+                BSON(
+                    std::string(odil::registry::SOPInstanceUID)+".Value"
+                    << sop_instance_uid)),
+            1);
+        BOOST_REQUIRE(storage.retrieve(sop_instance_uid) == modified);
+    }
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".versions"), 2);
+}
+
+BOOST_FIXTURE_TEST_CASE(DuplicatesConcurrent, Fixture)
+{
+    dopamine::archive::IndexManager index_manager(
+        this->connection_pool, this->database);
+    index_manager.set_defaults(dopamine::Schema::Verbose, true);
+    BOOST_REQUIRE_EQUAL(index_manager.create_indexes(), 0);
+
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Version);
+
+    odil::DataSet const data_set = this->get_data_set();
+    auto const sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+
+    // Different versions of the same SOP instance stored concurrently
+    std::vector<std::thread> threads;
+    for(int i=0; i<4; ++i)
+    {
+        odil::DataSet version = data_set;
+        version.add(odil::registry::PatientName, {"Doe^"+std::to_string(i)});
+        threads.emplace_back(
+            [&storage, version]() { storage.store(version); });
+    }
+    for(auto & thread: threads)
+    {
+        thread.join();
+    }
+
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".datasets"), 1);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".versions"), 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(CompactSchema, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_schema(dopamine::Schema::Compact);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Reject);
+    BOOST_REQUIRE(storage.get_schema() == dopamine::Schema::Compact);
+
+    odil::DataSet const data_set = this->get_data_set();
+    storage.store(data_set);
+    auto const sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+
+    auto const object = this->connection.findOne(
+        this->database+".datasets",
+        BSON(std::string(odil::registry::SOPInstanceUID) << sop_instance_uid));
+    BOOST_REQUIRE(!object.isEmpty());
+    BOOST_REQUIRE_EQUAL(
+        object[std::string(odil::registry::SOPClassUID)].String(),
+        odil::registry::RawDataStorage);
+
+    BOOST_REQUIRE(storage.retrieve(sop_instance_uid) == data_set);
+
+    // Duplicates are found with the compact path
+    odil::DataSet modified = data_set;
+    modified.add(odil::registry::PatientName, {"Doe^John"});
+    BOOST_REQUIRE_THROW(storage.store(modified), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(HasDocuments, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    BOOST_REQUIRE(!storage.has_documents(dopamine::Schema::Verbose));
+    BOOST_REQUIRE(!storage.has_documents(dopamine::Schema::Compact));
+
+    storage.store(this->get_data_set());
+    BOOST_REQUIRE(storage.has_documents(dopamine::Schema::Verbose));
+    BOOST_REQUIRE(!storage.has_documents(dopamine::Schema::Compact));
+
+    storage.set_schema(dopamine::Schema::Compact);
+    storage.store(this->get_data_set());
+    BOOST_REQUIRE(storage.has_documents(dopamine::Schema::Compact));
+}
+
+BOOST_FIXTURE_TEST_CASE(NormalizedValues, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+
+    odil::DataSet data_set = this->get_data_set();
+    data_set.add(odil::registry::StudyDate, {"20060705"});
+    data_set.add(odil::registry::StudyTime, {"1000"});
+    storage.store(data_set);
+
+    auto const object = this->connection.findOne(
+        this->database+".datasets",
+        BSON(
+            "Normalized.00080020_00080030" << BSON(
+                "$gte" << mongo::Date_t(1152093600000ULL))));
+    BOOST_REQUIRE(!object.isEmpty());
+    BOOST_REQUIRE(
+        storage.retrieve(data_set.as_string(
+            odil::registry::SOPInstanceUID, 0)) == data_set);
+}
+
+BOOST_FIXTURE_TEST_CASE(RetrieveMissing, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    BOOST_REQUIRE_THROW(storage.retrieve("1.2.3.4"), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(RetrieveView, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+
+    odil::DataSet const data_set = this->get_data_set();
+    storage.store(data_set);
+
+    auto const view = storage.retrieve_view(
+        data_set.as_string(odil::registry::SOPInstanceUID, 0));
+    std::istringstream stream(std::string(view->data(), view->size()));
+    BOOST_REQUIRE(odil::Reader::read_file(stream).second == data_set);
+}
+
+BOOST_FIXTURE_TEST_CASE(MigrateContent, Fixture)
+{
+    dopamine::archive::Storage storage(
+        this->connection_pool, this->database, this->bulk_database);
+
+    // One data set in bulk GridFS, one inline in the bulk database
+    std::vector<odil::DataSet> data_sets;
+    for(auto const limit: {1, 1000})
+    {
+        storage.set_gridfs_limit(limit);
+        data_sets.push_back(this->get_data_set());
+        storage.store(data_sets.back());
+    }
+
+    // Untyped references, as written by older versions
+    for(auto const & data_set: data_sets)
+    {
+        this->connection.update(
+            this->database+".datasets",
+            BSON(
+                std::string(odil::registry::SOPInstanceUID)+".Value"
+                << data_set.as_string(odil::registry::SOPInstanceUID, 0)),
+            BSON("$set" << BSON("Content" << "legacy")));
+    }
+    for(auto const & data_set: data_sets)
+    {
+        auto const stored = storage.retrieve(
+            data_set.as_string(odil::registry::SOPInstanceUID, 0));
+        BOOST_REQUIRE(stored == data_set);
+    }
+
+    BOOST_REQUIRE_EQUAL(storage.migrate_content(), 2);
+    BOOST_REQUIRE_EQUAL(storage.migrate_content(), 0);
+
+    for(auto const & data_set: data_sets)
+    {
+        auto const & sop_instance_uid = data_set.as_string(
+            odil::registry::SOPInstanceUID, 0);
+        auto const metadata = this->connection.findOne(
+            this->database+".datasets",
+            BSON(
+                std::string(odil::registry::SOPInstanceUID)+".Value"
+                << sop_instance_uid));
+        BOOST_REQUIRE_EQUAL(metadata["Content"].type(), mongo::Object);
+        BOOST_REQUIRE_EQUAL(
+            metadata["Content"]["store"].String(), "bulk");
+
+        auto const stored = storage.retrieve(sop_instance_uid);
+        BOOST_REQUIRE(stored == data_set);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(MigrateMetadata, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+
+    odil::DataSet data_set = this->get_data_set();
+    data_set.add(odil::registry::PatientName, {"Doe^John"});
+    data_set.add(odil::registry::StudyDate, {"20060705"});
+    storage.store(data_set);
+    BOOST_REQUIRE_EQUAL(storage.migrate_metadata(), 0);
+
+    // Person name and date without their normalized form, as written by
+    // older versions
+    auto const query = BSON(
+        std::string(odil::registry::SOPInstanceUID)+".Value"
+        << data_set.as_string(odil::registry::SOPInstanceUID, 0));
+    auto const path =
+        std::string(odil::registry::PatientName)+".Value.0."
+        +dopamine::normalized_alphabetic;
+    this->connection.update(
+        this->database+".datasets", query,
+        BSON("$unset" << BSON(path << "" << "Normalized" << "")));
+
+    BOOST_REQUIRE_EQUAL(storage.migrate_metadata(), 1);
+    BOOST_REQUIRE_EQUAL(storage.migrate_metadata(), 0);
+
+    auto const metadata = this->connection.findOne(
+        this->database+".datasets", query);
+    BOOST_REQUIRE_EQUAL(
+        metadata.getFieldDotted(path).String(), "DOE^JOHN");
+    BOOST_REQUIRE_EQUAL(
+        metadata.getFieldDotted(
+            "Normalized."+std::string(odil::registry::StudyDate)).type(),
+        mongo::Date);
+    BOOST_REQUIRE(storage.retrieve(
+        data_set.as_string(odil::registry::SOPInstanceUID, 0)) == data_set);
+}
+
+BOOST_FIXTURE_TEST_CASE(GridFSChunkSize, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_gridfs_limit(1);
+    storage.set_gridfs_chunk_size(16);
+    BOOST_REQUIRE_EQUAL(storage.get_gridfs_chunk_size(), 16);
+    storage.set_gridfs_readers(3);
+    BOOST_REQUIRE_EQUAL(storage.get_gridfs_readers(), 3);
+
+    odil::DataSet const data_set = this->get_data_set();
+    storage.store(data_set);
+
+    auto const file = this->connection.findOne(this->database+".fs.files", {});
+    BOOST_REQUIRE_EQUAL(file["chunkSize"].numberInt(), 16);
+    BOOST_REQUIRE_EQUAL(
+        this->connection.count(this->database+".fs.chunks"),
+        (file["length"].numberLong()+15)/16);
+
+    auto const stored = storage.retrieve(
+        data_set.as_string(odil::registry::SOPInstanceUID, 0));
+    BOOST_REQUIRE(stored == data_set);
+}
+
+BOOST_FIXTURE_TEST_CASE(Compression, Fixture)
+{
+    for(auto const & bulk_database: {std::string(), this->bulk_database})
+    {
+        // Content in the metadata or bulk document, and in GridFS
+        for(auto const limit: {1000, 1})
+        {
+            dopamine::archive::Storage storage(
+                this->connection_pool, this->database, bulk_database);
+            storage.set_gridfs_limit(limit);
+            storage.set_compression(3, 0);
+            BOOST_REQUIRE_EQUAL(storage.get_compression_level(), 3);
+            BOOST_REQUIRE_EQUAL(storage.get_compression_min_size(), 0);
+
+            odil::DataSet const data_set = this->get_data_set();
+            auto const & sop_instance_uid = data_set.as_string(
+                odil::registry::SOPInstanceUID, 0);
+            storage.store(data_set);
+
+            auto const metadata = this->connection.findOne(
+                this->database+".datasets",
+                BSON(
+                    std::string(odil::registry::SOPInstanceUID)+".Value"
+                    << sop_instance_uid));
+            BOOST_REQUIRE_EQUAL(metadata["Content"].type(), mongo::Object);
+            BOOST_REQUIRE_EQUAL(
+                metadata["Content"]["codec"].String(), "zstd");
+
+            auto const stored = storage.retrieve(sop_instance_uid);
+            BOOST_REQUIRE(stored == data_set);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CompressionMinSize, Fixture)
+{
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_gridfs_limit(1000);
+    storage.set_compression(3, 1000000);
+
+    odil::DataSet const data_set = this->get_data_set();
+    auto const & sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+    storage.store(data_set);
+
+    auto const metadata = this->connection.findOne(
+        this->database+".datasets",
+        BSON(
+            std::string(odil::registry::SOPInstanceUID)+".Value"
+            << sop_instance_uid));
+    BOOST_REQUIRE_EQUAL(metadata["Content"].type(), mongo::BinData);
+
+    auto const stored = storage.retrieve(sop_instance_uid);
+    BOOST_REQUIRE(stored == data_set);
+}
+
+BOOST_FIXTURE_TEST_CASE(BulkStorage, Fixture)
+{
+    auto const root =
+        boost::filesystem::temp_directory_path()
+        /boost::filesystem::unique_path();
+    auto const bulk_storage =
+        std::make_shared<dopamine::bulk::BulkStorageFilesystem>(
+            root.string(), false);
+
+    dopamine::archive::Storage storage(
+        this->connection_pool, this->database, this->bulk_database);
+    storage.set_bulk_storage(bulk_storage);
+    BOOST_REQUIRE(storage.get_bulk_storage() == bulk_storage);
+
+    odil::DataSet const data_set = this->get_data_set();
+    auto const & sop_instance_uid = data_set.as_string(
+        odil::registry::SOPInstanceUID, 0);
+    storage.store(data_set);
+
+    BOOST_REQUIRE(!this->connection.exists(this->database+".fs.files"));
+    BOOST_REQUIRE(!this->connection.exists(this->bulk_database+".datasets"));
+    BOOST_REQUIRE(!this->connection.exists(this->bulk_database+".fs.files"));
+
+    auto const metadata = this->connection.findOne(
+        this->database+".datasets",
+        BSON(
+            std::string(odil::registry::SOPInstanceUID)+".Value"
+            << sop_instance_uid));
+    auto const reference = metadata["Content"].Obj();
+    BOOST_REQUIRE_EQUAL(reference["store"].String(), "filesystem");
+    BOOST_REQUIRE(
+        boost::filesystem::exists(
+            bulk_storage->get_path(reference["id"].String())));
+
+    auto const stored = storage.retrieve(sop_instance_uid);
+    BOOST_REQUIRE(stored == data_set);
+
+    // Uncompressed content is memory-mapped
+    auto const view = storage.retrieve_view(sop_instance_uid);
+    BOOST_REQUIRE(
+        std::dynamic_pointer_cast<dopamine::bulk::MappedView>(view) != nullptr);
+
+    boost::filesystem::remove_all(root);
+}
+
+BOOST_FIXTURE_TEST_CASE(SweepBulkStorage, Fixture)
+{
+    auto const root =
+        boost::filesystem::temp_directory_path()
+        /boost::filesystem::unique_path();
+    auto const bulk_storage =
+        std::make_shared<dopamine::bulk::BulkStorageFilesystem>(
+            root.string(), false);
+
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
+    storage.set_bulk_storage(bulk_storage);
+    storage.set_duplicates(dopamine::archive::Storage::Duplicates::Replace);
+
+    odil::DataSet data_set = this->get_data_set();
+    storage.store(data_set);
+    auto const old_id = this->connection.findOne(
+        this->database+".datasets", {})["Content"].Obj()["id"].String();
+
+    // The replaced content is kept until it is swept.
+    odil::DataSet modified = data_set;
+    modified.add(odil::registry::PatientName, {"Doe^John"});
+    storage.store(modified);
+    auto const new_id = this->connection.findOne(
+        this->database+".datasets", {})["Content"].Obj()["id"].String();
+    BOOST_REQUIRE(old_id != new_id);
+    BOOST_REQUIRE(boost::filesystem::exists(bulk_storage->get_path(old_id)));
+
+    // Within the grace period
+    BOOST_REQUIRE_EQUAL(
+        storage.sweep_bulk_storage(std::chrono::seconds(60)), 0);
+
+    for(auto const & id: {old_id, new_id})
+    {
+        boost::filesystem::last_write_time(
+            bulk_storage->get_path(id), std::time(nullptr)-3600);
+    }
+    BOOST_REQUIRE_EQUAL(
+        storage.sweep_bulk_storage(std::chrono::seconds(60)), 1);
+    BOOST_REQUIRE(!boost::filesystem::exists(bulk_storage->get_path(old_id)));
+    BOOST_REQUIRE(storage.retrieve(data_set.as_string(
+        odil::registry::SOPInstanceUID, 0)) == modified);
+
+    boost::filesystem::remove_all(root);
+}
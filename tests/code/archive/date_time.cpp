@@ -0,0 +1,214 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE date_time
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <string>
+
+#include <mongo/bson/bson.h>
+#include <odil/DataSet.h>
+#include <odil/registry.h>
+
+#include "dopamine/archive/date_time.h"
+
+namespace
+{
+
+int64_t const day = 86400000;
+
+dopamine::archive::DateTimeInterval
+parse(std::string const & vr, std::string const & value)
+{
+    dopamine::archive::DateTimeInterval interval;
+    BOOST_REQUIRE(dopamine::archive::parse_date_time(vr, value, interval));
+    return interval;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(Unbounded)
+{
+    dopamine::archive::DateTimeInterval const interval;
+    BOOST_REQUIRE(!interval.has_begin());
+    BOOST_REQUIRE(!interval.has_end());
+}
+
+BOOST_AUTO_TEST_CASE(Date)
+{
+    auto const interval = parse("DA", "20060705");
+    BOOST_REQUIRE_EQUAL(interval.begin, 13334*day);
+    BOOST_REQUIRE_EQUAL(interval.end, 13335*day);
+
+    // Legacy format
+    BOOST_REQUIRE_EQUAL(parse("DA", "2006.07.05").begin, 13334*day);
+    BOOST_REQUIRE_EQUAL(parse("DA", "19691231").begin, -day);
+}
+
+BOOST_AUTO_TEST_CASE(DateInvalid)
+{
+    dopamine::archive::DateTimeInterval interval;
+    BOOST_REQUIRE(
+        !dopamine::archive::parse_date_time("DA", "20060230", interval));
+    BOOST_REQUIRE(
+        !dopamine::archive::parse_date_time("DA", "2006070", interval));
+    BOOST_REQUIRE(
+        !dopamine::archive::parse_date_time("DA", "2006O705", interval));
+}
+
+BOOST_AUTO_TEST_CASE(Time)
+{
+    // Precision of the value
+    auto interval = parse("TM", "10");
+    BOOST_REQUIRE_EQUAL(interval.begin, 36000000000LL);
+    BOOST_REQUIRE_EQUAL(interval.end, 39600000000LL);
+
+    interval = parse("TM", "1000");
+    BOOST_REQUIRE_EQUAL(interval.end, 36060000000LL);
+
+    interval = parse("TM", "100000.5");
+    BOOST_REQUIRE_EQUAL(interval.begin, 36000500000LL);
+    BOOST_REQUIRE_EQUAL(interval.end, 36000600000LL);
+
+    // Legacy format
+    interval = parse("TM", "10:00:00.123456");
+    BOOST_REQUIRE_EQUAL(interval.begin, 36000123456LL);
+    BOOST_REQUIRE_EQUAL(interval.end, 36000123457LL);
+}
+
+BOOST_AUTO_TEST_CASE(TimeInvalid)
+{
+    dopamine::archive::DateTimeInterval interval;
+    BOOST_REQUIRE(!dopamine::archive::parse_date_time("TM", "100", interval));
+    BOOST_REQUIRE(!dopamine::archive::parse_date_time("TM", "2400", interval));
+    BOOST_REQUIRE(
+        !dopamine::archive::parse_date_time("TM", "100000.", interval));
+}
+
+BOOST_AUTO_TEST_CASE(DateTime)
+{
+    auto interval = parse("DT", "2006");
+    BOOST_REQUIRE_EQUAL(interval.begin, 13149*day);
+    BOOST_REQUIRE_EQUAL(interval.end, 13514*day);
+
+    // UTC offset
+    interval = parse("DT", "200607051000-0500");
+    BOOST_REQUIRE_EQUAL(interval.begin, 13334*day+15*3600000LL);
+    BOOST_REQUIRE_EQUAL(interval.end, 13334*day+15*3600000LL+60000);
+
+    // Sub-millisecond precision is rounded outwards.
+    interval = parse("DT", "19700101000000.0001");
+    BOOST_REQUIRE_EQUAL(interval.begin, 0);
+    BOOST_REQUIRE_EQUAL(interval.end, 1);
+}
+
+BOOST_AUTO_TEST_CASE(Range)
+{
+    dopamine::archive::DateTimeInterval interval;
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range(
+            "DA", "20060705-20060707", interval));
+    BOOST_REQUIRE_EQUAL(interval.begin, 13334*day);
+    BOOST_REQUIRE_EQUAL(interval.end, 13337*day);
+
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range("DA", "20060705-", interval));
+    BOOST_REQUIRE_EQUAL(interval.begin, 13334*day);
+    BOOST_REQUIRE(!interval.has_end());
+
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range("DA", "-20060707", interval));
+    BOOST_REQUIRE(!interval.has_begin());
+    BOOST_REQUIRE_EQUAL(interval.end, 13337*day);
+
+    BOOST_REQUIRE(
+        !dopamine::archive::parse_date_time_range("DA", "-", interval));
+    BOOST_REQUIRE(
+        !dopamine::archive::parse_date_time_range("DA", "1930-1940", interval));
+}
+
+BOOST_AUTO_TEST_CASE(RangeDateTimeOffset)
+{
+    dopamine::archive::DateTimeInterval interval;
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range(
+            "DT", "200607051000-0500-200607071000-0500", interval));
+    BOOST_REQUIRE_EQUAL(interval.begin, 13334*day+15*3600000LL);
+    BOOST_REQUIRE_EQUAL(interval.end, 13336*day+15*3600000LL+60000);
+}
+
+BOOST_AUTO_TEST_CASE(Combine)
+{
+    dopamine::archive::DateTimeInterval dates, times;
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range(
+            "DA", "20060705-20060707", dates));
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range("TM", "1000-1800", times));
+
+    auto const interval = dopamine::archive::combine_date_time(dates, times);
+    BOOST_REQUIRE_EQUAL(interval.begin, 13334*day+10*3600000LL);
+    BOOST_REQUIRE_EQUAL(interval.end, 13336*day+18*3600000LL+60000);
+
+    // Open time bounds are the start and end of the days.
+    BOOST_REQUIRE(
+        dopamine::archive::parse_date_time_range("TM", "1000-", times));
+    auto const open = dopamine::archive::combine_date_time(dates, times);
+    BOOST_REQUIRE_EQUAL(open.begin, 13334*day+10*3600000LL);
+    BOOST_REQUIRE_EQUAL(open.end, 13337*day);
+}
+
+BOOST_AUTO_TEST_CASE(NormalizedValues)
+{
+    odil::DataSet data_set;
+    data_set.add(odil::registry::StudyDate, {"20060705"});
+    data_set.add(odil::registry::StudyTime, {"1000"});
+    data_set.add(odil::registry::AcquisitionDateTime, {"20060705100000"});
+    data_set.add(odil::registry::SeriesDate, {"invalid"});
+    data_set.add(odil::registry::ContentDate, {"20060705", "20060706"});
+
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::append_normalized_values(data_set, builder);
+    auto const normalized = builder.obj();
+
+    BOOST_REQUIRE_EQUAL(normalized.nFields(), 4);
+    BOOST_REQUIRE_EQUAL(
+        normalized[std::string(odil::registry::StudyDate)].date().millis,
+        13334*day);
+    BOOST_REQUIRE_EQUAL(
+        normalized[std::string(odil::registry::StudyTime)].numberLong(),
+        36000000000LL);
+    BOOST_REQUIRE_EQUAL(
+        normalized[
+            std::string(odil::registry::AcquisitionDateTime)].date().millis,
+        13334*day+10*3600000LL);
+    BOOST_REQUIRE_EQUAL(
+        normalized[
+            dopamine::archive::get_date_time_field(
+                odil::registry::StudyDate, odil::registry::StudyTime)
+        ].date().millis,
+        13334*day+10*3600000LL);
+}
+
+BOOST_AUTO_TEST_CASE(RangeCondition)
+{
+    dopamine::archive::DateTimeInterval interval;
+    interval.begin = 1000;
+
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::append_range_condition("date", "DA", interval, builder);
+    dopamine::archive::append_range_condition("time", "TM", interval, builder);
+    auto const condition = builder.obj();
+
+    BOOST_REQUIRE_EQUAL(condition["date"].Obj().nFields(), 1);
+    BOOST_REQUIRE_EQUAL(
+        condition["date"].Obj()["$gte"].date().millis, 1000);
+    BOOST_REQUIRE_EQUAL(condition["time"].Obj().nFields(), 1);
+    BOOST_REQUIRE_EQUAL(condition["time"].Obj()["$gte"].numberLong(), 1000);
+}
@@ -26,7 +26,7 @@ BOOST_FIXTURE_TEST_CASE(Echo, fixtures::Authorization)
         1, odil::registry::VerificationSOPClass);
 
     auto const status = dopamine::archive::echo(
-        this->connection, this->acl, parameters, request);
+        this->connection_pool, this->acl, parameters, request);
     BOOST_REQUIRE_EQUAL(status, odil::message::Response::Success);
 }
 
@@ -39,6 +39,6 @@ BOOST_FIXTURE_TEST_CASE(EchoBadUser, fixtures::Authorization)
         1, odil::registry::VerificationSOPClass);
 
     auto const status = dopamine::archive::echo(
-        this->connection, this->acl, parameters, request);
+        this->connection_pool, this->acl, parameters, request);
     BOOST_REQUIRE(odil::message::Response::is_failure(status));
 }
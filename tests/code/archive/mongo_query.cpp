@@ -14,6 +14,7 @@
 #include <odil/registry.h>
 
 #include "dopamine/archive/mongo_query.h"
+#include "dopamine/archive/QueryPlanCache.h"
 
 BOOST_AUTO_TEST_CASE(SingleValueString)
 {
@@ -75,26 +76,76 @@ BOOST_AUTO_TEST_CASE(WildCardOne)
     mongo::BSONElement const element(BSON("name" << "A?B")["name"]);
     mongo::BSONObjBuilder builder;
     dopamine::archive::as_mongo_query<dopamine::archive::MatchType::WildCard>(
-            "Field", "LO", element, builder);
-    BOOST_REQUIRE_EQUAL(builder.obj()["Field"].regex(), "^A.B$");
+            "Field.Value", "LO", element, builder);
+    auto const condition =
+        builder.obj()["Field.Value"].Obj()["$elemMatch"].Obj();
+    BOOST_REQUIRE_EQUAL(condition["$gte"].String(), "A");
+    BOOST_REQUIRE_EQUAL(condition["$lt"].String(), "B");
+    BOOST_REQUIRE_EQUAL(condition["$regex"].regex(), "^A.B$");
 }
 
 BOOST_AUTO_TEST_CASE(WildCardAny)
 {
-    mongo::BSONElement const element(BSON("name" << "A*B")["name"]);
+    mongo::BSONElement const element(BSON("name" << "*A*B")["name"]);
     mongo::BSONObjBuilder builder;
     dopamine::archive::as_mongo_query<dopamine::archive::MatchType::WildCard>(
             "Field", "LO", element, builder);
-    BOOST_REQUIRE_EQUAL(builder.obj()["Field"].regex(), "^A.*B$");
+    BOOST_REQUIRE_EQUAL(builder.obj()["Field"].regex(), "^.*A.*B$");
 }
 
 BOOST_AUTO_TEST_CASE(WildCardEscape)
 {
-    mongo::BSONElement const element(BSON("name" << "A^B.C")["name"]);
+    mongo::BSONElement const element(BSON("name" << "*A^B.C")["name"]);
     mongo::BSONObjBuilder builder;
     dopamine::archive::as_mongo_query<dopamine::archive::MatchType::WildCard>(
             "Field", "LO", element, builder);
-    BOOST_REQUIRE_EQUAL(builder.obj()["Field"].regex(), "^A\\^B\\.C$");
+    BOOST_REQUIRE_EQUAL(builder.obj()["Field"].regex(), "^.*A\\^B\\.C$");
+}
+
+BOOST_AUTO_TEST_CASE(WildCardPrefixUpperBound)
+{
+    mongo::BSONElement const element(BSON("name" << "A\xff*")["name"]);
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::as_mongo_query<dopamine::archive::MatchType::WildCard>(
+            "Field.Value", "LO", element, builder);
+    auto const condition =
+        builder.obj()["Field.Value"].Obj()["$elemMatch"].Obj();
+    BOOST_REQUIRE_EQUAL(condition["$gte"].String(), "A\xff");
+    BOOST_REQUIRE_EQUAL(condition["$lt"].String(), "B");
+    BOOST_REQUIRE_EQUAL(condition["$regex"].regex(), "^A\xff.*$");
+}
+
+BOOST_AUTO_TEST_CASE(WildCardPrefixArray)
+{
+    // Values in an array: the prefix range alone is matched by one value.
+    mongo::BSONElement const element(BSON("name" << "AB*")["name"]);
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::as_mongo_query<dopamine::archive::MatchType::WildCard>(
+            "Field.Value", "LO", element, builder);
+    BOOST_REQUIRE_EQUAL(
+        builder.obj(),
+        BSON(
+            "Field.Value" << BSON(
+                "$elemMatch" << BSON("$gte" << "AB" << "$lt" << "AC"))));
+}
+
+BOOST_AUTO_TEST_CASE(WildCardPrefixCompact)
+{
+    // Compact schema: multiple values are in an array, a single value is not.
+    mongo::BSONElement const element(BSON("name" << "AB*")["name"]);
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::as_mongo_query<dopamine::archive::MatchType::WildCard>(
+            "Field", "CS", element, builder);
+    BOOST_REQUIRE_EQUAL(
+        builder.obj(),
+        BSON(
+            "$or" << BSON_ARRAY(
+                BSON(
+                    "Field" << BSON(
+                        "$elemMatch" << BSON("$gte" << "AB" << "$lt" << "AC")))
+                << BSON(
+                    "Field" << BSON("$gte" << "AB" << "$lt" << "AC")
+                    << "Field.0" << BSON("$exists" << false)))));
 }
 
 BOOST_AUTO_TEST_CASE(WildCardPersonName)
@@ -106,7 +157,42 @@ BOOST_AUTO_TEST_CASE(WildCardPersonName)
     dopamine::archive::as_mongo_query<
         dopamine::archive::MatchType::WildCard>(
             "Field", "PN", element, builder);
-    BOOST_REQUIRE_EQUAL(builder.obj()["Field.Alphabetic"].regex(), "^.*$");
+    BOOST_REQUIRE_EQUAL(
+        builder.obj()["Field.Alphabetic_norm"].regex(), "^.*$");
+}
+
+BOOST_AUTO_TEST_CASE(WildCardPersonNamePrefix)
+{
+    mongo::BSONElement const element(
+        BSON("name" << BSON("Alphabetic" << "Doe^J*"))["name"]);
+
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::as_mongo_query<
+        dopamine::archive::MatchType::WildCard>(
+            "Field.Value", "PN", element, builder);
+    BOOST_REQUIRE_EQUAL(
+        builder.obj(),
+        BSON(
+            "Field.Value" << BSON(
+                "$elemMatch" << BSON(
+                    "Alphabetic_norm" << BSON(
+                        "$gte" << "DOE^J" << "$lt" << "DOE^K")))));
+
+    mongo::BSONObjBuilder compact_builder;
+    dopamine::archive::as_mongo_query<
+        dopamine::archive::MatchType::WildCard>(
+            "Field", "PN", element, compact_builder);
+    auto const condition = BSON("$gte" << "DOE^J" << "$lt" << "DOE^K");
+    BOOST_REQUIRE_EQUAL(
+        compact_builder.obj(),
+        BSON(
+            "$or" << BSON_ARRAY(
+                BSON(
+                    "Field" << BSON(
+                        "$elemMatch" << BSON("Alphabetic_norm" << condition)))
+                << BSON(
+                    "Field.Alphabetic_norm" << condition
+                    << "Field.0" << BSON("$exists" << false)))));
 }
 
 BOOST_AUTO_TEST_CASE(Range)
@@ -122,6 +208,32 @@ BOOST_AUTO_TEST_CASE(Range)
             "$gte" << "20160101" << "$lte" << "20161231")));
 }
 
+BOOST_AUTO_TEST_CASE(RangeNormalized)
+{
+    mongo::BSONElement const element(
+        BSON("name" << "20160101-20161231")["name"]);
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::as_mongo_query<
+        dopamine::archive::MatchType::Range>(
+            "00080020.Value", "DA", element, builder);
+    BOOST_REQUIRE_EQUAL(
+        builder.obj(), BSON("Normalized.00080020" << BSON(
+            "$gte" << mongo::Date_t(1451606400000ULL)
+            << "$lt" << mongo::Date_t(1483228800000ULL))));
+}
+
+BOOST_AUTO_TEST_CASE(RangeNormalizedTime)
+{
+    mongo::BSONElement const element(BSON("name" << "-1000")["name"]);
+    mongo::BSONObjBuilder builder;
+    dopamine::archive::as_mongo_query<
+        dopamine::archive::MatchType::Range>(
+            "00080030", "TM", element, builder);
+    BOOST_REQUIRE_EQUAL(
+        builder.obj(),
+        BSON("Normalized.00080030" << BSON("$lt" << 36060000000LL)));
+}
+
 BOOST_AUTO_TEST_CASE(MultipleValues)
 {
     mongo::BSONElement const element(
@@ -182,6 +294,34 @@ BOOST_AUTO_TEST_CASE(QueryPatient)
     ));
 }
 
+BOOST_AUTO_TEST_CASE(QueryPatientCompact)
+{
+    odil::DataSet data_set;
+    data_set.add("QueryRetrieveLevel", {"PATIENT"});
+    data_set.add("PatientName", {"Doe^John"});
+    data_set.add("PatientSex", {"M"});
+
+    mongo::BSONArrayBuilder terms;
+    mongo::BSONObjBuilder fields;
+    dopamine::archive::as_mongo_query(
+        data_set, terms, fields, dopamine::Schema::Compact);
+
+    BOOST_REQUIRE_EQUAL(
+        terms.arr(), BSON_ARRAY(
+            BSON(
+                std::string(odil::registry::PatientName)+".Alphabetic"
+                << "Doe^John")
+            << BSON(std::string(odil::registry::PatientSex) << "M")
+    ));
+
+    BOOST_REQUIRE_EQUAL(
+        fields.obj(), BSON(
+            std::string(odil::registry::PatientName) << 1
+            << std::string(odil::registry::PatientSex) << 1
+            << std::string(odil::registry::PatientID) << 1
+    ));
+}
+
 BOOST_AUTO_TEST_CASE(QueryStudy)
 {
     odil::DataSet data_set;
@@ -206,6 +346,35 @@ BOOST_AUTO_TEST_CASE(QueryStudy)
     ));
 }
 
+BOOST_AUTO_TEST_CASE(QueryStudyDateTime)
+{
+    odil::DataSet data_set;
+    data_set.add("QueryRetrieveLevel", {"STUDY"});
+    data_set.add("StudyDate", {"20060705-20060707"});
+    data_set.add("StudyTime", {"1000-1800"});
+
+    mongo::BSONArrayBuilder terms;
+    mongo::BSONObjBuilder fields;
+    dopamine::archive::as_mongo_query(data_set, terms, fields);
+
+    // The date and time ranges are combined.
+    BOOST_REQUIRE_EQUAL(
+        terms.arr(), BSON_ARRAY(
+            BSON(
+                "Normalized.00080020_00080030" << BSON(
+                    "$gte" << mongo::Date_t(1152093600000ULL)
+                    << "$lt" << mongo::Date_t(1152295260000ULL)))
+    ));
+
+    BOOST_REQUIRE_EQUAL(
+        fields.obj(), BSON(
+            std::string(odil::registry::StudyDate) << 1
+            << std::string(odil::registry::StudyTime) << 1
+            << std::string(odil::registry::PatientID) << 1
+            << std::string(odil::registry::StudyInstanceUID) << 1
+    ));
+}
+
 BOOST_AUTO_TEST_CASE(QuerySeries)
 {
     odil::DataSet data_set;
@@ -268,3 +437,81 @@ BOOST_AUTO_TEST_CASE(QueryImage)
             << std::string(odil::registry::SOPInstanceUID) << 1
     ));
 }
+
+BOOST_AUTO_TEST_CASE(QueryCached)
+{
+    dopamine::archive::QueryPlanCache cache;
+
+    odil::DataSet data_set;
+    data_set.add("QueryRetrieveLevel", {"STUDY"});
+    data_set.add("PatientID", {"1.2.3.4"});
+    data_set.add("StudyDescription");
+
+    mongo::BSONArrayBuilder terms;
+    mongo::BSONObjBuilder fields;
+    dopamine::archive::as_mongo_query(
+        data_set, terms, fields, dopamine::Schema::Verbose, &cache);
+    BOOST_REQUIRE_EQUAL(cache.size(), 1);
+    BOOST_REQUIRE_EQUAL(cache.get_hits(), 0);
+    BOOST_REQUIRE_EQUAL(cache.get_misses(), 1);
+
+    // Same shape, other values: the plan is re-used.
+    data_set.as_string(odil::registry::PatientID) = {"5.6.7.8"};
+    mongo::BSONArrayBuilder cached_terms;
+    mongo::BSONObjBuilder cached_fields;
+    dopamine::archive::as_mongo_query(
+        data_set, cached_terms, cached_fields,
+        dopamine::Schema::Verbose, &cache);
+    BOOST_REQUIRE_EQUAL(cache.size(), 1);
+    BOOST_REQUIRE_EQUAL(cache.get_hits(), 1);
+
+    BOOST_REQUIRE_EQUAL(
+        cached_terms.arr(), BSON_ARRAY(
+            BSON(std::string(odil::registry::PatientID)+".Value" << "5.6.7.8")
+    ));
+    BOOST_REQUIRE_EQUAL(cached_fields.obj(), fields.obj());
+
+    // Other match type: other shape.
+    data_set.as_string(odil::registry::PatientID) = {"5.6*"};
+    mongo::BSONArrayBuilder wildcard_terms;
+    mongo::BSONObjBuilder wildcard_fields;
+    dopamine::archive::as_mongo_query(
+        data_set, wildcard_terms, wildcard_fields,
+        dopamine::Schema::Verbose, &cache);
+    BOOST_REQUIRE_EQUAL(cache.size(), 2);
+    BOOST_REQUIRE_EQUAL(cache.get_misses(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(QueryCachedDateTime)
+{
+    dopamine::archive::QueryPlanCache cache;
+
+    odil::DataSet data_set;
+    data_set.add("QueryRetrieveLevel", {"STUDY"});
+    data_set.add("StudyDate", {"20060705-20060707"});
+    data_set.add("StudyTime", {"1000-1800"});
+
+    mongo::BSONArrayBuilder terms;
+    mongo::BSONObjBuilder fields;
+    dopamine::archive::as_mongo_query(
+        data_set, terms, fields, dopamine::Schema::Verbose, &cache);
+
+    // Same shape, but the dates cannot be combined with the times.
+    data_set.as_string(odil::registry::StudyDate) = {"2006-2007"};
+    mongo::BSONArrayBuilder cached_terms;
+    mongo::BSONObjBuilder cached_fields;
+    dopamine::archive::as_mongo_query(
+        data_set, cached_terms, cached_fields,
+        dopamine::Schema::Verbose, &cache);
+    BOOST_REQUIRE_EQUAL(cache.get_hits(), 1);
+
+    BOOST_REQUIRE_EQUAL(
+        cached_terms.arr(), BSON_ARRAY(
+            BSON(
+                std::string(odil::registry::StudyDate)+".Value"
+                << BSON("$gte" << "2006" << "$lte" << "2007"))
+            << BSON(
+                "Normalized."+std::string(odil::registry::StudyTime) << BSON(
+                    "$gte" << 36000000000LL << "$lt" << 64860000000LL))
+    ));
+}
@@ -25,7 +25,7 @@ struct Fixture: public fixtures::Authorization
     odil::DataSet data_set;
 
     Fixture()
-    : storage(this->connection, this->database)
+    : storage(this->connection_pool, this->database)
     {
         this->data_set.add(odil::registry::PatientName, { "Patient 1" });
         this->data_set.add(odil::registry::PatientID, { "1" });
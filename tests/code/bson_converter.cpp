@@ -16,6 +16,7 @@
 #include <odil/VR.h>
 
 #include "dopamine/bson_converter.h"
+#include "dopamine/Exception.h"
 
 template<typename TChecker, typename TGetter, typename TValue>
 void check_bson_array(
@@ -185,8 +186,11 @@ BOOST_AUTO_TEST_CASE(AsBSONPersonName)
             element.Obj().getField("Value").Array();
     BOOST_REQUIRE_EQUAL(array.size(), 1);
     check_bson_object(
-        array[0].Obj(), {"Alphabetic", "Ideographic", "Phonetic"});
+        array[0].Obj(),
+        {"Alphabetic", "Alphabetic_norm", "Ideographic", "Phonetic"});
     check_bson_string(array[0].Obj().getField("Alphabetic"), {"Alpha^Betic"});
+    check_bson_string(
+        array[0].Obj().getField("Alphabetic_norm"), {"ALPHA^BETIC"});
     check_bson_string(array[0].Obj().getField("Ideographic"), {"Ideo^Graphic"});
     check_bson_string(array[0].Obj().getField("Phonetic"), {"Pho^Netic"});
 }
@@ -212,9 +216,13 @@ BOOST_AUTO_TEST_CASE(AsBSONPersonNameUnicode)
     std::vector<mongo::BSONElement> array =
             element.Obj().getField("Value").Array();
     BOOST_REQUIRE_EQUAL(array.size(), 1);
-    check_bson_object(array[0].Obj(), {"Alphabetic"});
+    check_bson_object(array[0].Obj(), {"Alphabetic", "Alphabetic_norm"});
     check_bson_string(
         array[0].Obj().getField("Alphabetic"), {"Buc^J\xc3\xa9r\xc3\xb4me"});
+    // Only ASCII letters are normalized
+    check_bson_string(
+        array[0].Obj().getField("Alphabetic_norm"),
+        {"BUC^J\xc3\xa9R\xc3\xb4ME"});
 }
 
 BOOST_AUTO_TEST_CASE(AsBSONDataSets)
@@ -265,6 +273,145 @@ BOOST_AUTO_TEST_CASE(AsBSONBinary)
                       data_set.as_binary(0xdeadbeef));
 }
 
+BOOST_AUTO_TEST_CASE(AsBSONBuilder)
+{
+    odil::DataSet item;
+    item.add(0xbeeff00d, odil::Value::Strings({"foo"}), odil::VR::CS);
+    odil::DataSet data_set;
+    data_set.add(0xdeadbeef, odil::Value::DataSets({item, item}), odil::VR::SQ);
+    data_set.add(0xdeadf00d, odil::Value::Reals({1.5}), odil::VR::FD);
+
+    // Append after an existing field
+    mongo::BSONObjBuilder builder;
+    builder << "_id" << 1;
+    dopamine::as_bson(data_set, builder);
+    auto const bson = builder.obj();
+
+    check_bson_object(bson, {"_id", "deadbeef", "deadf00d"});
+    BOOST_REQUIRE(
+        bson.removeField("_id") == dopamine::as_bson(data_set));
+}
+
+BOOST_AUTO_TEST_CASE(AsBSONRepeated)
+{
+    odil::DataSet small;
+    small.add(0xdeadbeef, odil::Value::Strings({"foo"}), odil::VR::CS);
+    odil::DataSet large;
+    large.add(0xdeadbeef, odil::Value::Strings(1000, "bar"), odil::VR::CS);
+
+    // Results must not share the conversion buffer.
+    auto const large_bson = dopamine::as_bson(large);
+    auto const small_bson = dopamine::as_bson(small);
+    auto const large_bson_2 = dopamine::as_bson(large);
+
+    BOOST_REQUIRE_EQUAL(
+        small_bson["deadbeef"].Obj()["Value"].Array().size(), 1);
+    BOOST_REQUIRE_EQUAL(
+        large_bson["deadbeef"].Obj()["Value"].Array().size(), 1000);
+    BOOST_REQUIRE(large_bson == large_bson_2);
+}
+
+BOOST_AUTO_TEST_CASE(AsBSONCompact)
+{
+    odil::DataSet item;
+    item.add(odil::registry::PatientID, {"1234"});
+    odil::DataSet data_set;
+    data_set.add(odil::registry::PatientID, {"1234"});
+    data_set.add(odil::registry::ReferencedFrameNumber, {1, 2});
+    data_set.add(odil::registry::PatientName, {"Doe^John"});
+    data_set.add(odil::registry::OtherPatientIDsSequence, {item});
+    data_set.add(odil::registry::PatientAge, odil::Value::Strings());
+    data_set.add(0x00091001, {"private"}, odil::VR::LO);
+
+    auto const bson = dopamine::as_bson(
+        data_set, {}, dopamine::Schema::Compact);
+
+    // Single value: scalar
+    BOOST_REQUIRE_EQUAL(bson["00100020"].String(), "1234");
+    // Multiple values: array
+    check_bson_array(
+        bson["00081160"], &mongo::BSONElement::isNumber,
+        &mongo::BSONElement::Long,
+        odil::Value::Integers({1, 2}));
+    // Person name and item: object
+    BOOST_REQUIRE_EQUAL(
+        bson["00100010"].Obj()["Alphabetic"].String(), "Doe^John");
+    BOOST_REQUIRE_EQUAL(
+        bson["00101002"].Obj()["00100020"].String(), "1234");
+    // No value: empty array
+    BOOST_REQUIRE(bson["00101010"].Array().empty());
+    // Private element: verbose
+    check_bson_object(bson["00091001"].Obj(), {"vr", "Value"});
+}
+
+BOOST_AUTO_TEST_CASE(AsBSONCompactOtherVR)
+{
+    // Elements whose VR is not the dictionary one are stored verbose.
+    odil::DataSet data_set;
+    data_set.add(odil::registry::PatientID, {"1234"}, odil::VR::SH);
+
+    auto const bson = dopamine::as_bson(
+        data_set, {}, dopamine::Schema::Compact);
+    check_bson_object(bson["00100020"].Obj(), {"vr", "Value"});
+    check_bson_string(bson["00100020"].Obj()["vr"], "SH");
+}
+
+BOOST_AUTO_TEST_CASE(AsSchema)
+{
+    BOOST_REQUIRE(
+        dopamine::as_schema("verbose") == dopamine::Schema::Verbose);
+    BOOST_REQUIRE(
+        dopamine::as_schema("compact") == dopamine::Schema::Compact);
+    BOOST_REQUIRE_THROW(dopamine::as_schema("foo"), dopamine::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(GetValuePath)
+{
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_value_path(
+            odil::registry::PatientID, dopamine::Schema::Verbose),
+        "00100020.Value");
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_value_path(
+            odil::registry::PatientID, dopamine::Schema::Compact),
+        "00100020");
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_value_path(
+            odil::registry::EncapsulatedDocument, odil::VR::OB,
+            dopamine::Schema::Verbose),
+        "00420011.InlineBinary");
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_value_path(
+            odil::registry::PatientID, odil::VR::SH, dopamine::Schema::Compact),
+        "00100020.Value");
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_value_path(0x00091001, dopamine::Schema::Compact),
+        "00091001.Value");
+}
+
+BOOST_AUTO_TEST_CASE(GetFirstValue)
+{
+    auto const bson = BSON(
+        "verbose" << BSON("vr" << "LO" << "Value" << BSON_ARRAY("foo" << "bar"))
+        << "empty" << BSON("vr" << "LO")
+        << "scalar" << "foo"
+        << "array" << BSON_ARRAY("foo" << "bar")
+        << "empty_array" << mongo::BSONArray()
+        << "item" << BSON("Alphabetic" << "Doe^John"));
+
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_first_value(bson["verbose"]).String(), "foo");
+    BOOST_REQUIRE(dopamine::get_first_value(bson["empty"]).eoo());
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_first_value(bson["scalar"]).String(), "foo");
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_first_value(bson["array"]).String(), "foo");
+    BOOST_REQUIRE(dopamine::get_first_value(bson["empty_array"]).eoo());
+    BOOST_REQUIRE_EQUAL(
+        dopamine::get_first_value(bson["item"]).Obj()["Alphabetic"].String(),
+        "Doe^John");
+}
+
 BOOST_AUTO_TEST_CASE(AsDataSetEmpty)
 {
     mongo::BSONObj bson;
@@ -441,3 +588,115 @@ BOOST_AUTO_TEST_CASE(AsDataSetBinary)
         data_set.as_binary("deadbeef") ==
         odil::Value::Binary({{0x1, 0x2, 0x3}, {0x4, 0x5}}));
 }
+
+BOOST_AUTO_TEST_CASE(AsDataSetOtherFields)
+{
+    auto const bson = BSON(
+        "_id" << 1 << "Content" << "foo" << "ContentHash" << "sha1:0"
+        << "PatientID" << BSON("vr" << "LO" << "Value" << BSON_ARRAY("1"))
+        << "0010abcd" << BSON("vr" << "CS" << "Value" << BSON_ARRAY("FOO")));
+
+    odil::DataSet const data_set = dopamine::as_dataset(bson);
+    BOOST_REQUIRE_EQUAL(data_set.size(), 1);
+    BOOST_REQUIRE(data_set.has(odil::Tag(0x0010, 0xabcd)));
+}
+
+BOOST_AUTO_TEST_CASE(AsDataSetNoValue)
+{
+    auto const bson = BSON("deadbeef" << BSON("vr" << "LO"));
+
+    odil::DataSet const data_set = dopamine::as_dataset(bson);
+    BOOST_REQUIRE_EQUAL(data_set.size(), 1);
+    BOOST_REQUIRE(data_set.get_vr("deadbeef") == odil::VR::LO);
+    BOOST_REQUIRE(data_set.empty("deadbeef"));
+}
+
+BOOST_AUTO_TEST_CASE(AsDataSetNoVR)
+{
+    auto const bson = BSON(
+        "deadbeef" << BSON("Value" << BSON_ARRAY("FOO")));
+    BOOST_REQUIRE_THROW(dopamine::as_dataset(bson), dopamine::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(AsDataSetPersonNameComponents)
+{
+    auto const bson = BSON(
+        "deadbeef" << BSON(
+            "vr" << "PN" << "Value" << BSON_ARRAY(
+                BSON("Alphabetic" << "Doe^John")
+                << BSON("Phonetic" << "Pho^Netic")
+                << BSON("Alphabetic" << ""))));
+
+    odil::DataSet const data_set = dopamine::as_dataset(bson);
+    BOOST_REQUIRE(data_set.as_string("deadbeef") == odil::Value::Strings(
+        {"Doe^John", "==Pho^Netic", ""}));
+}
+
+BOOST_AUTO_TEST_CASE(RoundTrip)
+{
+    odil::DataSet item;
+    item.add(odil::registry::PatientName, {"Doe^John=Ideo=Pho"});
+    item.add(odil::registry::PatientWeight, {72.5});
+    item.add(odil::registry::ReferencedFrameNumber, {1, 2, 3});
+
+    odil::DataSet data_set;
+    data_set.add(odil::registry::SpecificCharacterSet, {"ISO_IR 100"});
+    data_set.add(odil::registry::PatientID, {"J\xe9r\xf4me"});
+    data_set.add(
+        odil::registry::OtherPatientIDsSequence,
+        odil::Value::DataSets({item, item}));
+
+    BOOST_REQUIRE(
+        dopamine::as_dataset(dopamine::as_bson(data_set)) == data_set);
+}
+
+BOOST_AUTO_TEST_CASE(AsDataSetCompact)
+{
+    auto const bson = BSON(
+        "00100020" << "1234"
+        << "00081160" << BSON_ARRAY(1 << 2)
+        << "00100010" << BSON("Alphabetic" << "Doe^John")
+        << "00101010" << mongo::BSONArray()
+        << "00091001" << BSON("vr" << "LO" << "Value" << BSON_ARRAY("foo")));
+
+    odil::DataSet const data_set = dopamine::as_dataset(bson);
+    BOOST_REQUIRE_EQUAL(data_set.size(), 5);
+    BOOST_REQUIRE(data_set.get_vr(odil::registry::PatientID) == odil::VR::LO);
+    BOOST_REQUIRE(
+        data_set.as_string(odil::registry::PatientID)
+            == odil::Value::Strings({"1234"}));
+    BOOST_REQUIRE(
+        data_set.as_int(odil::registry::ReferencedFrameNumber)
+            == odil::Value::Integers({1, 2}));
+    BOOST_REQUIRE(
+        data_set.as_string(odil::registry::PatientName)
+            == odil::Value::Strings({"Doe^John"}));
+    BOOST_REQUIRE(data_set.empty(odil::registry::PatientAge));
+    BOOST_REQUIRE(
+        data_set.as_string(0x00091001) == odil::Value::Strings({"foo"}));
+}
+
+BOOST_AUTO_TEST_CASE(RoundTripCompact)
+{
+    odil::DataSet item;
+    item.add(odil::registry::PatientName, {"Doe^John=Ideo=Pho"});
+    item.add(odil::registry::PatientWeight, {72.5});
+    item.add(odil::registry::ReferencedFrameNumber, {1, 2, 3});
+
+    odil::DataSet data_set;
+    data_set.add(odil::registry::SpecificCharacterSet, {"ISO_IR 100"});
+    data_set.add(odil::registry::PatientID, {"J\xe9r\xf4me"});
+    data_set.add(odil::registry::PatientAge, odil::Value::Strings());
+    data_set.add(
+        odil::registry::OtherPatientIDsSequence,
+        odil::Value::DataSets({item, item}));
+    data_set.add(
+        odil::registry::EncapsulatedDocument,
+        odil::Value::Binary({{0x1, 0x2, 0x3}}), odil::VR::OB);
+    data_set.add(0x00091001, {"private"}, odil::VR::LO);
+
+    BOOST_REQUIRE(
+        dopamine::as_dataset(
+            dopamine::as_bson(data_set, {}, dopamine::Schema::Compact))
+        == data_set);
+}
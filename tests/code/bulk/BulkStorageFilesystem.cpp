@@ -0,0 +1,168 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE BulkStorageFilesystem
+#include <boost/test/unit_test.hpp>
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "dopamine/bulk/BulkStorageFilesystem.h"
+#include "dopamine/bulk/factory.h"
+#include "dopamine/bulk/View.h"
+#include "dopamine/Exception.h"
+
+struct Fixture
+{
+    std::string const root;
+
+    Fixture()
+    : root(
+        (boost::filesystem::temp_directory_path()
+            /boost::filesystem::unique_path()).string())
+    {
+        // Nothing else.
+    }
+
+    ~Fixture()
+    {
+        boost::filesystem::remove_all(this->root);
+    }
+
+    static dopamine::bulk::BulkStorageBase::Writer
+    get_writer(std::string const & content)
+    {
+        return [content](std::streambuf & buffer) {
+            buffer.sputn(content.c_str(), content.size());
+        };
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(Constructor, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem const storage(this->root, false);
+    BOOST_REQUIRE_EQUAL(storage.get_root(), this->root);
+    BOOST_REQUIRE(!storage.get_fsync());
+    BOOST_REQUIRE_EQUAL(storage.get_name(), "filesystem");
+}
+
+BOOST_FIXTURE_TEST_CASE(StoreRetrieve, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    auto const id = storage.store(this->get_writer("hello"));
+    // SHA-1 of "hello"
+    BOOST_REQUIRE_EQUAL(id, "aaf4c61ddcc5e8a2dabede0f3b482cd9aea9434d");
+    BOOST_REQUIRE(
+        boost::filesystem::is_regular_file(
+            boost::filesystem::path(this->root)/"aa"/"f4"/id));
+    BOOST_REQUIRE_EQUAL(storage.retrieve(id), "hello");
+}
+
+BOOST_FIXTURE_TEST_CASE(StoreLarge, Fixture)
+{
+    std::string content;
+    for(int i=0; i<1000000; ++i)
+    {
+        content += std::to_string(i);
+    }
+
+    dopamine::bulk::BulkStorageFilesystem storage(this->root, false);
+    auto const id = storage.store(this->get_writer(content));
+    BOOST_REQUIRE(storage.retrieve(id) == content);
+}
+
+BOOST_FIXTURE_TEST_CASE(Deduplicate, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    auto const id_1 = storage.store(this->get_writer("hello"));
+    auto const id_2 = storage.store(this->get_writer("hello"));
+    BOOST_REQUIRE_EQUAL(id_1, id_2);
+    BOOST_REQUIRE(
+        boost::filesystem::is_empty(boost::filesystem::path(this->root)/"tmp"));
+}
+
+BOOST_FIXTURE_TEST_CASE(View, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    auto const id = storage.store(this->get_writer("hello"));
+    auto const view = storage.view(id);
+    BOOST_REQUIRE(
+        std::dynamic_pointer_cast<dopamine::bulk::MappedView>(view) != nullptr);
+    BOOST_REQUIRE_EQUAL(std::string(view->data(), view->size()), "hello");
+
+    BOOST_REQUIRE_THROW(
+        storage.view(std::string(40, '0')), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(Remove, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    auto const id = storage.store(this->get_writer("hello"));
+    storage.remove(id);
+    BOOST_REQUIRE(!boost::filesystem::exists(storage.get_path(id)));
+    BOOST_REQUIRE_THROW(storage.retrieve(id), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(List, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    BOOST_REQUIRE(storage.list(std::time(nullptr)+60).empty());
+
+    auto const old = storage.store(this->get_writer("hello"));
+    auto const recent = storage.store(this->get_writer("world"));
+    boost::filesystem::last_write_time(
+        storage.get_path(old), std::time(nullptr)-3600);
+    boost::filesystem::last_write_time(
+        storage.get_path(recent), std::time(nullptr)-3600);
+    // Storing an identical content refreshes its file.
+    storage.store(this->get_writer("world"));
+
+    BOOST_REQUIRE(
+        storage.list(std::time(nullptr)-60) == std::vector<std::string>{old});
+}
+
+BOOST_FIXTURE_TEST_CASE(FailedWriter, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    BOOST_REQUIRE_THROW(
+        storage.store(
+            [](std::streambuf &) { throw dopamine::Exception("foo"); }),
+        dopamine::Exception);
+    BOOST_REQUIRE(
+        boost::filesystem::is_empty(boost::filesystem::path(this->root)/"tmp"));
+}
+
+BOOST_FIXTURE_TEST_CASE(InvalidIdentifier, Fixture)
+{
+    dopamine::bulk::BulkStorageFilesystem storage(this->root);
+    BOOST_REQUIRE_THROW(
+        storage.retrieve("../../etc/passwd"), dopamine::Exception);
+}
+
+BOOST_FIXTURE_TEST_CASE(Factory, Fixture)
+{
+    BOOST_REQUIRE(!dopamine::bulk::factory({}));
+    BOOST_REQUIRE(!dopamine::bulk::factory({{"type", "MongoDB"}}));
+
+    auto const storage = std::dynamic_pointer_cast<
+            dopamine::bulk::BulkStorageFilesystem>(
+        dopamine::bulk::factory(
+            {{"type", "Filesystem"}, {"root", this->root}, {"fsync", "false"}}));
+    BOOST_REQUIRE(storage);
+    BOOST_REQUIRE_EQUAL(storage->get_root(), this->root);
+    BOOST_REQUIRE(!storage->get_fsync());
+
+    BOOST_REQUIRE_THROW(
+        dopamine::bulk::factory({{"type", "foo"}}), dopamine::Exception);
+}
@@ -0,0 +1,105 @@
+/*************************************************************************
+ * dopamine - Copyright (C) Universite de Strasbourg
+ * Distributed under the terms of the CeCILL-B license, as published by
+ * the CEA-CNRS-INRIA. Refer to the LICENSE file or to
+ * http://www.cecill.info/licences/Licence_CeCILL-B_V1-en.html
+ * for details.
+ ************************************************************************/
+
+#define BOOST_TEST_MODULE View
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "dopamine/bulk/View.h"
+#include "dopamine/Exception.h"
+
+struct Fixture
+{
+    std::string const path;
+
+    Fixture()
+    : path(
+        (boost::filesystem::temp_directory_path()
+            /boost::filesystem::unique_path()).string())
+    {
+        // Nothing else.
+    }
+
+    ~Fixture()
+    {
+        boost::filesystem::remove(this->path);
+    }
+
+    void write(std::string const & content) const
+    {
+        std::ofstream stream(this->path, std::ios::binary);
+        stream << content;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(StringView)
+{
+    dopamine::bulk::StringView const view("hello");
+    BOOST_REQUIRE_EQUAL(view.size(), 5);
+    BOOST_REQUIRE_EQUAL(std::string(view.data(), view.size()), "hello");
+}
+
+BOOST_FIXTURE_TEST_CASE(MappedView, Fixture)
+{
+    this->write("hello, world");
+    dopamine::bulk::MappedView const view(this->path);
+    BOOST_REQUIRE_EQUAL(view.size(), 12);
+    BOOST_REQUIRE_EQUAL(std::string(view.data(), view.size()), "hello, world");
+}
+
+BOOST_FIXTURE_TEST_CASE(MappedViewEmpty, Fixture)
+{
+    this->write("");
+    dopamine::bulk::MappedView const view(this->path);
+    BOOST_REQUIRE_EQUAL(view.size(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(MappedViewMissing, Fixture)
+{
+    BOOST_REQUIRE_THROW(
+        dopamine::bulk::MappedView(this->path), dopamine::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(ViewBufferRead)
+{
+    std::string const content("hello, world");
+    dopamine::bulk::ViewBuffer buffer(content.c_str(), content.size());
+    std::istream stream(&buffer);
+    std::string const read(
+        (std::istreambuf_iterator<char>(stream)),
+        std::istreambuf_iterator<char>());
+    BOOST_REQUIRE_EQUAL(read, content);
+}
+
+BOOST_AUTO_TEST_CASE(ViewBufferSeek)
+{
+    std::string const content("hello, world");
+    dopamine::bulk::ViewBuffer buffer(content.c_str(), content.size());
+    std::istream stream(&buffer);
+
+    stream.seekg(7);
+    BOOST_REQUIRE_EQUAL(stream.tellg(), 7);
+    std::string word;
+    stream >> word;
+    BOOST_REQUIRE_EQUAL(word, "world");
+
+    stream.clear();
+    stream.seekg(-5, std::ios::end);
+    BOOST_REQUIRE_EQUAL(stream.tellg(), 7);
+    stream.seekg(-7, std::ios::cur);
+    BOOST_REQUIRE_EQUAL(stream.tellg(), 0);
+
+    stream.seekg(20);
+    BOOST_REQUIRE(stream.fail());
+}
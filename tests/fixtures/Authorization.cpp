@@ -17,7 +17,7 @@ namespace fixtures
 
 Authorization
 ::Authorization()
-: MongoDB(), acl(this->connection, this->database)
+: MongoDB(), acl(this->connection_pool, this->database)
 {
     this->acl.set_entries({
         { "echo", "Echo", {} },
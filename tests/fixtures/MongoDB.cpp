@@ -15,6 +15,8 @@
 
 #include <mongo/client/dbclient.h>
 
+#include "dopamine/ConnectionPool.h"
+
 namespace {
 
 class Appender : public mongo::logger::MessageLogDomain::EventAppender {
@@ -41,7 +43,7 @@ namespace fixtures
 
 MongoDB
 ::MongoDB()
-: database(this->_generate_database_name())
+: connection_pool("localhost"), database(this->_generate_database_name())
 {
     if(!this->_client_initialized)
     {
@@ -13,6 +13,8 @@
 
 #include <mongo/client/dbclient.h>
 
+#include "dopamine/ConnectionPool.h"
+
 namespace fixtures
 {
 
@@ -24,6 +26,7 @@ class MongoDB
 {
 public:
     mongo::DBClientConnection connection;
+    dopamine::ConnectionPool connection_pool;
     std::string const database;
 
     MongoDB();
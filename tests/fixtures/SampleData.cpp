@@ -79,7 +79,7 @@ void
 SampleData
 ::_populate()
 {
-    dopamine::archive::Storage storage(this->connection, this->database);
+    dopamine::archive::Storage storage(this->connection_pool, this->database);
 
     std::vector<std::string> const modalities{"MR", "CT"};
     std::vector<std::string> const sop_classes{